@@ -19,9 +19,6 @@ uint16_t MEASURE_DELAY = 1000;   // Time interval in milliseconds (1 second)
 // Initialize SoftwareSerial on pins 8 and 9
 SoftwareSerial softSerial(SOFT_RX_PIN, SOFT_TX_PIN);
 
-// used for timer
-unsigned long lastExecutionTime = 0;
-
 // buffer for the kiss instance
 uint8_t buffer[128];
 // output frame array
@@ -30,8 +27,21 @@ uint8_t output[128];
 size_t index = 0;
 // header for the incoming frame
 uint8_t header;
-// float uint8_t pointer for payload data to send
-uint8_t* b;
+
+// telemetry values, little endian on the link whatever the byte order of the board
+uint8_t temperature[4];
+uint8_t uptime[4];
+
+// IDs of the telemetry items
+#define TELEMETRY_TEMPERATURE 1
+#define TELEMETRY_UPTIME 2
+
+// the temperature every MEASURE_DELAY milliseconds, the uptime every 10 s, sorted by priority
+kiss_telemetry_t telemetry_items[] = {
+  {TELEMETRY_TEMPERATURE, sizeof(temperature), 0, 1000, temperature, 0},
+  {TELEMETRY_UPTIME, sizeof(uptime), 1, 10000, uptime, 0},
+};
+kiss_scheduler_t scheduler;
 // errors for kiss
 int err = 0;
 
@@ -51,7 +61,9 @@ void setup()
   softSerial.begin(9600);
 
   // initialization of the kiss instance
-  kiss_init(&kiss, buffer, 128, 1, write, read, NULL, 0);
+  kiss_init(&kiss, buffer, 128, 1, write, read, NULL, 0, KISS_CRC32_OFF);
+  kiss_set_clock(&kiss, millis_clock);
+  kiss_scheduler_init(&scheduler, telemetry_items, 2, sample, NULL);
   
   // system initialized serial printing
   Serial.println(F("System Initialized..."));
@@ -60,38 +72,8 @@ void setup()
 
 void loop() 
 {
-  // Non-blocking timer using millis()
-  unsigned long currentMillis = millis();
-  
-  // if we need to update the temperature data
-  if (currentMillis - lastExecutionTime >= MEASURE_DELAY) 
-  {
-    // save last execution time
-    lastExecutionTime = currentMillis;
-
-    // Read temperature from the I2C sensor
-    float currentTemp = readTemperature();
-
-    // Check if the reading is valid
-    if (!isnan(currentTemp)) 
-    {
-        // float to 4 bytes pointer
-        b = (uint8_t*)(void*)&currentTemp;
-
-        // encode payload data
-        err = kiss_encode(&kiss, b, 4, KISS_HEADER_DATA(0));
-
-        if(err != 0)
-        {
-          // send frame 
-          err = kiss_send_frame(&kiss);
-
-          if(err != 0)
-            kiss_send_frame(&kiss);
-        }
-
-    }
-  }
+  // sends the telemetry items that are due, in one frame when they are due together
+  err = kiss_scheduler_poll(&kiss, &scheduler, 0, NULL);
   
   // if we receive a frame
   if(kiss_receive_frame(&kiss, 1) == 0)
@@ -109,6 +91,7 @@ void loop()
       { 
         // changing the measuring delay
         MEASURE_DELAY = ((output[1] & 0xFF) << 8) | ((output[0] & 0xFF) << 0);
+        telemetry_items[0].period_ms = MEASURE_DELAY;
       }
       else if(header == KISS_HEADER_PING)
       {
@@ -152,6 +135,46 @@ float readTemperature()
   return NAN;
 }
 
+/**
+ * Writes a 32 bit value in little endian order.
+ */
+void put_le32(uint8_t *out, uint32_t value)
+{
+  for(uint8_t i = 0; i < 4; i++)
+    out[i] = (uint8_t)(value >> (8 * i));
+}
+
+/**
+ * Called by the scheduler right before a value is sent.
+ * A failed temperature reading is not sent.
+ */
+int32_t sample(kiss_instance_t *kiss, uint16_t ID, void *user)
+{
+  if(ID == TELEMETRY_TEMPERATURE)
+  {
+    float currentTemp = readTemperature();
+    if(isnan(currentTemp))
+      return 1;
+    // the IEEE 754 bits of the float, sent like an uint32_t
+    uint32_t bits;
+    memcpy(&bits, &currentTemp, sizeof(bits));
+    put_le32(temperature, bits);
+  }
+  else if(ID == TELEMETRY_UPTIME)
+  {
+    put_le32(uptime, millis());
+  }
+  return 0;
+}
+
+/**
+ * Millisecond clock of the kiss instance
+ */
+uint32_t millis_clock(kiss_instance_t *kiss)
+{
+  return millis();
+}
+
 /**
  * Transmits a custom data packet through SoftwareSerial.
  * Protocol: [STX] [ID] [FLOAT_DATA] [ETX]
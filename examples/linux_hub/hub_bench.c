@@ -0,0 +1,256 @@
+/*
+* Ground station hub benchmark: many links received by one thread, with epoll and the serial transport
+* (one read() per link per wake up) and with the io_uring transport (one io_uring_enter per loop for all the links).
+* The links are pty pairs and socket pairs, a generator thread sends the frames on the other side.
+*
+* gcc -O2 -std=c99 -I../.. hub_bench.c ../../kissLIB.c ../../linux/kiss_serial.c ../../linux/kiss_uring.c -lpthread -o hub_bench
+* ./hub_bench [links] [frames per link]
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "kissLIB.h"
+#include "linux/kiss_serial.h"
+#include "linux/kiss_uring.h"
+
+
+#define MAX_LINKS KISS_URING_MAX_LINKS
+#define PAYLOAD_SIZE 64
+
+static int links = 32;
+static int frames_per_link = 20000;
+
+// hub side and generator side of every link
+static int hub_fd[MAX_LINKS], gen_fd[MAX_LINKS];
+static kiss_instance_t hub_kiss[MAX_LINKS], gen_kiss[MAX_LINKS];
+static uint8_t hub_buffer[MAX_LINKS][256], gen_buffer[MAX_LINKS][256];
+static kiss_serial_t hub_port[MAX_LINKS], gen_port[MAX_LINKS];
+static kiss_handler_t handlers[KISS_HANDLER_COUNT];
+static kiss_uring_t hub;
+
+static volatile uint64_t received;
+static uint64_t read_calls;
+
+
+
+// every data frame received by the hub
+int32_t on_data(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    (void)kiss;
+    (void)header;
+    (void)payload;
+    (void)length;
+    (void)user;
+
+    received++;
+    return KISS_OK;
+}
+
+
+
+// counts the read() system calls of the serial transport: it reads only when its buffer is empty
+int32_t counting_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received_len)
+{
+    if(0 == kiss_serial_pending((kiss_serial_t *)kiss->context))
+    {
+        read_calls++;
+    }
+    return kiss_serial_read(kiss, buffer, dataLen, received_len);
+}
+
+
+
+// the generator sends the frames of all the links round robin
+void *generator(void *arg)
+{
+    (void)arg;
+
+    uint8_t payload[PAYLOAD_SIZE];
+    for(int i = 0; i < PAYLOAD_SIZE; i++)
+    {
+        payload[i] = (uint8_t)(i * 7);
+    }
+
+    for(int f = 0; f < frames_per_link; f++)
+    {
+        for(int l = 0; l < links; l++)
+        {
+            payload[0] = (uint8_t)f;
+            kiss_encode_and_send(&gen_kiss[l], payload, PAYLOAD_SIZE, KISS_HEADER_DATA(0));
+        }
+    }
+    return NULL;
+}
+
+
+
+// a pty pair for the even links, a socket pair for the odd ones
+void open_links(void)
+{
+    for(int l = 0; l < links; l++)
+    {
+        if(l % 2)
+        {
+            int sv[2];
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+            hub_fd[l] = sv[0];
+            gen_fd[l] = sv[1];
+        }
+        else
+        {
+            gen_fd[l] = posix_openpt(O_RDWR | O_NOCTTY);
+            grantpt(gen_fd[l]);
+            unlockpt(gen_fd[l]);
+            hub_fd[l] = open(ptsname(gen_fd[l]), O_RDWR | O_NOCTTY);
+        }
+        kiss_serial_attach(&gen_port[l], gen_fd[l], -1);
+        kiss_init(&gen_kiss[l], gen_buffer[l], sizeof(gen_buffer[l]), 1, kiss_serial_write, kiss_serial_read, &gen_port[l], 0, KISS_CRC32_ON);
+    }
+}
+
+
+
+void close_links(void)
+{
+    for(int l = 0; l < links; l++)
+    {
+        close(hub_fd[l]);
+        close(gen_fd[l]);
+    }
+}
+
+
+
+double now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+void report(const char *name, double wall, double cpu, uint64_t syscalls)
+{
+    uint64_t total = (uint64_t)links * frames_per_link;
+    printf("%-9s %8.0f frames/s  %6.3f us CPU/frame  %8.2f frames/syscall\n",
+        name, total / wall, cpu * 1e6 / total, (double)total / syscalls);
+}
+
+
+
+void bench_epoll(void)
+{
+    open_links();
+    int ep = epoll_create1(0);
+    for(int l = 0; l < links; l++)
+    {
+        // the reads wait a little only to complete a frame already started
+        kiss_serial_attach(&hub_port[l], hub_fd[l], 50);
+        kiss_init(&hub_kiss[l], hub_buffer[l], sizeof(hub_buffer[l]), 1, kiss_serial_write, counting_read, &hub_port[l], 0, KISS_CRC32_ON);
+        kiss_set_handlers(&hub_kiss[l], handlers);
+        struct epoll_event ev = {EPOLLIN, {.u32 = (uint32_t)l}};
+        epoll_ctl(ep, EPOLL_CTL_ADD, hub_fd[l], &ev);
+    }
+
+    received = 0;
+    read_calls = 0;
+    uint64_t waits = 0;
+    pthread_t thread;
+    double wall = now(CLOCK_MONOTONIC), cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    pthread_create(&thread, NULL, generator, NULL);
+
+    struct epoll_event events[MAX_LINKS];
+    while(received < (uint64_t)links * frames_per_link)
+    {
+        int n = epoll_wait(ep, events, MAX_LINKS, 1000);
+        waits++;
+        for(int i = 0; i < n; i++)
+        {
+            int l = (int)events[i].data.u32;
+            do
+            {
+                kiss_poll(&hub_kiss[l], 4, NULL, NULL, NULL);
+            }
+            while(kiss_serial_pending(&hub_port[l]) > 0);
+        }
+    }
+
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    wall = now(CLOCK_MONOTONIC) - wall;
+    pthread_join(thread, NULL);
+    report("epoll", wall, cpu, waits + read_calls);
+    close(ep);
+    close_links();
+}
+
+
+
+void bench_uring(void)
+{
+    open_links();
+    if(kiss_uring_init(&hub) != KISS_OK)
+    {
+        perror("io_uring");
+        close_links();
+        return;
+    }
+    for(int l = 0; l < links; l++)
+    {
+        kiss_init(&hub_kiss[l], hub_buffer[l], sizeof(hub_buffer[l]), 1, kiss_uring_write, kiss_uring_read, NULL, 0, KISS_CRC32_ON);
+        kiss_set_handlers(&hub_kiss[l], handlers);
+        kiss_uring_add(&hub, &hub_kiss[l], hub_fd[l]);
+    }
+
+    received = 0;
+    pthread_t thread;
+    double wall = now(CLOCK_MONOTONIC), cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    pthread_create(&thread, NULL, generator, NULL);
+
+    while(received < (uint64_t)links * frames_per_link)
+    {
+        kiss_uring_run(&hub, 1000, NULL);
+    }
+
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    wall = now(CLOCK_MONOTONIC) - wall;
+    pthread_join(thread, NULL);
+    report("io_uring", wall, cpu, hub.syscalls);
+    kiss_uring_close(&hub);
+    close_links();
+}
+
+
+
+int main(int argc, char **argv)
+{
+    if(argc > 1)
+    {
+        links = atoi(argv[1]);
+    }
+    if(argc > 2)
+    {
+        frames_per_link = atoi(argv[2]);
+    }
+    if(links < 1 || links > MAX_LINKS || frames_per_link < 1)
+    {
+        printf("usage: %s [links 1-%d] [frames per link]\n", argv[0], MAX_LINKS);
+        return 1;
+    }
+
+    handlers[0].fn = on_data;
+    printf("%d links, %d frames of %d bytes per link\n", links, frames_per_link, PAYLOAD_SIZE);
+    bench_epoll();
+    bench_uring();
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+/*
+* KISS over TCP server benchmark on the loopback: one server, a TNC simulated by a socket pair on the link
+* and many TCP clients, all in one thread.
+* Fan-out: the TNC sends bursts of data frames, every client must receive all of them.
+* Forwarding: every client sends bursts of frames, the TNC must receive all of them (the server stops reading
+* the clients while the link is full, so nothing is lost).
+*
+* gcc -O2 -std=c99 -I../.. tcp_bench.c ../../kissLIB.c ../../linux/kiss_serial.c ../../linux/kiss_tcp.c -o tcp_bench
+* ./tcp_bench [clients] [frames]
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "kissLIB.h"
+#include "linux/kiss_serial.h"
+#include "linux/kiss_tcp.h"
+
+
+#define MAX_CLIENTS KISS_TCP_MAX_CLIENTS
+#define BURST 32
+#define PAYLOAD_SIZE 200
+/* rounds of the server without progress before a run is declared stalled */
+#define STALL_ROUNDS 100
+
+static int clients = 8;
+static int frames = 20000;
+
+static kiss_tcp_server_t server;
+// link side (the server) and TNC side of the socket pair
+static kiss_serial_t link_port, tnc_port;
+static kiss_instance_t link_kiss, tnc_kiss;
+static uint8_t link_buffer[2 * PAYLOAD_SIZE + 16], tnc_buffer[2 * PAYLOAD_SIZE + 16];
+// the applications connected to the server
+static int client_fd[MAX_CLIENTS];
+static kiss_serial_t client_port[MAX_CLIENTS];
+static kiss_instance_t client_kiss[MAX_CLIENTS];
+static uint8_t client_buffer[MAX_CLIENTS][2 * PAYLOAD_SIZE + 16];
+
+static uint8_t payload[PAYLOAD_SIZE];
+static uint8_t output[PAYLOAD_SIZE];
+static size_t last_read;
+
+
+
+double now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+void report(const char *name, long delivered, long expected, double wall, double cpu)
+{
+    printf("%-11s %8.0f frames/s  %6.3f us CPU/frame  (%ld of %ld frames delivered)\n",
+        name, delivered / wall, cpu * 1e6 / delivered, delivered, expected);
+}
+
+
+
+// bytes given by the last read: a read can end in the middle of a frame, the socket is empty only when it gives nothing
+int32_t tracking_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received_len)
+{
+    int32_t err = kiss_serial_read(kiss, buffer, dataLen, received_len);
+    last_read = *received_len;
+    return err;
+}
+
+
+
+// every frame already arrived on an instance whose reads do not wait
+int drain(kiss_instance_t *const kiss, kiss_serial_t *const port)
+{
+    int received = 0;
+    for(;;)
+    {
+        last_read = 0;
+        if(KISS_OK == kiss_receive_frame(kiss, 1))
+        {
+            size_t length = 0;
+            uint8_t header = 0;
+            if(KISS_OK == kiss_std_decode(kiss, output, sizeof(output), &length, &header))
+            {
+                received++;
+            }
+        }
+        else if(0 == last_read && 0 == kiss_serial_pending(port))
+        {
+            return received;
+        }
+    }
+}
+
+
+
+// the server, the TNC on its link and the clients connected on the loopback
+int open_all(void)
+{
+    if(kiss_tcp_server_init(&server, "127.0.0.1", 0) != KISS_OK)
+    {
+        return 1;
+    }
+
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+    {
+        return 1;
+    }
+    kiss_serial_attach(&link_port, sv[0], 0);
+    kiss_serial_attach(&tnc_port, sv[1], 0);
+    kiss_init(&link_kiss, link_buffer, sizeof(link_buffer), 0, kiss_serial_write, kiss_serial_read, &link_port, 0, KISS_CRC32_OFF);
+    kiss_init(&tnc_kiss, tnc_buffer, sizeof(tnc_buffer), 0, kiss_serial_write, tracking_read, &tnc_port, 0, KISS_CRC32_OFF);
+    kiss_tcp_server_set_link(&server, &link_kiss, sv[0]);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kiss_tcp_server_port(&server));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for(int c = 0; c < clients; c++)
+    {
+        client_fd[c] = socket(AF_INET, SOCK_STREAM, 0);
+        if(client_fd[c] < 0 || connect(client_fd[c], (const struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            return 1;
+        }
+        // small frames: do not wait to fill a segment
+        int one = 1;
+        setsockopt(client_fd[c], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        kiss_serial_attach(&client_port[c], client_fd[c], 0);
+        kiss_init(&client_kiss[c], client_buffer[c], sizeof(client_buffer[c]), 0, kiss_serial_write, tracking_read, &client_port[c], 0, KISS_CRC32_OFF);
+    }
+
+    for(int round = 0; round < STALL_ROUNDS && server.count < (uint32_t)clients; round++)
+    {
+        kiss_tcp_server_run(&server, 10);
+    }
+    return (server.count == (uint32_t)clients) ? 0 : 1;
+}
+
+
+
+void close_all(void)
+{
+    for(int c = 0; c < clients; c++)
+    {
+        close(client_fd[c]);
+    }
+    kiss_tcp_server_close(&server);
+    close(link_port.fd);
+    close(tnc_port.fd);
+}
+
+
+
+// TNC -> every client, a burst is received by everybody before the next one
+void bench_fanout(void)
+{
+    long received[MAX_CLIENTS] = {0};
+    long delivered = 0;
+
+    double wall = now(CLOCK_MONOTONIC), cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    for(int f = 0; f < frames; f += BURST)
+    {
+        int burst = (frames - f < BURST) ? (frames - f) : BURST;
+        for(int i = 0; i < burst; i++)
+        {
+            payload[0] = (uint8_t)(f + i);
+            kiss_std_send(&tnc_kiss, KISS_STD_HEADER(0, KISS_STD_DATA), payload, PAYLOAD_SIZE);
+        }
+
+        long target = f + burst;
+        int idle = 0;
+        int done = 0;
+        while(!done && idle < STALL_ROUNDS)
+        {
+            kiss_tcp_server_run(&server, 1);
+            done = 1;
+            int progress = 0;
+            for(int c = 0; c < clients; c++)
+            {
+                int n = drain(&client_kiss[c], &client_port[c]);
+                received[c] += n;
+                delivered += n;
+                progress += n;
+                done = done && (received[c] >= target);
+            }
+            idle = progress ? 0 : idle + 1;
+        }
+    }
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    wall = now(CLOCK_MONOTONIC) - wall;
+
+    report("fan-out", delivered, (long)frames * clients, wall, cpu);
+}
+
+
+
+// every client -> TNC, the server forwards everything even when the link is slower than the clients
+void bench_forward(void)
+{
+    long delivered = 0;
+    long expected = 0;
+
+    double wall = now(CLOCK_MONOTONIC), cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    for(int f = 0; f < frames; f += BURST)
+    {
+        int burst = (frames - f < BURST) ? (frames - f) : BURST;
+        for(int c = 0; c < clients; c++)
+        {
+            for(int i = 0; i < burst; i++)
+            {
+                payload[0] = (uint8_t)(f + i);
+                kiss_std_send(&client_kiss[c], KISS_STD_HEADER(1, KISS_STD_DATA), payload, PAYLOAD_SIZE);
+            }
+        }
+        expected += (long)burst * clients;
+
+        int idle = 0;
+        while(delivered < expected && idle < STALL_ROUNDS)
+        {
+            kiss_tcp_server_run(&server, 1);
+            int n = drain(&tnc_kiss, &tnc_port);
+            delivered += n;
+            idle = n ? 0 : idle + 1;
+        }
+    }
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    wall = now(CLOCK_MONOTONIC) - wall;
+
+    report("forwarding", delivered, expected, wall, cpu);
+}
+
+
+
+int main(int argc, char **argv)
+{
+    if(argc > 1)
+    {
+        clients = atoi(argv[1]);
+    }
+    if(argc > 2)
+    {
+        frames = atoi(argv[2]);
+    }
+    if(clients < 1 || clients > MAX_CLIENTS || frames < 1)
+    {
+        printf("usage: %s [clients 1-%d] [frames]\n", argv[0], MAX_CLIENTS);
+        return 1;
+    }
+
+    for(int i = 0; i < PAYLOAD_SIZE; i++)
+    {
+        payload[i] = (i % 4) ? (uint8_t)i : KISS_FEND;
+    }
+    if(open_all() != 0)
+    {
+        printf("cannot open the server and the clients on the loopback\n");
+        return 1;
+    }
+
+    printf("%d clients, %d frames of %d bytes\n", clients, frames, PAYLOAD_SIZE);
+    bench_fanout();
+    bench_forward();
+
+    close_all();
+    return 0;
+}
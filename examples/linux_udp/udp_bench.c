@@ -0,0 +1,182 @@
+/*
+* Link benchmark between two processes on the same machine (here two instances in one thread), on the same UDP sockets:
+* KISS framing with the serial transport (escaping, one write and one read per frame)
+* against the datagram framing with the UDP transport (no escaping, one sendmmsg/recvmmsg per batch of frames).
+* The payloads are the worst case for the escaping: half of the bytes are FEND or FESC.
+*
+* gcc -O2 -std=c99 -I../.. udp_bench.c ../../kissLIB.c ../../linux/kiss_serial.c ../../linux/kiss_udp.c -o udp_bench
+* ./udp_bench [frames] [payload bytes]
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kissLIB.h"
+#include "linux/kiss_serial.h"
+#include "linux/kiss_udp.h"
+
+
+#define BURST KISS_UDP_BATCH
+#define MAX_PAYLOAD 1024
+
+static int frames = 200000;
+static int payload_size = 256;
+
+static uint8_t payload[MAX_PAYLOAD];
+static uint8_t tx_buffer[2 * MAX_PAYLOAD + 16], rx_buffer[2 * MAX_PAYLOAD + 16], output[2 * MAX_PAYLOAD];
+static kiss_instance_t tx, rx;
+static kiss_serial_t tx_port, rx_port;
+static kiss_udp_t tx_udp, rx_udp;
+static uint64_t kiss_calls;
+
+
+
+// counts the write() system calls of the serial transport, one datagram per frame
+int32_t counting_write(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    kiss_calls++;
+    return kiss_serial_write(kiss, data, length);
+}
+
+
+
+// counts the read() system calls of the serial transport: it reads only when its buffer is empty
+int32_t counting_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received_len)
+{
+    if(0 == kiss_serial_pending((kiss_serial_t *)kiss->context))
+    {
+        kiss_calls++;
+    }
+    return kiss_serial_read(kiss, buffer, dataLen, received_len);
+}
+
+
+
+double now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+void report(const char *name, int received, double wall, double cpu, uint64_t syscalls)
+{
+    printf("%-9s %8.0f frames/s  %6.3f us CPU/frame  %6.2f frames/syscall  (%d frames received)\n",
+        name, received / wall, cpu * 1e6 / received, (double)received / syscalls, received);
+}
+
+
+
+// bursts of frames from tx to rx, every burst is received before the next one
+int run(void)
+{
+    int received = 0;
+    for(int f = 0; f < frames; f += BURST)
+    {
+        for(int i = 0; i < BURST; i++)
+        {
+            payload[0] = (uint8_t)(f + i);
+            kiss_encode_and_send(&tx, payload, payload_size, KISS_HEADER_DATA(0));
+        }
+        if(tx.context == &tx_udp)
+        {
+            kiss_udp_flush(&tx_udp);
+        }
+
+        for(int i = 0; i < BURST; i++)
+        {
+            size_t length = 0;
+            uint8_t header = 0;
+            if(kiss_receive_frame(&rx, 4) != KISS_OK || kiss_decode(&rx, output, sizeof(output), &length, &header) != KISS_OK)
+            {
+                break;
+            }
+            received++;
+        }
+    }
+    return received;
+}
+
+
+
+// two UDP sockets on the loopback sending to each other
+void open_sockets(void)
+{
+    kiss_udp_open(&tx_udp, "127.0.0.1", 0, 1000);
+    kiss_udp_open(&rx_udp, "127.0.0.1", 0, 1000);
+    kiss_udp_connect(&tx_udp, "127.0.0.1", kiss_udp_port(&rx_udp));
+    kiss_udp_connect(&rx_udp, "127.0.0.1", kiss_udp_port(&tx_udp));
+}
+
+
+
+void bench_kiss(void)
+{
+    open_sockets();
+    kiss_serial_attach(&tx_port, tx_udp.fd, 1000);
+    kiss_serial_attach(&rx_port, rx_udp.fd, 1000);
+    kiss_init(&tx, tx_buffer, sizeof(tx_buffer), 0, counting_write, kiss_serial_read, &tx_port, 0, KISS_CRC32_ON);
+    kiss_init(&rx, rx_buffer, sizeof(rx_buffer), 0, kiss_serial_write, counting_read, &rx_port, 0, KISS_CRC32_ON);
+
+    kiss_calls = 0;
+    double wall = now(CLOCK_MONOTONIC), cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    int received = run();
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    wall = now(CLOCK_MONOTONIC) - wall;
+
+    report("KISS", received, wall, cpu, kiss_calls);
+    kiss_udp_close(&tx_udp);
+    kiss_udp_close(&rx_udp);
+}
+
+
+
+void bench_udp(void)
+{
+    open_sockets();
+    kiss_init(&tx, tx_buffer, sizeof(tx_buffer), 0, kiss_udp_write, kiss_udp_read, &tx_udp, 0, KISS_CRC32_ON | KISS_FRAMING_DATAGRAM);
+    kiss_init(&rx, rx_buffer, sizeof(rx_buffer), 0, kiss_udp_write, kiss_udp_read, &rx_udp, 0, KISS_CRC32_ON | KISS_FRAMING_DATAGRAM);
+
+    double wall = now(CLOCK_MONOTONIC), cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    int received = run();
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    wall = now(CLOCK_MONOTONIC) - wall;
+
+    report("datagram", received, wall, cpu, (uint64_t)tx_udp.syscalls + rx_udp.syscalls);
+    kiss_udp_close(&tx_udp);
+    kiss_udp_close(&rx_udp);
+}
+
+
+
+int main(int argc, char **argv)
+{
+    if(argc > 1)
+    {
+        frames = atoi(argv[1]);
+    }
+    if(argc > 2)
+    {
+        payload_size = atoi(argv[2]);
+    }
+    if(frames < 1 || payload_size < 1 || payload_size > MAX_PAYLOAD)
+    {
+        printf("usage: %s [frames] [payload bytes 1-%d]\n", argv[0], MAX_PAYLOAD);
+        return 1;
+    }
+
+    for(int i = 0; i < MAX_PAYLOAD; i++)
+    {
+        payload[i] = (i % 2) ? KISS_FEND : (uint8_t)i;
+    }
+    printf("%d frames of %d bytes\n", frames, payload_size);
+    bench_kiss();
+    bench_udp();
+
+    return 0;
+}
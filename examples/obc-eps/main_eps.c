@@ -66,6 +66,15 @@ int32_t read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen,
     return 0;
 }
 
+/* * Command handler for DATA_CMD_RESET.
+ * Clears the internal data string, the user pointer is the DATA string.
+ */
+int32_t cmd_reset_data(kiss_instance_t *const kiss, uint16_t command, const uint8_t *const args, size_t length, void *const user)
+{
+    strcpy((char*)user, "");
+    return 0;
+}
+
 /* * Utility function to generate pseudo-random telemetry values.
  * Returns a value within the [low, up] inclusive range.
  */
@@ -139,6 +148,42 @@ int main()
         return 1;
     }
 
+    /* * Parameter registry:
+     * maps each ID to the variable, sorted by ID (consecutive, so the lookup is a direct index).
+     * Configuration parameters can be read and written, sensors are read only.
+     */
+    const kiss_param_t eps_params[] = {
+        {PARAM1_ID, 2, KISS_PARAM_RW, &PARAM1},
+        {PARAM2_ID, 2, KISS_PARAM_RW, &PARAM2},
+        {PARAM3_ID, 2, KISS_PARAM_RW, &PARAM3},
+        {PARAM4_ID, 2, KISS_PARAM_RW, &PARAM4},
+        {SENS1_ID, 4, KISS_PARAM_READ, &SENS1},
+        {SENS2_ID, 4, KISS_PARAM_READ, &SENS2},
+        {SENS3_ID, 4, KISS_PARAM_READ, &SENS3},
+    };
+    kiss_registry_t eps_registry;
+    kiss_obc_err = kiss_registry_init(&eps_registry, eps_params, sizeof(eps_params) / sizeof(eps_params[0]));
+    if(kiss_obc_err != KISS_OK)
+    {
+        printf("Error init parameter registry\n");
+        return 1;
+    }
+
+    /* * Command dispatch table:
+     * maps each command ID to its handler, sorted by ID.
+     * No automatic ACK: the OBC sends the reset without waiting for an answer.
+     */
+    const kiss_command_t eps_command_list[] = {
+        {DATA_CMD_RESET, cmd_reset_data, DATA},
+    };
+    kiss_command_table_t eps_commands;
+    kiss_obc_err = kiss_command_table_init(&eps_commands, eps_command_list, 1, 0, NULL);
+    if(kiss_obc_err != KISS_OK)
+    {
+        printf("Error init command table\n");
+        return 1;
+    }
+
     /* Flag to force a UI refresh when new data arrives */
     int update = 0;
 
@@ -157,15 +202,10 @@ int main()
             switch(header_obc)
             {
                 case KISS_HEADER_COMMAND:
-                    /* Convert the first two bytes of the payload into a 16-bit command ID */
-                    uint16_t cmd = KISS_BYTE_TO_UINT16(output_obc[0], output_obc[1]);
-                    switch(cmd)
-                    {
-                        case DATA_CMD_RESET:
-                            /* Clear the internal data string */
-                            strcpy(DATA, "");
-                            break;
-                    }
+                    /* * The command ID is looked up in the dispatch table and its handler is called,
+                     * the table answers NACK only for unknown commands.
+                     */
+                    kiss_command_dispatch(&kiss_obc_i, &eps_commands, header_obc, output_obc, output_obc_len);
                     break;
 
                 case KISS_HEADER_DATA(5):
@@ -182,116 +222,18 @@ int main()
                     break;
 
                 case KISS_HEADER_REQUEST_PARAM:
-                    /* * Master requested the value of a specific parameter.
-                     * Extract the ID from the received frame.
-                     */
-                    uint16_t id = 0;
-                    kiss_extract_param(&kiss_obc_i, &id, NULL, 0, NULL);
-                    uint8_t *bs;
-                    size_t len_bs = 0;
-
-                    uint8_t exit_all = 0;
-                    /* Map the ID to the local variable and split into bytes */
-                    switch(id)
-                    {
-                        case PARAM1_ID:
-                            bs = (uint8_t*)&PARAM1;
-                            len_bs = 2;
-                            break;
-                        case PARAM2_ID:
-                            bs = (uint8_t*)&PARAM2;
-                            len_bs = 2;
-                            break;
-                        case PARAM3_ID:
-                            bs = (uint8_t*)&PARAM3;
-                            len_bs = 2;
-                            break;
-                        case PARAM4_ID:
-                            bs = (uint8_t*)&PARAM4;
-                            len_bs = 2;
-                            break;     
-                        case SENS1_ID:
-                            bs = (uint8_t*)&SENS1;
-                            len_bs = 4;  
-                            break;
-                        case SENS2_ID:
-                            bs = (uint8_t*)&SENS2;
-                            len_bs = 4;
-                            break;
-                        case SENS3_ID:
-                            bs = (uint8_t*)&SENS3;
-                            len_bs = 4;
-                            break;      
-                        default:
-                            kiss_send_nack(&kiss_obc_i);
-                            exit_all = 1;
-                            break;
-                    }
-
-                    if(exit_all) 
-                    {
-                        break;
-                    }
-                    
-                    /* * Build the response frame:
-                     * 1. Start encoding with the ID as payload.
-                     * 2. Append (push) the actual parameter value.
-                     * 3. Send the final encapsulated frame.
+                case KISS_HEADER_REQUEST_PARAM_TAG:
+                case KISS_HEADER_SET_PARAM:
+                    /* * Parameter frames are answered directly from the registry:
+                     * requests get the value read from the variable (NACK if unknown),
+                     * sets are written into the variable and ACKed (NACK if not writable).
                      */
-                    kiss_obc_err = kiss_encode(&kiss_obc_i, (uint8_t *)&id, 2, KISS_HEADER_REQUEST_PARAM);
-                    if(kiss_obc_err != KISS_OK)
-                    {
-                        printf("Error encoding ID\n");
-                        return 1;
-                    }
-                    
-                    kiss_obc_err = kiss_push_encode(&kiss_obc_i, bs, len_bs);
-                    if(kiss_obc_err != KISS_OK)
-                    {
-                        printf("Error push encoding value\n");
-                        return 1;
-                    }
-                    
                     /* Apply delay before sending to simulate hardware turnaround time */
                     Sleep(kiss_obc_i.TXdelay*10);
-                    kiss_obc_err = kiss_send_frame(&kiss_obc_i);
-                    if(kiss_obc_err != KISS_OK)
-                    {
-                        printf("Error sending value\n");
-                        return 1;
-                    }
-                    break;
-
-                case KISS_HEADER_SET_PARAM:
-                    /* * Master requested to update a parameter value.
-                     * Extract both the ID and the new value from the frame.
-                     */
-                    uint8_t value_b[8];
-                    size_t len = 0;
-                    kiss_obc_err = kiss_extract_param(&kiss_obc_i, &id, value_b, 8, &len);
-                    
-                    /* Reconstruct the 16-bit value from bytes */
-                    uint16_t value = KISS_BYTE_TO_UINT16(value_b[0], value_b[1]);
-                    
-                    /* Apply the change to the corresponding local variable */
-                    switch(id)
-                    {
-                        case PARAM1_ID:
-                            PARAM1 = value;
-                            break;
-                        case PARAM2_ID:
-                            PARAM2 = value;
-                            break;
-                        case PARAM3_ID:
-                            PARAM3 = value;
-                            break;
-                        case PARAM4_ID:
-                            PARAM4 = value;
-                            break;
-                    }
+                    kiss_obc_err = kiss_registry_serve(&kiss_obc_i, &eps_registry, header_obc, output_obc, output_obc_len);
                     if(kiss_obc_err != KISS_OK)
                     {
-                        printf("Error during extract set param %d\n", kiss_obc_err);
+                        printf("Error serving parameter %d\n", kiss_obc_err);
                         return 1;
                     }
                     break;
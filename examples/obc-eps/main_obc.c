@@ -273,6 +273,18 @@ int main()
                     printf("Error during sending the set param %d\n", kiss_err_eps);
                     return 1;
                 }
+
+                /* the EPS answers ACK if the parameter has been written, NACK if it cannot be written */
+                kiss_err_eps = kiss_receive_and_decode(&kiss_eps_i, output, sizeof(output), &len, 100, &header);
+                if(kiss_err_eps != KISS_OK)
+                {
+                    printf("Error receiving the answer to set param %d\n", kiss_err_eps);
+                    return 1;
+                }
+
+                /* print the answer and stop for a character from the user */
+                printf("PARAM%d %s\n", param_id, (KISS_HEADER_ACK == header) ? "written" : "rejected");
+                _getch();
                 break;
             /* case 5 we want to read a sensor */
             case 5:
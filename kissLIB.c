@@ -200,6 +200,444 @@ static uint32_t kiss_crc32_push(kiss_instance_t *const kiss, uint32_t prev_crc,
 
 
 
+/*
+* COBS stuffing of `length` bytes at the end of the instance buffer
+* every block starts with a code byte (kiss->cobs_code) written when the block ends:
+* the distance to the next zero, which is removed, or 0xFF after 254 bytes without zeros
+*/
+static int32_t kiss_append_cobs(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        if(kiss->index + 1 > kiss->buffer_size)
+        {
+            kiss->Status = KISS_STATUS_ERROR_STATE;
+            return KISS_ERR_BUFFER_OVERFLOW;
+        }
+
+        if(0 == data[i])
+        {
+            /* the zero ends the block, its place is the code byte of the next block */
+            kiss->buffer[kiss->cobs_code] = (uint8_t)(kiss->index - kiss->cobs_code);
+            kiss->cobs_code = kiss->index;
+            kiss->index++;
+        }
+        else
+        {
+            kiss->buffer[kiss->index] = data[i];
+            kiss->index++;
+
+            /* full block, a new one starts without any zero removed */
+            if(0xFF == kiss->index - kiss->cobs_code)
+            {
+                if(kiss->index + 1 > kiss->buffer_size)
+                {
+                    kiss->Status = KISS_STATUS_ERROR_STATE;
+                    return KISS_ERR_BUFFER_OVERFLOW;
+                }
+                kiss->buffer[kiss->cobs_code] = 0xFF;
+                kiss->cobs_code = kiss->index;
+                kiss->index++;
+            }
+        }
+    }
+    return KISS_OK;
+}
+
+
+
+/*
+* remove the last byte stuffed with kiss_append_cobs and return it (the frame must not be closed)
+* when the current block is empty the previous one is found walking the code bytes from the start
+*/
+static uint8_t kiss_cobs_pop(kiss_instance_t *const kiss)
+{
+    if(kiss->index - kiss->cobs_code > 1)
+    {
+        kiss->index--;
+        return kiss->buffer[kiss->index];
+    }
+
+    /* the first code byte is after the opening delimiter */
+    size_t p = 1;
+    while(p + kiss->buffer[p] < kiss->cobs_code && kiss->buffer[p] != 0)
+    {
+        p += kiss->buffer[p];
+    }
+
+    uint8_t code = kiss->buffer[p];
+    kiss->index = kiss->cobs_code;
+    kiss->cobs_code = p;
+
+    if(0xFF == code)
+    {
+        /* full block: no zero between the two blocks, the byte is the last one of the block */
+        kiss->index--;
+        return kiss->buffer[kiss->index];
+    }
+
+    /* the zero removed between the two blocks */
+    return 0;
+}
+
+
+
+/* special bytes of a byte stuffing framing, for the code out of the hot loops */
+typedef struct
+{
+    uint8_t end;
+    uint8_t esc;
+    uint8_t tend;
+    uint8_t tesc;
+} kiss_special_t;
+
+static const kiss_special_t kiss_special_kiss = {KISS_FEND, KISS_FESC, KISS_TFEND, KISS_TFESC};
+static const kiss_special_t kiss_special_hdlc = {KISS_HDLC_FLAG, KISS_HDLC_ESC, KISS_HDLC_TFLAG, KISS_HDLC_TESC};
+
+
+
+/* special bytes of the instance framing (KISS and SLIP share them, COBS uses them only to scramble) */
+static const kiss_special_t *kiss_special(const kiss_instance_t *const kiss)
+{
+    return (KISS_FRAMING_HDLC == kiss->framing) ? &kiss_special_hdlc : &kiss_special_kiss;
+}
+
+
+
+/* byte delimiting the frames on the link */
+static uint8_t kiss_delimiter(const kiss_instance_t *const kiss)
+{
+    return (KISS_FRAMING_COBS == kiss->framing) ? KISS_COBS_DELIMITER : kiss_special(kiss)->end;
+}
+
+
+
+/*
+* byte stuffing engine, generated for every set of special bytes so that the loops compare with constants:
+*
+* kiss_append_<name>: escape `length` bytes from `data` and append them to the instance buffer
+* it keeps the same space checks of the original encoder and sets the error state on overflow
+*
+* kiss_unescape_<name>: unescape the received frame in the output, the output may be the instance buffer
+* (the byte is always written before the position of the next byte read). With `has_header` the first byte
+* is the header. A frame with only the opening delimiters before another one gives KISS_ERR_NO_DATA_RECEIVED
+*/
+#define KISS_DEFINE_STUFFING(name, END, ESC, TEND, TESC) \
+static int32_t kiss_append_##name(kiss_instance_t *const kiss, const uint8_t *const data, size_t length) \
+{ \
+    for(size_t i = 0; i < length; i++) \
+    { \
+        uint8_t b = data[i]; \
+        /* if it is a special character */ \
+        if((END) == b || (ESC) == b) \
+        { \
+            /* constantly check if there is enough space in the kiss buffer */ \
+            if(kiss->index + 2 > kiss->buffer_size) \
+            { \
+                kiss->Status = KISS_STATUS_ERROR_STATE; \
+                return KISS_ERR_BUFFER_OVERFLOW; \
+            } \
+            /* add escape and transposed char */ \
+            kiss->buffer[kiss->index] = (ESC); \
+            kiss->index++; \
+            kiss->buffer[kiss->index] = ((END) == b) ? (TEND) : (TESC); \
+            kiss->index++; \
+        } \
+        else \
+        { \
+            /* check again if there is enough space in the kiss buffer */ \
+            if(kiss->index + 1 > kiss->buffer_size) \
+            { \
+                kiss->Status = KISS_STATUS_ERROR_STATE; \
+                return KISS_ERR_BUFFER_OVERFLOW; \
+            } \
+            /* add the byte in the buffer */ \
+            kiss->buffer[kiss->index] = b; \
+            kiss->index++; \
+        } \
+    } \
+    return KISS_OK; \
+} \
+\
+static int32_t kiss_unescape_##name(kiss_instance_t *const kiss, uint8_t has_header, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header) \
+{ \
+    /* pointers for fast access */ \
+    const uint8_t *src = kiss->buffer; \
+    const uint8_t *src_end = kiss->buffer + kiss->index; \
+    uint8_t *dst = output; \
+    const uint8_t *dst_end = output + output_max_size; \
+\
+    /* fast skip for padding */ \
+    while (src < src_end && (END) == *src) \
+    { \
+        src++; \
+    } \
+\
+    /* if buffer ended with only FEND */ \
+    if (src >= src_end) \
+    { \
+        *output_length = 0; \
+        kiss->Status = KISS_STATUS_ERROR_STATE; \
+        return KISS_ERR_INVALID_FRAME; \
+    } \
+\
+    if (has_header) \
+    { \
+        /* first byte is always header, but it could be escaped */ \
+        uint8_t val = *src++; \
+\
+        /* header escape management */ \
+        if ((ESC) == val) \
+        { \
+            if (src >= src_end) \
+            { \
+                kiss->Status = KISS_STATUS_ERROR_STATE; \
+                return KISS_ERR_INVALID_FRAME; \
+            } \
+            val = *src++; \
+            if ((TEND) == val) \
+            { \
+                val = (END); \
+            } \
+            else if ((TESC) == val) \
+            { \
+                val = (ESC); \
+            } \
+            else \
+            { \
+                /* illigal escape found */ \
+                kiss->Status = KISS_STATUS_ERROR_STATE; \
+                return KISS_ERR_INVALID_FRAME; \
+            } \
+        } \
+        /* if we find another FEND it means there is no payload */ \
+        else if ((END) == val) \
+        { \
+            *output_length = 0; \
+            return KISS_ERR_NO_DATA_RECEIVED; \
+        } \
+        *header = val; \
+    } \
+\
+    /* MAIN LOOP (Payload) */ \
+    while (src < src_end) \
+    { \
+        uint8_t byte = *src++; \
+\
+        /* final FEND */ \
+        if ((END) == byte) \
+        { \
+            /* exiting from loop */ \
+            break; \
+        } \
+\
+        /* escape frequency found */ \
+        if ((ESC) == byte) \
+        { \
+            if (src >= src_end) \
+            { \
+                kiss->Status = KISS_STATUS_ERROR_STATE; \
+                /* buffer ended before the frame was done */ \
+                return KISS_ERR_INVALID_FRAME; \
+            } \
+\
+            /* read the next byte */ \
+            byte = *src++; \
+\
+            if ((TEND) == byte) \
+            { \
+                byte = (END); \
+            } \
+            else if ((TESC) == byte) \
+            { \
+                byte = (ESC); \
+            } \
+            else \
+            { \
+                /* the sequence was not valid */ \
+                kiss->Status = KISS_STATUS_ERROR_STATE; \
+                return KISS_ERR_INVALID_FRAME; \
+            } \
+        } \
+\
+        /* normal byte */ \
+        if (dst >= dst_end) \
+        { \
+            return KISS_ERR_BUFFER_OVERFLOW; \
+        } \
+\
+        *dst++ = byte; \
+    } \
+\
+    /* final length read */ \
+    *output_length = (size_t)(dst - output); \
+    return KISS_OK; \
+}
+
+/* KISS and SLIP */
+KISS_DEFINE_STUFFING(kiss, KISS_FEND, KISS_FESC, KISS_TFEND, KISS_TFESC)
+/* HDLC asynchronous framing */
+KISS_DEFINE_STUFFING(hdlc, KISS_HDLC_FLAG, KISS_HDLC_ESC, KISS_HDLC_TFLAG, KISS_HDLC_TESC)
+
+
+
+/* datagram framing: the bytes are appended as they are, the datagram itself delimits the frame */
+static int32_t kiss_append_plain(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    if(length > kiss->buffer_size - kiss->index)
+    {
+        kiss->Status = KISS_STATUS_ERROR_STATE;
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+    for(size_t i = 0; i < length; i++)
+    {
+        kiss->buffer[kiss->index + i] = data[i];
+    }
+    kiss->index += length;
+    return KISS_OK;
+}
+
+
+
+/* datagram framing: the first byte of the received frame is the header, the others go in the output (it may be the instance buffer) */
+static int32_t kiss_unframe_plain(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header)
+{
+    if(0 == kiss->index)
+    {
+        kiss->Status = KISS_STATUS_ERROR_STATE;
+        return KISS_ERR_INVALID_FRAME;
+    }
+    size_t n = kiss->index - 1;
+    if(n > output_max_size)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    *header = kiss->buffer[0];
+    for(size_t i = 0; i < n; i++)
+    {
+        output[i] = kiss->buffer[i + 1];
+    }
+    *output_length = n;
+    return KISS_OK;
+}
+
+
+
+/* escape `length` bytes from `data` and append them to the instance buffer, with the framing of the instance */
+static int32_t kiss_append_escaped(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    switch(kiss->framing)
+    {
+        case KISS_FRAMING_COBS:
+            return kiss_append_cobs(kiss, data, length);
+        case KISS_FRAMING_HDLC:
+            return kiss_append_hdlc(kiss, data, length);
+        case KISS_FRAMING_DATAGRAM:
+            return kiss_append_plain(kiss, data, length);
+        default:
+            return kiss_append_kiss(kiss, data, length);
+    }
+}
+
+
+
+/* append the final CRC32 (little endian, escaped) at the end of the payload */
+static int32_t kiss_append_crc32(kiss_instance_t *const kiss, uint32_t crc)
+{
+    uint8_t crc_b[4];
+    crc_b[0] = (uint8_t)(crc & 0xFF);
+    crc_b[1] = (uint8_t)((crc >> 8) & 0xFF);
+    crc_b[2] = (uint8_t)((crc >> 16) & 0xFF);
+    crc_b[3] = (uint8_t)((crc >> 24) & 0xFF);
+
+    return kiss_append_escaped(kiss, crc_b, 4);
+}
+
+
+
+/*
+* tells if a frame with this header (as it is written on the link) carries a CRC32
+* in KISS_CRC32_PER_FRAME mode the information is in the header itself
+*/
+static uint8_t kiss_header_has_crc(const kiss_instance_t *const kiss, uint8_t wire_header)
+{
+    if(KISS_CRC32_ON == kiss->CRC32)
+    {
+        return 1;
+    }
+    if(KISS_CRC32_PER_FRAME == kiss->CRC32 && (wire_header & KISS_HEADER_CRC_FLAG))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/* number of bytes that `data` takes once escaped (the COBS overhead is in kiss_payload_room) */
+static size_t kiss_escaped_len(const kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    size_t n = length;
+    if(KISS_FRAMING_COBS == kiss->framing || KISS_FRAMING_DATAGRAM == kiss->framing)
+    {
+        return n;
+    }
+    const kiss_special_t *special = kiss_special(kiss);
+    for(size_t i = 0; i < length; i++)
+    {
+        if(special->end == data[i] || special->esc == data[i])
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+
+
+/*
+* escaped payload bytes that always fit in the instance buffer for a frame with this header:
+* the buffer minus two FEND, the header and the CRC32 in their worst (escaped) size
+* with COBS: two delimiters, first code byte and header, plus one code byte every 254 bytes
+*/
+static size_t kiss_payload_room(const kiss_instance_t *const kiss, uint8_t header)
+{
+    size_t overhead = 4;
+
+    if(KISS_CRC32_ON == kiss->CRC32 ||
+        (KISS_CRC32_PER_FRAME == kiss->CRC32 && (kiss->crc_policy & (1U << KISS_HEADER_TYPE(header)))))
+    {
+        overhead += 8;
+    }
+    if(KISS_FRAMING_COBS == kiss->framing)
+    {
+        overhead += kiss->buffer_size / 254 + 1;
+    }
+
+    return (kiss->buffer_size > overhead) ? (kiss->buffer_size - overhead) : 0;
+}
+
+
+
+/* flag of the frame: only the ping, ACK and NACK control frames have one */
+static uint8_t kiss_header_flag(uint8_t header)
+{
+    switch(header)
+    {
+        case KISS_HEADER_ACK:
+            return KISS_FLAG_ACK;
+        case KISS_HEADER_NACK:
+            return KISS_FLAG_NACK;
+        case KISS_HEADER_PING:
+            return KISS_FLAG_PING;
+        default:
+            return KISS_FLAG_NONE;
+    }
+}
+
+
+
 int32_t kiss_init(kiss_instance_t *const kiss, uint8_t *const buffer, size_t buffer_size, uint8_t tx_delay, kiss_write_fn write, kiss_read_fn read, void *const context, uint8_t padding, uint8_t crc32)
 {
     if (NULL == kiss || 0 == buffer_size || NULL == buffer)
@@ -214,6 +652,15 @@ int32_t kiss_init(kiss_instance_t *const kiss, uint8_t *const buffer, size_t buf
     {
         return KISS_ERR_PADDING_OVERFLOW;
     }
+    if((crc32 & KISS_FRAMING_MASK) > KISS_FRAMING_DATAGRAM)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* the per frame CRC32 flag is in the header, SLIP frames do not have it */
+    if(KISS_FRAMING_SLIP == (crc32 & KISS_FRAMING_MASK) && KISS_CRC32_PER_FRAME == (crc32 & KISS_CRC32_MODE_MASK))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
 
     /* initialize all the parameters */
     kiss->buffer = buffer;
@@ -225,987 +672,5353 @@ int32_t kiss_init(kiss_instance_t *const kiss, uint8_t *const buffer, size_t buf
     kiss->read = read;
     kiss->Status = KISS_STATUS_NOTHING;
     kiss->padding = padding;
-    if(0 == crc32)
+    kiss->framing = (uint8_t)(crc32 & KISS_FRAMING_MASK);
+    kiss->cobs_code = 0;
+    crc32 = (uint8_t)(crc32 & KISS_CRC32_MODE_MASK);
+    if(KISS_CRC32_OFF == crc32)
+    {
+        kiss->CRC32 = KISS_CRC32_OFF;
+    }
+    else if(KISS_CRC32_PER_FRAME == crc32)
+    {
+        kiss->CRC32 = KISS_CRC32_PER_FRAME;
+    }
+    else
+    {
+        kiss->CRC32 = KISS_CRC32_ON;
+    }
+    kiss->crc_policy = KISS_CRC_POLICY_DEFAULT;
+    kiss->frame_flag = KISS_FLAG_NONE;
+    kiss->clock = NULL;
+    kiss->handlers = NULL;
+    kiss->lzss_policy = 0;
+    kiss->lzss_window = KISS_LZSS_WINDOW_DEFAULT;
+    kiss->lzss_buffer = NULL;
+    kiss->lzss_buffer_size = 0;
+    kiss->scramble_policy = 0;
+    kiss->channel = NULL;
+    kiss->persistence = KISS_STD_PERSISTENCE_DEFAULT;
+    kiss->slot_time = KISS_STD_SLOTTIME_DEFAULT;
+    kiss->TXtail = 0;
+    kiss->fullduplex = 0;
+    kiss->csma_seed = 0x2545F491UL;
+
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_set_crc_policy(kiss_instance_t *const kiss, uint8_t header, uint8_t enable)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    uint16_t bit = (uint16_t)(1U << KISS_HEADER_TYPE(header));
+
+    if(0 == enable)
     {
-        kiss->CRC32 = 0;
+        kiss->crc_policy &= (uint16_t)~bit;
     }
     else
     {
-        kiss->CRC32 = 1;
+        kiss->crc_policy |= bit;
     }
 
+    return KISS_OK;
+}
+
+
+
+
+
+int32_t kiss_set_clock(kiss_instance_t *const kiss, kiss_clock_fn clock)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss->clock = clock;
+
+    return KISS_OK;
+}
 
+
+
+/* escape bytes at the end of the frame being encoded and add them to its CRC32 */
+static int32_t kiss_frame_put(kiss_instance_t *const kiss, uint8_t use_crc, uint32_t *const crc, const uint8_t *const data, size_t length)
+{
+    int32_t err = kiss_append_escaped(kiss, data, length);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+    if(use_crc)
+    {
+        *crc = kiss_crc32_push(kiss, *crc, data, length);
+    }
     return KISS_OK;
 }
 
 
 
-
-
-int32_t kiss_encode(kiss_instance_t *const kiss, const uint8_t *const data, size_t length, uint8_t header)
+/*
+* start a frame in the instance buffer: opening FEND and escaped header
+* `use_crc` tells if the frame must end with a CRC32, `crc` starts with the header written on the link
+*/
+static int32_t kiss_frame_begin(kiss_instance_t *const kiss, uint8_t header, uint8_t *const use_crc, uint32_t *const crc)
+{
+    if(kiss->buffer_size < 3) 
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    /* the header written on the link, in per frame mode it also tells if the CRC32 is there */
+    uint8_t wire_header = header;
+    *use_crc = kiss_header_has_crc(kiss, header);
+    *crc = 0;
+
+    if(KISS_CRC32_PER_FRAME == kiss->CRC32)
+    {
+        /* the flag bit is reserved, this header cannot be sent in per frame mode */
+        if(header & KISS_HEADER_CRC_FLAG)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        if(kiss->crc_policy & (1U << KISS_HEADER_TYPE(header)))
+        {
+            wire_header |= KISS_HEADER_CRC_FLAG;
+            *use_crc = 1;
+        }
+    }
+
+    /* starting bytes of the frame, a datagram starts with the header */
+    kiss->index = 0;
+    if(kiss->framing != KISS_FRAMING_DATAGRAM)
+    {
+        kiss->buffer[kiss->index] = kiss_delimiter(kiss);
+        kiss->index++;
+    }
+
+    /* the code byte of the first COBS block */
+    if(KISS_FRAMING_COBS == kiss->framing)
+    {
+        kiss->cobs_code = kiss->index;
+        kiss->index++;
+    }
+
+    /* SLIP frames have no header, the payload starts right away */
+    if(KISS_FRAMING_SLIP == kiss->framing)
+    {
+        return KISS_OK;
+    }
+    if(*use_crc)
+    {
+        *crc = kiss_crc32_push(kiss, *crc, &wire_header, 1);
+    }
+
+    /* header, it could be escaped as any other byte */
+    return kiss_append_escaped(kiss, &wire_header, 1);
+}
+
+
+
+/* close a frame started with kiss_frame_begin: CRC32 (if used) and final FEND */
+static int32_t kiss_frame_end(kiss_instance_t *const kiss, uint8_t use_crc, uint32_t crc)
+{
+    if(use_crc)
+    {
+        int32_t err = kiss_append_crc32(kiss, ~crc);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+
+    /* Terminate frame with check and KISS_FEND byte*/
+    if(kiss->index + 1 > kiss->buffer_size)
+    {
+        kiss->Status = KISS_STATUS_ERROR_STATE;
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+    if(KISS_FRAMING_COBS == kiss->framing)
+    {
+        /* the last block ends with the frame, cobs_code stays there for kiss_push_encode */
+        kiss->buffer[kiss->cobs_code] = (uint8_t)(kiss->index - kiss->cobs_code);
+    }
+    if(kiss->framing != KISS_FRAMING_DATAGRAM)
+    {
+        kiss->buffer[kiss->index] = kiss_delimiter(kiss);
+        kiss->index++;
+    }
+
+    /* we change the status to ready to transmit */
+    kiss->Status = KISS_STATUS_TRANSMITTING;
+
+    return KISS_OK;
+}
+
+
+
+/* bit writer of the LZSS compressor, the full bytes are escaped straight in the frame */
+typedef struct
+{
+    kiss_instance_t *kiss;
+    uint8_t use_crc;
+    uint32_t crc;
+    uint8_t acc;
+    uint8_t bits;
+    size_t bytes;
+    int32_t err;
+} kiss_bit_writer_t;
+
+
+
+/* bit reader of the LZSS decompressor, it can read the escaped or stuffed bytes of a received frame */
+typedef struct
+{
+    const uint8_t *p;
+    uint8_t escaped; /* 0 plain bytes, 1 escaped with the special bytes, 2 COBS stuffed */
+    const kiss_special_t *special;
+    size_t remaining;
+    uint8_t acc;
+    uint8_t bits;
+    uint8_t block; /* COBS: bytes left in the block */
+    uint8_t zero; /* COBS: the block is followed by a removed zero */
+} kiss_bit_reader_t;
+
+
+
+/* append the `count` low bits of `value`, most significant first */
+static void kiss_bits_put(kiss_bit_writer_t *const w, uint32_t value, uint8_t count)
+{
+    while(count > 0)
+    {
+        count--;
+        w->acc = (uint8_t)((w->acc << 1) | ((value >> count) & 1U));
+        w->bits++;
+        if(8 == w->bits)
+        {
+            if(KISS_OK == w->err)
+            {
+                w->err = kiss_frame_put(w->kiss, w->use_crc, &w->crc, &w->acc, 1);
+            }
+            w->bytes++;
+            w->acc = 0;
+            w->bits = 0;
+        }
+    }
+}
+
+
+
+/* start reading the received frame from its header, after the opening delimiters */
+static void kiss_reader_frame(kiss_bit_reader_t *const r, const kiss_instance_t *const kiss)
+{
+    uint8_t delimiter = kiss_delimiter(kiss);
+
+    r->p = kiss->buffer;
+    r->escaped = (KISS_FRAMING_COBS == kiss->framing) ? 2 : 1;
+    if(KISS_FRAMING_DATAGRAM == kiss->framing)
+    {
+        /* no delimiters and no escapes, the header is the first byte */
+        r->escaped = 0;
+    }
+    while(r->escaped != 0 && delimiter == *r->p)
+    {
+        r->p++;
+    }
+    r->special = kiss_special(kiss);
+    r->remaining = 0;
+    r->acc = 0;
+    r->bits = 0;
+    r->block = 0;
+    r->zero = 0;
+
+    if(KISS_FRAMING_COBS == kiss->framing)
+    {
+        r->block = (uint8_t)(*r->p - 1);
+        r->zero = (0xFF != *r->p);
+        r->p++;
+    }
+}
+
+
+
+/* next byte of the source, the escape sequences and the COBS blocks were already checked by kiss_decode */
+static uint8_t kiss_reader_byte(kiss_bit_reader_t *const r)
+{
+    if(2 == r->escaped)
+    {
+        while(0 == r->block)
+        {
+            /* next block, the zero removed before it comes first */
+            uint8_t zero = r->zero;
+            r->block = (uint8_t)(*r->p - 1);
+            r->zero = (0xFF != *r->p);
+            r->p++;
+            if(zero)
+            {
+                return 0;
+            }
+        }
+        r->block--;
+    }
+
+    uint8_t b = *r->p;
+    r->p++;
+    if(1 == r->escaped && r->special->esc == b)
+    {
+        b = (r->special->tend == *r->p) ? r->special->end : r->special->esc;
+        r->p++;
+    }
+    return b;
+}
+
+
+
+/* bits not read yet */
+static size_t kiss_bits_left(const kiss_bit_reader_t *const r)
+{
+    return r->remaining * 8 + r->bits;
+}
+
+
+
+/* read `count` bits, most significant first. The caller checks that they are there */
+static uint32_t kiss_bits_get(kiss_bit_reader_t *const r, uint8_t count)
+{
+    uint32_t value = 0;
+    while(count > 0)
+    {
+        if(0 == r->bits)
+        {
+            r->acc = kiss_reader_byte(r);
+            r->remaining--;
+            r->bits = 8;
+        }
+        r->bits--;
+        value = (value << 1) | ((uint32_t)(r->acc >> r->bits) & 1U);
+        count--;
+    }
+    return value;
+}
+
+
+
+/*
+* encode the frame as KISS_HEADER_LZSS [header][window bits][bit stream]
+* literal: 1 + 8 bits, match: 0 + (offset - 1) on window bits + (length - KISS_LZSS_MATCH_MIN) on KISS_LZSS_LENGTH_BITS
+* the matches are searched in the payload itself, so no window buffer is needed
+* returns KISS_ERR_NOT_HANDLED when the compressed payload is not shorter, the caller encodes it as it is
+*/
+static int32_t kiss_lzss_encode(kiss_instance_t *const kiss, const uint8_t *const data, size_t length, uint8_t header)
+{
+    if(KISS_CRC32_PER_FRAME == kiss->CRC32 && (header & KISS_HEADER_CRC_FLAG))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_bit_writer_t w;
+    w.kiss = kiss;
+    w.use_crc = 0;
+    w.crc = 0;
+    w.acc = 0;
+    w.bits = 0;
+    w.bytes = 0;
+    w.err = KISS_OK;
+
+    int32_t err = kiss_frame_begin(kiss, KISS_HEADER_LZSS, &w.use_crc, &w.crc);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    uint8_t head[2] = {header, kiss->lzss_window};
+    err = kiss_frame_put(kiss, w.use_crc, &w.crc, head, 2);
+    if(err != KISS_OK)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+
+    size_t window = (size_t)1 << kiss->lzss_window;
+    size_t max_match = KISS_LZSS_MATCH_MIN + (1U << KISS_LZSS_LENGTH_BITS) - 1;
+    size_t i = 0;
+
+    while(i < length)
+    {
+        size_t best_len = 0;
+        size_t best_off = 0;
+        size_t start = (i > window) ? (i - window) : 0;
+        size_t limit = (length - i < max_match) ? (length - i) : max_match;
+
+        /* closest positions first, the match may overlap the current position */
+        for(size_t j = i; j > start; j--)
+        {
+            const uint8_t *candidate = &data[j - 1];
+            size_t k = 0;
+            while(k < limit && candidate[k] == data[i + k])
+            {
+                k++;
+            }
+            if(k > best_len)
+            {
+                best_len = k;
+                best_off = i - (j - 1);
+                if(k == limit)
+                {
+                    break;
+                }
+            }
+        }
+
+        if(best_len >= KISS_LZSS_MATCH_MIN)
+        {
+            kiss_bits_put(&w, 0, 1);
+            kiss_bits_put(&w, (uint32_t)(best_off - 1), kiss->lzss_window);
+            kiss_bits_put(&w, (uint32_t)(best_len - KISS_LZSS_MATCH_MIN), KISS_LZSS_LENGTH_BITS);
+            i += best_len;
+        }
+        else
+        {
+            kiss_bits_put(&w, 0x100U | data[i], 9);
+            i++;
+        }
+
+        /* not shorter than the payload (or too big for the buffer): it is sent as it is */
+        if(w.err != KISS_OK || w.bytes + 2 >= length)
+        {
+            return KISS_ERR_NOT_HANDLED;
+        }
+    }
+
+    /* last byte padded with zeros, too few bits for another literal or match */
+    if(w.bits > 0)
+    {
+        kiss_bits_put(&w, 0, (uint8_t)(8 - w.bits));
+    }
+    if(w.err != KISS_OK || w.bytes + 2 >= length)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+
+    return kiss_frame_end(kiss, w.use_crc, w.crc);
+}
+
+
+
+/* expand an LZSS bit stream, the matches are copied from the output itself */
+static int32_t kiss_lzss_expand(kiss_bit_reader_t *const r, uint8_t window_bits, uint8_t *const output, size_t output_max_size, size_t *const output_length)
+{
+    if(window_bits < KISS_LZSS_WINDOW_MIN || window_bits > KISS_LZSS_WINDOW_MAX)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    size_t n = 0;
+
+    /* a literal is 9 bits, the padding of the last byte is less */
+    while(kiss_bits_left(r) >= 9)
+    {
+        if(kiss_bits_get(r, 1))
+        {
+            if(n >= output_max_size)
+            {
+                return KISS_ERR_BUFFER_OVERFLOW;
+            }
+            output[n] = (uint8_t)kiss_bits_get(r, 8);
+            n++;
+        }
+        else
+        {
+            if(kiss_bits_left(r) < (size_t)window_bits + KISS_LZSS_LENGTH_BITS)
+            {
+                /* padding */
+                break;
+            }
+            size_t offset = kiss_bits_get(r, window_bits) + 1;
+            size_t len = kiss_bits_get(r, KISS_LZSS_LENGTH_BITS) + KISS_LZSS_MATCH_MIN;
+
+            if(offset > n)
+            {
+                return KISS_ERR_INVALID_FRAME;
+            }
+            if(len > output_max_size - n)
+            {
+                return KISS_ERR_BUFFER_OVERFLOW;
+            }
+            for(size_t k = 0; k < len; k++)
+            {
+                output[n] = output[n - offset];
+                n++;
+            }
+        }
+    }
+
+    *output_length = n;
+    return KISS_OK;
+}
+
+
+
+/*
+* XOR key of a scrambled payload: the first key that leaves no FEND/FESC byte of the framing (0 if there are none),
+* the presence of the byte values is enough for that. Only when the payload has all the 256 values
+* the key is the one with the fewest special bytes in the histogram.
+* The key itself is never a special byte, it is the first byte of the payload.
+*/
+static uint8_t kiss_scramble_key(const kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    const uint8_t end = kiss_special(kiss)->end;
+    const uint8_t esc = kiss_special(kiss)->esc;
+    uint8_t seen[32] = {0};
+
+    for(size_t i = 0; i < length; i++)
+    {
+        seen[data[i] >> 3] |= (uint8_t)(1U << (data[i] & 7));
+    }
+
+    for(uint16_t k = 0; k < 256; k++)
+    {
+        uint8_t a = (uint8_t)(end ^ k);
+        uint8_t b = (uint8_t)(esc ^ k);
+        if(end == k || esc == k)
+        {
+            continue;
+        }
+        if(0 == (seen[a >> 3] & (1U << (a & 7))) && 0 == (seen[b >> 3] & (1U << (b & 7))))
+        {
+            return (uint8_t)k;
+        }
+    }
+
+    uint16_t hist[256] = {0};
+    for(size_t i = 0; i < length; i++)
+    {
+        if(hist[data[i]] < 0xFFFF)
+        {
+            hist[data[i]]++;
+        }
+    }
+
+    uint8_t best = 0;
+    uint32_t best_cost = (uint32_t)hist[end] + hist[esc];
+    for(uint16_t k = 1; k < 256; k++)
+    {
+        if(end == k || esc == k)
+        {
+            continue;
+        }
+        uint32_t cost = (uint32_t)hist[end ^ k] + hist[esc ^ k];
+        if(cost < best_cost)
+        {
+            best = (uint8_t)k;
+            best_cost = cost;
+        }
+    }
+
+    return best;
+}
+
+
+
+int32_t kiss_encode(kiss_instance_t *const kiss, const uint8_t *const data, size_t length, uint8_t header)
+{
+    /* check for parameters error or size of the buffer too small for the payload */
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == data && length > 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* compressed payload, sent only if it is shorter (SLIP frames cannot tell that they are compressed) */
+    if((kiss->lzss_policy & (1U << KISS_HEADER_TYPE(header))) && kiss->framing != KISS_FRAMING_SLIP)
+    {
+        int32_t lzss_err = kiss_lzss_encode(kiss, data, length, header);
+        if(lzss_err != KISS_ERR_NOT_HANDLED)
+        {
+            return lzss_err;
+        }
+    }
+
+    uint8_t use_crc = 0;
+    uint32_t crc = 0;
+
+    int32_t err = kiss_frame_begin(kiss, header, &use_crc, &crc);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    if(kiss->scramble_policy & (1U << KISS_HEADER_TYPE(header)))
+    {
+        /* key prefix, then the payload XORed a few bytes at a time */
+        uint8_t key = kiss_scramble_key(kiss, data, length);
+        err = kiss_frame_put(kiss, use_crc, &crc, &key, 1);
+
+        size_t i = 0;
+        while(KISS_OK == err && i < length)
+        {
+            uint8_t chunk[16];
+            size_t n = (length - i < sizeof(chunk)) ? (length - i) : sizeof(chunk);
+            for(size_t j = 0; j < n; j++)
+            {
+                chunk[j] = (uint8_t)(data[i + j] ^ key);
+            }
+            err = kiss_frame_put(kiss, use_crc, &crc, chunk, n);
+            i += n;
+        }
+    }
+    else
+    {
+        /* adding payload data */
+        err = kiss_frame_put(kiss, use_crc, &crc, data, length);
+    }
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    return kiss_frame_end(kiss, use_crc, crc);
+}
+
+
+
+int32_t kiss_push_encode(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    
+    /* control that parameters are good */
+    if(NULL == kiss || NULL == data || 0 == length) 
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    
+    if(KISS_STATUS_ERROR_STATE == kiss->Status)
+    {
+        return KISS_ERR_STATUS;
+    }
+    
+    if(kiss->Status != KISS_STATUS_TRANSMITTING)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* the smallest encoded frame is FEND, header, FEND (FEND, FEND with SLIP, the header alone in a datagram) */
+    size_t min_index = (KISS_FRAMING_SLIP == kiss->framing) ? 2 : 3;
+    if(KISS_FRAMING_DATAGRAM == kiss->framing)
+    {
+        min_index = 1;
+    }
+    if(kiss->index < min_index)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    const kiss_special_t *special = kiss_special(kiss);
+
+    /* the header written by kiss_encode is always right after the first FEND, it may be escaped */
+    uint8_t wire_header = kiss->buffer[1];
+    if(KISS_FRAMING_COBS == kiss->framing)
+    {
+        /* after the first code byte, a code of 1 means that the header is a removed zero */
+        wire_header = (1 == kiss->buffer[1]) ? 0 : kiss->buffer[2];
+    }
+    else if(KISS_FRAMING_SLIP == kiss->framing)
+    {
+        wire_header = KISS_HEADER_DATA(0);
+    }
+    else if(KISS_FRAMING_DATAGRAM == kiss->framing)
+    {
+        wire_header = kiss->buffer[0];
+    }
+    else if(special->esc == wire_header)
+    {
+        wire_header = (special->tend == kiss->buffer[2]) ? special->end : special->esc;
+    }
+
+    /* the compressed bit stream cannot be extended, the scrambling key was chosen for the first data only */
+    if(KISS_HEADER_LZSS == (uint8_t)(wire_header & ~KISS_HEADER_CRC_FLAG) ||
+        (kiss->scramble_policy & (1U << KISS_HEADER_TYPE(wire_header))))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    if(KISS_FRAMING_DATAGRAM == kiss->framing)
+    {
+        /* nothing closes a datagram */
+    }
+    else if(kiss_delimiter(kiss) == kiss->buffer[kiss->index-1])
+    {
+        /* remove the closing FEND, it is written again at the end */
+        kiss->index--;
+    }
+    else
+    {
+        kiss->Status = KISS_STATUS_ERROR_STATE;
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    int32_t err = KISS_OK;
+
+    /* frame without CRC32, just append the new data */
+    if(0 == kiss_header_has_crc(kiss, wire_header))
+    {
+        err = kiss_append_escaped(kiss, data, length);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+    else
+    {
+        uint8_t crc_b[4];
+        uint32_t crc = 0;
+
+        /* walk back over the 4 CRC32 bytes (last byte first), each one may be escaped */
+        for(uint8_t i = 0; i < 4; i++)
+        {
+            if(KISS_FRAMING_COBS == kiss->framing)
+            {
+                crc_b[3 - i] = kiss_cobs_pop(kiss);
+                continue;
+            }
+            if(kiss->index < min_index)
+            {
+                kiss->Status = KISS_STATUS_ERROR_STATE;
+                return KISS_ERR_INVALID_FRAME;
+            }
+
+            uint8_t b = kiss->buffer[kiss->index - 1];
+
+            /* a transposed byte is an escape only if it follows FESC, FESC is never a transposed byte itself */
+            if(KISS_FRAMING_DATAGRAM != kiss->framing && (special->tend == b || special->tesc == b) && special->esc == kiss->buffer[kiss->index - 2])
+            {
+                crc_b[3 - i] = (special->tend == b) ? special->end : special->esc;
+                kiss->index = kiss->index - 2;
+            }
+            else
+            {
+                crc_b[3 - i] = b;
+                kiss->index = kiss->index - 1;
+            }
+        }
+
+        crc = KISS_BYTE_TO_UINT32(crc_b[0], crc_b[1], crc_b[2], crc_b[3]);
+
+        /* back to the CRC32 state before the final XOR and continue with the new data */
+        crc = ~crc;
+        crc = kiss_crc32_push(kiss, crc, data, length);
+        crc = ~crc;
+
+        /* start putting at the end of the payload new data */
+        err = kiss_append_escaped(kiss, data, length);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+
+        err = kiss_append_crc32(kiss, crc);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+
+    /* close the frame again */
+    return kiss_frame_end(kiss, 0, 0);
+}
+
+
+
+/*
+* COBS decoding of the received frame: the first byte is the header, the others go in the output
+* the output may be the instance buffer, every block has a code byte so the writing is behind the reading
+*/
+static int32_t kiss_cobs_unstuff(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header)
+{
+    const uint8_t *src = kiss->buffer;
+    const uint8_t *src_end = kiss->buffer + kiss->index;
+    size_t n = 0;
+    uint8_t has_header = 0;
+
+    /* padding */
+    while(src < src_end && KISS_COBS_DELIMITER == *src)
+    {
+        src++;
+    }
+
+    while(src < src_end && *src != KISS_COBS_DELIMITER)
+    {
+        uint8_t code = *src++;
+
+        for(uint16_t k = 0; k < (uint16_t)code; k++)
+        {
+            uint8_t b = 0;
+
+            if(k < code - 1)
+            {
+                if(src >= src_end || KISS_COBS_DELIMITER == *src)
+                {
+                    /* block cut by the end of the frame */
+                    kiss->Status = KISS_STATUS_ERROR_STATE;
+                    return KISS_ERR_INVALID_FRAME;
+                }
+                b = *src++;
+            }
+            else if(0xFF == code || src >= src_end || KISS_COBS_DELIMITER == *src)
+            {
+                /* no zero after a full block or at the end of the frame */
+                break;
+            }
+
+            if(0 == has_header)
+            {
+                *header = b;
+                has_header = 1;
+            }
+            else
+            {
+                if(n >= output_max_size)
+                {
+                    return KISS_ERR_BUFFER_OVERFLOW;
+                }
+                output[n] = b;
+                n++;
+            }
+        }
+    }
+
+    if(0 == has_header)
+    {
+        kiss->Status = KISS_STATUS_ERROR_STATE;
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    *output_length = n;
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_decode(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header)
+{
+    /* check basic parameters */
+    if (NULL == kiss || NULL == output || NULL == output_length)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if (kiss->Status != KISS_STATUS_RECEIVED) 
+    {
+        return KISS_ERR_STATUS;
+    }
+
+    /* SLIP frames have no header, the payload is given as data of the port 0 */
+    uint8_t val = KISS_HEADER_DATA(0);
+    int32_t err = KISS_OK;
+
+    switch(kiss->framing)
+    {
+        case KISS_FRAMING_COBS:
+            err = kiss_cobs_unstuff(kiss, output, output_max_size, output_length, &val);
+            break;
+        case KISS_FRAMING_HDLC:
+            err = kiss_unescape_hdlc(kiss, 1, output, output_max_size, output_length, &val);
+            break;
+        case KISS_FRAMING_SLIP:
+            err = kiss_unescape_kiss(kiss, 0, output, output_max_size, output_length, &val);
+            break;
+        case KISS_FRAMING_DATAGRAM:
+            err = kiss_unframe_plain(kiss, output, output_max_size, output_length, &val);
+            break;
+        default:
+            err = kiss_unescape_kiss(kiss, 1, output, output_max_size, output_length, &val);
+            break;
+    }
+
+    /* if we find another FEND right after the first one there is no payload, it is ok */
+    if(KISS_ERR_NO_DATA_RECEIVED == err)
+    {
+        return KISS_OK;
+    }
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    /* Header */
+    if (header) 
+    {
+        *header = val;
+    }
+
+    /* the header as received on the link (with the CRC flag in per frame mode) */
+    uint8_t wire_header = val;
+    if(KISS_CRC32_PER_FRAME == kiss->CRC32)
+    {
+        val = (uint8_t)(val & ~KISS_HEADER_CRC_FLAG);
+        if (header) 
+        {
+            *header = val;
+        }
+    }
+
+    if(kiss_header_has_crc(kiss, wire_header))
+    {
+        /* the frame is too short to contain the CRC32 */
+        if(*output_length < 4)
+        {
+            kiss->Status = KISS_STATUS_RECEIVED_ERROR;
+            return KISS_ERR_INVALID_FRAME;
+        }
+        // Extract the received CRC (the last 4 bytes of the decoded payload)
+        size_t payload_len = *output_length - 4;
+        uint32_t received_crc = (uint32_t)output[payload_len] |
+                                ((uint32_t)output[payload_len + 1] << 8) |
+                                ((uint32_t)output[payload_len + 2] << 16) |
+                                ((uint32_t)output[payload_len + 3] << 24);
+        *output_length = payload_len;
+
+        uint32_t calc_crc = 0;
+        if(kiss->framing != KISS_FRAMING_SLIP)
+        {
+            calc_crc = kiss_crc32_push(kiss, calc_crc, &wire_header, 1);
+        }
+        calc_crc = kiss_crc32_push(kiss, calc_crc, output, payload_len);
+        calc_crc = ~calc_crc;
+        // Verify the calculated CRC of the payload against the received one
+        if (calc_crc != received_crc)
+        {        
+            kiss->Status = KISS_STATUS_RECEIVED_ERROR;
+            return KISS_ERR_CRC32_MISMATCH;
+        }
+    }   
+
+    /* compressed frame: expand it from the received bytes into the output (not when decoding in place) */
+    if(KISS_HEADER_LZSS == val && output != kiss->buffer)
+    {
+        if(*output_length < 2)
+        {
+            kiss->Status = KISS_STATUS_RECEIVED_ERROR;
+            return KISS_ERR_INVALID_FRAME;
+        }
+
+        kiss_bit_reader_t r;
+        kiss_reader_frame(&r, kiss);
+        r.remaining = *output_length;
+
+        /* the LZSS header, then the original header */
+        (void)kiss_reader_byte(&r);
+        val = kiss_reader_byte(&r);
+        uint8_t window_bits = kiss_reader_byte(&r);
+        r.remaining -= 2;
+
+        err = kiss_lzss_expand(&r, window_bits, output, output_max_size, output_length);
+        if(err != KISS_OK)
+        {
+            kiss->Status = KISS_STATUS_RECEIVED_ERROR;
+            return err;
+        }
+        if (header) 
+        {
+            *header = val;
+        }
+    }
+    else if(kiss->scramble_policy & (1U << KISS_HEADER_TYPE(val)))
+    {
+        /* remove the key prefix and unscramble the payload */
+        if(*output_length < 1)
+        {
+            kiss->Status = KISS_STATUS_RECEIVED_ERROR;
+            return KISS_ERR_INVALID_FRAME;
+        }
+        uint8_t key = output[0];
+        for(size_t i = 1; i < *output_length; i++)
+        {
+            output[i - 1] = (uint8_t)(output[i] ^ key);
+        }
+        *output_length = *output_length - 1;
+    }
+
+    kiss->frame_flag = kiss_header_flag(val);
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_decode_inplace(kiss_instance_t *const kiss, const uint8_t **const payload, size_t *const length, uint8_t *const header)
+{
+    if(NULL == kiss || NULL == payload || NULL == length)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the decoded byte is always written before the position of the next byte read
+    * (at least one FEND is removed), so the buffer can be its own output */
+    int32_t err = kiss_decode(kiss, kiss->buffer, kiss->buffer_size, length, header);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    *payload = kiss->buffer;
+    /* the buffer does not contain the frame anymore */
+    kiss->index = *length;
+    kiss->Status = KISS_STATUS_NOTHING;
+
+    return KISS_OK;
+}
+
+
+
+/**
+ * @brief write the kiss->padding delimiters sent before a frame
+ * @return the error of the write callback, KISS_ERR_PADDING_OVERFLOW or KISS_OK
+ */
+static int32_t kiss_send_padding(kiss_instance_t *const kiss)
+{
+    int32_t err = KISS_OK;
+
+    /* check if padding size is not too large */
+    if(kiss->padding > KISS_MAX_PADDING)
+    {
+        return KISS_ERR_PADDING_OVERFLOW;
+    }
+
+    /* every write is a datagram: the padding would be a frame of its own */
+    if(KISS_FRAMING_DATAGRAM == kiss->framing)
+    {
+        return KISS_OK;
+    }
+
+    /* if kiss->padding is not zero we send some KISS_FEND padding bytes (the delimiter of the other framings) */
+    if(kiss->padding > 0 && kiss_delimiter(kiss) != KISS_FEND)
+    {
+        uint8_t chunk[KISS_MAX_PADDING];
+        for(uint8_t i = 0; i < kiss->padding; i++)
+        {
+            chunk[i] = kiss_delimiter(kiss);
+        }
+        err = kiss->write(kiss, chunk, kiss->padding);
+    }
+    else if(kiss->padding > 0)
+    {
+        /* adding arduino block for extra memory reduction */
+        #ifdef ARDUINO
+            uint8_t chunk[KISS_MAX_PADDING];
+            for(uint8_t i = 0; i < kiss->padding; i++)
+            {
+                chunk[i] = pgm_read_byte(&kiss_padding_block[i]);
+            }
+            err = kiss->write(kiss, chunk, kiss->padding);
+        #else
+            err = kiss->write(kiss, kiss_padding_block, kiss->padding);
+        #endif
+    }
+
+    return err;
+}
+
+
+
+/**
+ * @brief p-persistence channel access: when the channel is clear it is taken with probability (persistence + 1) / 256,
+ *  otherwise the sender waits a slot time and tries again. Nothing to wait in full duplex.
+ * @return KISS_ERR_TIMEOUT if the channel is not taken in KISS_CSMA_MAX_SLOTS slots, KISS_OK otherwise
+ */
+static int32_t kiss_channel_access(kiss_instance_t *const kiss)
+{
+    const kiss_channel_t *channel = kiss->channel;
+
+    if(kiss->fullduplex)
+    {
+        return KISS_OK;
+    }
+
+    for(uint32_t slot = 0; slot < KISS_CSMA_MAX_SLOTS; slot++)
+    {
+        if(NULL == channel->busy || 0 == channel->busy(kiss))
+        {
+            uint8_t r;
+            if(channel->random != NULL)
+            {
+                r = channel->random(kiss);
+            }
+            else
+            {
+                /* xorshift32 */
+                uint32_t x = kiss->csma_seed;
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                kiss->csma_seed = x;
+                r = (uint8_t)(x >> 24);
+            }
+
+            if(r <= kiss->persistence)
+            {
+                return KISS_OK;
+            }
+        }
+
+        if(channel->delay != NULL)
+        {
+            channel->delay(kiss, (uint32_t)kiss->slot_time * 10);
+        }
+    }
+
+    return KISS_ERR_TIMEOUT;
+}
+
+
+
+int32_t kiss_send_frame(kiss_instance_t *const kiss)
+{
+    /* param check */
+    if (NULL == kiss) 
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* check if the write callback function exists */
+    if(NULL == kiss->write)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+    /* if we are not in the transmitting status it means there is nothing to transmit */
+    if(kiss->Status != KISS_STATUS_TRANSMITTING)
+    {
+        return KISS_ERR_DATA_NOT_ENCODED;
+    }
+
+    int32_t err = KISS_OK;
+
+    /* check if padding size is not too large */
+    if(kiss->padding > KISS_MAX_PADDING)
+    {
+        return KISS_ERR_PADDING_OVERFLOW;
+    }
+
+    /* radio channel: wait for the channel (the frame stays ready if it is never clear), key up and wait TXdelay */
+    if(kiss->channel != NULL)
+    {
+        err = kiss_channel_access(kiss);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+        if(kiss->channel->ptt != NULL)
+        {
+            kiss->channel->ptt(kiss, 1);
+        }
+        if(kiss->channel->delay != NULL)
+        {
+            kiss->channel->delay(kiss, (uint32_t)kiss->TXdelay * 10);
+        }
+    }
+
+    /* padding bytes before the frame */
+    err = kiss_send_padding(kiss);
+
+    /* write the frame */
+    if(KISS_OK == err)
+    {
+        err = kiss->write(kiss, kiss->buffer, kiss->index);
+    }
+
+    /* TXtail and key down, also after an error */
+    if(kiss->channel != NULL)
+    {
+        if(kiss->channel->delay != NULL)
+        {
+            kiss->channel->delay(kiss, (uint32_t)kiss->TXtail * 10);
+        }
+        if(kiss->channel->ptt != NULL)
+        {
+            kiss->channel->ptt(kiss, 0);
+        }
+    }
+
+    /* if no error */
+    if(KISS_OK == err)
+    {
+        kiss->Status = KISS_STATUS_TRANSMITTED;
+        return KISS_OK;
+    }
+
+    /* here we have an error */
+    kiss->Status = KISS_STATUS_ERROR_STATE;
+    return err;
+}
+
+
+
+int32_t kiss_encode_and_send(kiss_instance_t *const kiss, const uint8_t *const data, size_t length, uint8_t header)
+{
+    /* error container */
+    int32_t err = KISS_OK;
+    /* encoding the data */
+    err = kiss_encode(kiss, data, length, header);
+    /* check if the encoding went ok */
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+    /* sending the frame immediatly */
+    return kiss_send_frame(kiss);
+}
+
+
+
+/* datagram framing: every read that gives something is a whole frame */
+static int32_t kiss_receive_datagram(kiss_instance_t *const kiss, uint32_t maxAttempts)
+{
+    kiss->index = 0;
+    kiss->Status = KISS_STATUS_RECEIVING;
+
+    for(uint32_t attempt = 0; attempt < maxAttempts; attempt++)
+    {
+        size_t received = 0;
+        int32_t err = kiss->read(kiss, kiss->buffer, kiss->buffer_size, &received);
+        if(err != KISS_OK)
+        {
+            kiss->Status = KISS_STATUS_ERROR_STATE;
+            return err;
+        }
+        if(received > 0)
+        {
+            kiss->index = received;
+            kiss->Status = KISS_STATUS_RECEIVED;
+            kiss->frame_flag = KISS_FLAG_NONE;
+            return KISS_OK;
+        }
+    }
+
+    return KISS_ERR_NO_DATA_RECEIVED;
+}
+
+
+
+int32_t kiss_receive_frame(kiss_instance_t *const kiss, uint32_t maxAttempts)
+{
+    /* check if parameters are ok */
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the reading callback function must exist */
+    if(NULL == kiss->read)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+
+    // Validate inputs
+    if (NULL == kiss->buffer || 0 == maxAttempts)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    if(KISS_FRAMING_DATAGRAM == kiss->framing)
+    {
+        return kiss_receive_datagram(kiss, maxAttempts);
+    }
+
+    // check if the frame is started or not
+    uint8_t frame_started = 0;
+    // error state of the read function (== 0 no error)
+    int32_t err = KISS_OK;
+    // frame size usage
+    size_t new_index = 0;
+    size_t new_read = 0;
+
+    // a frame left incomplete by the previous call (the read had nothing more) goes on, otherwise we start with index = 0
+    if(KISS_STATUS_RECEIVING == kiss->Status && kiss->index > 0 && kiss->index < kiss->buffer_size)
+    {
+        frame_started = 1;
+        new_index = kiss->index;
+    }
+    kiss->index = new_index;
+    // we make sure that the status is receiving
+    kiss->Status = KISS_STATUS_RECEIVING;
+    // FEND, or 0x00 with COBS framing
+    uint8_t delimiter = kiss_delimiter(kiss);
+
+    // Read bytes until a full frame is received
+    for(uint32_t attempt = 0; attempt < maxAttempts; attempt++)
+    {
+        // the frame does not fit the buffer
+        if(new_index >= kiss->buffer_size)
+        {
+            kiss->index = 0;
+            kiss->Status = KISS_STATUS_ERROR_STATE;
+            return KISS_ERR_BUFFER_OVERFLOW;
+        }
+
+        // try to read after the bytes of the frame kept so far, the caller make sure that the read starts when something arrives 
+        // a frame can span several reads, the bytes after its end are not kept
+        err = kiss->read(kiss, &(kiss->buffer[new_index]), kiss->buffer_size - new_index, &(new_read));
+
+        kiss->index = new_index + new_read;
+        /* if the read function returns an error we stop the function and return the error */
+        if(err != KISS_OK)
+        {
+            kiss->Status = KISS_STATUS_ERROR_STATE;
+            return err;
+        }
+        
+        /* we received something, hence we start searching for the frame inside */
+        for(size_t i = new_index; i < kiss->index; i++)
+        {
+
+            /* if the frame is not started we go inside */
+            if (!frame_started)
+            {
+                /* starting frame? */
+                if (delimiter == kiss->buffer[i])
+                {
+                    /* frame is started we copy at the start of the buffer, remember that
+                    * in this case i >= new_index ALWAYS */
+                    frame_started = 1;
+                    kiss->buffer[new_index] = kiss->buffer[i];
+                    new_index++;
+                } 
+            }
+            else
+            {
+                /* if there are more C0 after the first one we just pass them since they are there for sync or padding */
+                if(i > 0 && delimiter == kiss->buffer[i] && new_index <= 1)
+                {
+                    /* do nothing, continue the cycle and ignore the C0 padding */
+                }
+                else
+                {
+                    /* we copy back the byte */
+                    kiss->buffer[new_index] = kiss->buffer[i];
+                    new_index++;
+                
+                    /* if we are here the frame is already started and we are searching for the ending byte */
+                    if (delimiter == kiss->buffer[i])
+                    {
+                        /* we have the ending byte so we set the received status */
+                        kiss->Status = KISS_STATUS_RECEIVED;
+                        /* we set the frame length */
+                        kiss->index = new_index;
+
+                        /* if the frame length is not enough to be valid return error state */
+                        if(new_index < 3)
+                        {
+                            kiss->Status = KISS_STATUS_ERROR_STATE;                    
+                            return KISS_ERR_INVALID_FRAME;
+                        }
+
+                        kiss->Status = KISS_STATUS_RECEIVED;
+                        kiss->frame_flag = KISS_FLAG_NONE;
+                        return KISS_OK;
+                    } 
+                }    
+            }   
+        }
+    }
+    /* if we arrive here it means no data is received, the bytes of a started frame are kept for the next call */
+    kiss->index = new_index;
+    return KISS_ERR_NO_DATA_RECEIVED;
+}
+
+
+
+uint8_t kiss_frame_delimiter(const kiss_instance_t *const kiss)
+{
+    return (NULL == kiss) ? KISS_FEND : kiss_delimiter(kiss);
+}
+
+
+
+int32_t kiss_receive_and_decode(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint32_t maxAttempts, uint8_t *const header)
+{
+    /* check if kiss is null*/
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* buffer size cannot be zero */
+    if(0 == kiss->buffer_size)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* check if output data pointer is null */
+    if(NULL == output)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* check if the ouput length pointer is null */
+    if(NULL == output_length)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* check if the maximum attempts are ok */
+    if(0 == maxAttempts)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    
+    // -----------------------
+
+    /* error container */
+    int32_t err = KISS_OK;
+    /* try to receive a frame */
+    err = kiss_receive_frame(kiss, maxAttempts);
+    /* check if the frame has been received */
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+    /* decode the frame and return the output status */
+    return kiss_decode(kiss, output, output_max_size, output_length, header);
+}
+
+
+
+int32_t kiss_set_handlers(kiss_instance_t *const kiss, const kiss_handler_t *const handlers)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss->handlers = handlers;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_dispatch(kiss_instance_t *const kiss, const uint8_t **const payload, size_t *const length, uint8_t *const header)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    const uint8_t *data = NULL;
+    size_t len = 0;
+    uint8_t head = 0;
+
+    /* decode in the instance buffer, kiss_decode sets the frame flag */
+    int32_t err = kiss_decode_inplace(kiss, &data, &len, &head);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    /* a compressed frame is expanded in the LZSS buffer and dispatched with its original header */
+    uint8_t compressed = (KISS_HEADER_LZSS == head) ? 1 : 0;
+    if(compressed && kiss->lzss_buffer)
+    {
+        err = kiss_lzss_decompress(data, len, kiss->lzss_buffer, kiss->lzss_buffer_size, &len, &head);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+        data = kiss->lzss_buffer;
+        compressed = 0;
+    }
+
+    if(payload)
+    {
+        *payload = data;
+    }
+    if(length)
+    {
+        *length = len;
+    }
+    if(header)
+    {
+        *header = head;
+    }
+
+    /* one indirect call selected by the frame type, a frame still compressed goes back to the caller */
+    if(0 == compressed && kiss->handlers && kiss->handlers[KISS_HEADER_TYPE(head)].fn)
+    {
+        const kiss_handler_t *h = &kiss->handlers[KISS_HEADER_TYPE(head)];
+        return h->fn(kiss, head, data, len, h->user);
+    }
+
+    return KISS_ERR_NOT_HANDLED;
+}
+
+
+
+int32_t kiss_poll(kiss_instance_t *const kiss, uint32_t maxAttempts, const uint8_t **const payload, size_t *const length, uint8_t *const header)
+{
+    int32_t err = kiss_receive_frame(kiss, maxAttempts);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    return kiss_dispatch(kiss, payload, length, header);
+}
+
+
+
+int32_t kiss_registry_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_registry_serve(kiss, (const kiss_registry_t *)user, header, payload, length);
+}
+
+
+
+int32_t kiss_command_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_command_dispatch(kiss, (const kiss_command_table_t *)user, header, payload, length);
+}
+
+
+
+int32_t kiss_request_table_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_request_table_handle(kiss, (kiss_request_table_t *)user, header, payload, length);
+}
+
+
+
+int32_t kiss_link_monitor_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_link_monitor_handle(kiss, (kiss_link_monitor_t *)user, header, payload, length);
+}
+
+
+
+int32_t kiss_param_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    const kiss_param_link_t *link = (const kiss_param_link_t *)user;
+    if(NULL == link)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the tagged responses are for the request table, the requests and sets for the registry */
+    if(KISS_HEADER_PARAM_RESPONSE_TAG == header)
+    {
+        return link->requests ? kiss_request_table_handle(kiss, link->requests, header, payload, length) : KISS_ERR_NOT_HANDLED;
+    }
+    return link->registry ? kiss_registry_serve(kiss, link->registry, header, payload, length) : KISS_ERR_NOT_HANDLED;
+}
+
+
+
+int32_t kiss_set_TXdelay(kiss_instance_t *const kiss, uint8_t tx_delay)
+{
+    if (NULL == kiss || 0 == tx_delay)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(kiss->buffer_size < 4)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    kiss->TXdelay = tx_delay;
+
+    uint8_t payData = tx_delay;
+    size_t len = 1;
+
+    /* if we don't want CRC32 we enter here */
+    return kiss_encode_and_send(kiss, &payData, len, KISS_HEADER_TX_DELAY);
+    
+}
+
+
+
+int32_t kiss_set_speed(kiss_instance_t *const kiss, uint32_t BaudRate)
+{
+    if (NULL == kiss || 0 == BaudRate)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(kiss->buffer_size < 7)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    uint8_t payData[4];
+    size_t len = 4;
+
+    payData[0] = (uint8_t)(BaudRate & 0xFF);
+    payData[1] = (uint8_t)((BaudRate >> 8) & 0xFF);
+    payData[2] = (uint8_t)((BaudRate >> 16) & 0xFF);
+    payData[3] = (uint8_t)((BaudRate >> 24) & 0xFF);
+
+    return kiss_encode_and_send(kiss, payData, len, KISS_HEADER_SPEED);
+
+}
+
+
+
+int32_t kiss_send_ack(kiss_instance_t *const kiss)
+{
+    if (NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(kiss->buffer_size < 3)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    return kiss_encode_and_send(kiss, NULL, 0, KISS_HEADER_ACK);
+}
+
+
+
+int32_t kiss_send_nack(kiss_instance_t *const kiss)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(kiss->buffer_size < 3) 
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    return kiss_encode_and_send(kiss, NULL, 0, KISS_HEADER_NACK);
+
+}
+
+
+
+
+int32_t kiss_send_ping(kiss_instance_t *const kiss)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(kiss->buffer_size < 3) 
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    return kiss_encode_and_send(kiss, NULL, 0, KISS_HEADER_PING);
+
+}
+
+
+
+int32_t kiss_send_ping_reply(kiss_instance_t *const kiss, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || (NULL == payload && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(length > KISS_PING_ECHO_MAX)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    /* the payload may be inside the instance buffer (kiss_decode_inplace), copy it before encoding */
+    uint8_t echo[KISS_PING_ECHO_MAX];
+    for(size_t i = 0; i < length; i++)
+    {
+        echo[i] = payload[i];
+    }
+
+    /* the ACK echoes the ping payload */
+    return kiss_encode_and_send(kiss, echo, length, KISS_HEADER_ACK);
+}
+
+
+
+int32_t kiss_link_monitor_init(kiss_link_monitor_t *const monitor, uint32_t interval_ms, uint32_t timeout_ms)
+{
+    if(NULL == monitor || 0 == interval_ms || 0 == timeout_ms || timeout_ms > interval_ms)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    monitor->interval_ms = interval_ms;
+    monitor->timeout_ms = timeout_ms;
+    monitor->sent_at = 0;
+    monitor->srtt = 0;
+    monitor->rttvar = 0;
+    monitor->loss = 0;
+    monitor->sent = 0;
+    monitor->received = 0;
+    monitor->seq = 0;
+    monitor->outstanding = 0;
+    monitor->started = 0;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_link_monitor_poll(kiss_instance_t *const kiss, kiss_link_monitor_t *const monitor)
+{
+    if(NULL == kiss || NULL == monitor)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+
+    uint32_t now = kiss->clock(kiss);
+    uint32_t elapsed = now - monitor->sent_at;
+
+    /* no ACK within the timeout: one more loss sample */
+    if(monitor->outstanding && elapsed >= monitor->timeout_ms)
+    {
+        monitor->outstanding = 0;
+        monitor->loss = monitor->loss - (monitor->loss >> 3) + 65536U;
+    }
+
+    if(monitor->outstanding || (monitor->started && elapsed < monitor->interval_ms))
+    {
+        return KISS_OK;
+    }
+
+    /* time for a new ping */
+    monitor->seq++;
+    int32_t err = kiss_encode_and_send(kiss, &monitor->seq, 1, KISS_HEADER_PING);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    monitor->sent_at = now;
+    monitor->outstanding = 1;
+    monitor->started = 1;
+    monitor->sent++;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_link_monitor_handle(kiss_instance_t *const kiss, kiss_link_monitor_t *const monitor, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == monitor)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the other device is measuring the link too */
+    if(KISS_HEADER_PING == header)
+    {
+        return kiss_send_ping_reply(kiss, payload, length);
+    }
+
+    /* only the ACK carrying the sequence of the outstanding ping is a sample */
+    if(header != KISS_HEADER_ACK || 0 == monitor->outstanding || NULL == kiss->clock)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+    if(NULL == payload || length != 1 || payload[0] != monitor->seq)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+
+    uint32_t rtt = kiss->clock(kiss) - monitor->sent_at;
+
+    monitor->outstanding = 0;
+    monitor->received++;
+    monitor->loss = monitor->loss - (monitor->loss >> 3);
+
+    if(1 == monitor->received)
+    {
+        /* first sample: SRTT = R, RTTVAR = R / 2 */
+        monitor->srtt = rtt << 3;
+        monitor->rttvar = rtt << 1;
+    }
+    else
+    {
+        /* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R */
+        uint32_t srtt_ms = monitor->srtt >> 3;
+        uint32_t delta = (srtt_ms > rtt) ? (srtt_ms - rtt) : (rtt - srtt_ms);
+        monitor->rttvar = monitor->rttvar - (monitor->rttvar >> 2) + delta;
+        monitor->srtt = monitor->srtt - (monitor->srtt >> 3) + rtt;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_link_monitor_stats(const kiss_link_monitor_t *const monitor, kiss_link_stats_t *const stats)
+{
+    if(NULL == monitor || NULL == stats)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    stats->srtt_ms = monitor->srtt >> 3;
+    stats->jitter_ms = monitor->rttvar >> 2;
+    stats->rto_ms = stats->srtt_ms + (monitor->rttvar);
+    /* loss is 0 to 65536 scaled by 8 (2^19), the product fits in 32 bits */
+    stats->loss_permille = (uint16_t)((monitor->loss * 1000U) >> 19);
+    stats->sent = monitor->sent;
+    stats->received = monitor->received;
+
+    return KISS_OK;
+}
+
+
+
+
+int32_t kiss_set_param(kiss_instance_t *const kiss, uint16_t ID, const uint8_t *const param, size_t len)
+{
+    /* check if kiss instance is null or parameter pointer is null */
+    if(NULL == kiss || NULL == param) 
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* check if buffer size is large enough */
+    if(kiss->buffer_size < 5 + len) 
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    /* error container */
+    int32_t err = KISS_OK;
+    
+    /* ID of the parameter to send as byte array */
+    uint8_t id_[2] = {(uint8_t) ID, (uint8_t)(ID >> 8)};
+    
+    /* encode the parameter ID */
+    err = kiss_encode(kiss, id_, 2, KISS_HEADER_SET_PARAM);
+    /* check for errors */
+    if(err != KISS_OK) 
+    {
+        return err;
+    }  
+    
+    /* push encode the parameter */
+    err = kiss_push_encode(kiss, param, len);
+    /* check for errors */
+    if(err != KISS_OK) 
+    {
+        return err;
+    }
+
+
+    /* status is transmitting */
+    kiss->Status = KISS_STATUS_TRANSMITTING;
+
+    /* send the frame and return the result */
+    return kiss_send_frame(kiss);
+
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+int32_t kiss_request_param(kiss_instance_t *const kiss, uint16_t ID)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* check if buffer size is large enough */
+    if(kiss->buffer_size < 5) 
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    /* error container */
+    int32_t err = KISS_OK;
+    
+    /* ID of the parameter to send as byte array */
+    uint8_t id_[2] = {(uint8_t) ID, (uint8_t)(ID >> 8)};
+
+    /* encode the parameter ID */
+    err = kiss_encode(kiss, id_, 2, KISS_HEADER_REQUEST_PARAM);
+
+    /* check for errors */
+    if(err != KISS_OK) 
+    {
+        return err;
+    }
+    
+    /* status is transmitting */
+    kiss->Status = KISS_STATUS_TRANSMITTING;
+
+    /* send the frame and return the result */
+    return kiss_send_frame(kiss);    
+}
+
+
+
+int32_t kiss_request_table_init(kiss_request_table_t *const table, kiss_request_t *const slots, uint8_t size)
+{
+    if(NULL == table || NULL == slots || 0 == size)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    table->slots = slots;
+    table->size = size;
+    table->pending = 0;
+    table->next_tag = 0;
+
+    for(uint8_t i = 0; i < size; i++)
+    {
+        slots[i].in_use = 0;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_request_param_async(kiss_instance_t *const kiss, kiss_request_table_t *const table, uint16_t ID, uint32_t timeout_ms, kiss_param_cb callback, void *const user)
+{
+    if(NULL == kiss || NULL == table || NULL == callback)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* without a clock the timeouts cannot be handled */
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+    if(table->pending >= table->size)
+    {
+        return KISS_ERR_TABLE_FULL;
+    }
+
+    /* pick a tag not used by any outstanding request, there are less than 256 slots so one is always free */
+    uint8_t tag = table->next_tag;
+    uint8_t used = 1;
+    while(used)
+    {
+        used = 0;
+        for(uint8_t i = 0; i < table->size; i++)
+        {
+            if(table->slots[i].in_use && table->slots[i].tag == tag)
+            {
+                used = 1;
+                tag++;
+                break;
+            }
+        }
+    }
+    table->next_tag = (uint8_t)(tag + 1);
+
+    /* first free slot */
+    kiss_request_t *slot = NULL;
+    for(uint8_t i = 0; i < table->size; i++)
+    {
+        if(0 == table->slots[i].in_use)
+        {
+            slot = &table->slots[i];
+            break;
+        }
+    }
+    if(NULL == slot)
+    {
+        return KISS_ERR_TABLE_FULL;
+    }
+
+    /* tag and ID of the parameter to send as byte array */
+    uint8_t req[3] = {tag, (uint8_t) ID, (uint8_t)(ID >> 8)};
+
+    int32_t err = kiss_encode_and_send(kiss, req, 3, KISS_HEADER_REQUEST_PARAM_TAG);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    /* the request is in flight */
+    slot->callback = callback;
+    slot->user = user;
+    slot->deadline = kiss->clock(kiss) + timeout_ms;
+    slot->ID = ID;
+    slot->tag = tag;
+    slot->in_use = 1;
+    table->pending++;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_request_table_handle(kiss_instance_t *const kiss, kiss_request_table_t *const table, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == table)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(header != KISS_HEADER_PARAM_RESPONSE_TAG)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+    /* tag, ID and status are always there */
+    if(NULL == payload || length < 4)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    uint8_t tag = payload[0];
+    uint16_t ID = KISS_BYTE_TO_UINT16(payload[1], payload[2]);
+    uint8_t status = payload[3];
+
+    for(uint8_t i = 0; i < table->size; i++)
+    {
+        kiss_request_t *slot = &table->slots[i];
+        if(slot->in_use && slot->tag == tag && slot->ID == ID)
+        {
+            /* free the slot before the callback, so the callback can send a new request */
+            slot->in_use = 0;
+            table->pending--;
+
+            if(0 == status)
+            {
+                slot->callback(kiss, ID, KISS_OK, &payload[4], length - 4, slot->user);
+            }
+            else
+            {
+                /* the remote status is not a local error code: it is given as the value */
+                slot->callback(kiss, ID, KISS_ERR_REMOTE, &payload[3], 1, slot->user);
+            }
+            return KISS_OK;
+        }
+    }
+
+    /* response arrived after the timeout, nothing to do */
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_request_table_poll(kiss_instance_t *const kiss, kiss_request_table_t *const table)
+{
+    if(NULL == kiss || NULL == table)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+    if(0 == table->pending)
+    {
+        return KISS_OK;
+    }
+
+    uint32_t now = kiss->clock(kiss);
+
+    for(uint8_t i = 0; i < table->size; i++)
+    {
+        kiss_request_t *slot = &table->slots[i];
+        /* signed difference so the clock can wrap around */
+        if(slot->in_use && (int32_t)(now - slot->deadline) >= 0)
+        {
+            slot->in_use = 0;
+            table->pending--;
+            slot->callback(kiss, slot->ID, KISS_ERR_TIMEOUT, NULL, 0, slot->user);
+        }
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_extract_request_tag(const uint8_t *const payload, size_t length, uint8_t *const tag, uint16_t *const ID)
+{
+    if(NULL == payload || NULL == tag || NULL == ID)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(length != 3)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    *tag = payload[0];
+    *ID = KISS_BYTE_TO_UINT16(payload[1], payload[2]);
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_send_param_response(kiss_instance_t *const kiss, uint8_t tag, uint16_t ID, uint8_t status, const uint8_t *const value, size_t length)
+{
+    if(NULL == kiss || (NULL == value && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* tag, ID and status in front of the value */
+    uint8_t head[4] = {tag, (uint8_t) ID, (uint8_t)(ID >> 8), status};
+
+    int32_t err = kiss_encode(kiss, head, 4, KISS_HEADER_PARAM_RESPONSE_TAG);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    if(length > 0)
+    {
+        err = kiss_push_encode(kiss, value, length);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+
+    return kiss_send_frame(kiss);
+}
+
+
+
+int32_t kiss_registry_init(kiss_registry_t *const registry, const kiss_param_t *const params, uint16_t count)
+{
+    if(NULL == registry || NULL == params || 0 == count)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    for(uint16_t i = 0; i < count; i++)
+    {
+        /* the value must fit in one frame together with the ID */
+        if(NULL == params[i].value || 0 == params[i].size || params[i].size > 254)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        /* sorted without duplicates, needed by the binary search */
+        if(i > 0 && params[i].ID <= params[i - 1].ID)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+    }
+
+    registry->params = params;
+    registry->count = count;
+    /* consecutive IDs: the parameter is found by index */
+    registry->dense = ((uint32_t)params[count - 1].ID - params[0].ID == (uint32_t)count - 1) ? 1 : 0;
+
+    return KISS_OK;
+}
+
+
+
+const kiss_param_t *kiss_registry_find(const kiss_registry_t *const registry, uint16_t ID)
+{
+    if(NULL == registry || NULL == registry->params || 0 == registry->count)
+    {
+        return NULL;
+    }
+
+    const kiss_param_t *params = registry->params;
+
+    if(ID < params[0].ID || ID > params[registry->count - 1].ID)
+    {
+        return NULL;
+    }
+
+    if(registry->dense)
+    {
+        return &params[ID - params[0].ID];
+    }
+
+    /* binary search on the sorted IDs */
+    uint16_t low = 0;
+    uint16_t high = registry->count;
+    while(low < high)
+    {
+        uint16_t mid = (uint16_t)(low + ((high - low) >> 1));
+        if(params[mid].ID == ID)
+        {
+            return &params[mid];
+        }
+        if(params[mid].ID < ID)
+        {
+            low = (uint16_t)(mid + 1);
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+/*
+* add one batch item (head followed by the value) to the frame that is being built.
+* `used` is the escaped size of the open frame (0 if no frame is open), the frame is sent and a new one
+* is started when the item does not fit anymore.
+*/
+static int32_t kiss_batch_put(kiss_instance_t *const kiss, uint8_t header, size_t *const used, size_t *const frames, const uint8_t *const head, size_t head_len, const uint8_t *const value, size_t value_len)
+{
+    int32_t err = KISS_OK;
+    size_t room = kiss_payload_room(kiss, header);
+    size_t need = kiss_escaped_len(kiss, head, head_len);
+    if(value_len > 0)
+    {
+        need += kiss_escaped_len(kiss, value, value_len);
+    }
+
+    /* the open frame is full, send it */
+    if(*used > 0 && *used + need > room)
+    {
+        err = kiss_send_frame(kiss);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+        (*frames)++;
+        *used = 0;
+    }
+    /* the item does not fit even in an empty frame */
+    if(need > room)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    if(0 == *used)
+    {
+        err = kiss_encode(kiss, head, head_len, header);
+    }
+    else
+    {
+        err = kiss_push_encode(kiss, head, head_len);
+    }
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+    if(value_len > 0)
+    {
+        err = kiss_push_encode(kiss, value, value_len);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+
+    *used += need;
+    return KISS_OK;
+}
+
+
+
+/* send the last batch frame if one is open */
+static int32_t kiss_batch_flush(kiss_instance_t *const kiss, size_t *const used, size_t *const frames)
+{
+    if(0 == *used)
+    {
+        return KISS_OK;
+    }
+
+    int32_t err = kiss_send_frame(kiss);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+    (*frames)++;
+    *used = 0;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_registry_serve(kiss_instance_t *const kiss, const kiss_registry_t *const registry, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == registry)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    int32_t err = KISS_OK;
+    const kiss_param_t *param = NULL;
+
+    if(KISS_HEADER_REQUEST_PARAM == header)
+    {
+        if(NULL == payload || length != 2)
+        {
+            return kiss_send_nack(kiss);
+        }
+
+        param = kiss_registry_find(registry, KISS_BYTE_TO_UINT16(payload[0], payload[1]));
+        if(NULL == param || 0 == (param->flags & KISS_PARAM_READ))
+        {
+            return kiss_send_nack(kiss);
+        }
+
+        /* ID followed by the value, read directly from the variable */
+        uint8_t id_[2] = {(uint8_t) param->ID, (uint8_t)(param->ID >> 8)};
+        err = kiss_encode(kiss, id_, 2, KISS_HEADER_REQUEST_PARAM);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+        err = kiss_push_encode(kiss, (const uint8_t *)param->value, param->size);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+        return kiss_send_frame(kiss);
+    }
+    else if(KISS_HEADER_REQUEST_PARAM_TAG == header)
+    {
+        uint8_t tag = 0;
+        uint16_t ID = 0;
+
+        err = kiss_extract_request_tag(payload, length, &tag, &ID);
+        if(err != KISS_OK)
+        {
+            return kiss_send_nack(kiss);
+        }
+
+        param = kiss_registry_find(registry, ID);
+        if(NULL == param)
+        {
+            return kiss_send_param_response(kiss, tag, ID, KISS_ERR_UNKNOWN_PARAM, NULL, 0);
+        }
+        if(0 == (param->flags & KISS_PARAM_READ))
+        {
+            return kiss_send_param_response(kiss, tag, ID, KISS_ERR_PARAM_ACCESS, NULL, 0);
+        }
+        return kiss_send_param_response(kiss, tag, ID, 0, (const uint8_t *)param->value, param->size);
+    }
+    else if(KISS_HEADER_SET_PARAM == header)
+    {
+        if(NULL == payload || length < 3)
+        {
+            return kiss_send_nack(kiss);
+        }
+
+        param = kiss_registry_find(registry, KISS_BYTE_TO_UINT16(payload[0], payload[1]));
+        /* the new value must have exactly the size of the variable */
+        if(NULL == param || 0 == (param->flags & KISS_PARAM_WRITE) || (length - 2) != param->size)
+        {
+            return kiss_send_nack(kiss);
+        }
+
+        /* the value goes straight from the decoded frame to the variable */
+        uint8_t *dst = (uint8_t *)param->value;
+        for(uint8_t i = 0; i < param->size; i++)
+        {
+            dst[i] = payload[2 + i];
+        }
+
+        return kiss_send_ack(kiss);
+    }
+    else if(KISS_HEADER_BATCH_GET == header)
+    {
+        if(NULL == payload || 0 == length || (length & 1))
+        {
+            return kiss_send_nack(kiss);
+        }
+
+        size_t used = 0;
+        size_t frames = 0;
+        const uint8_t *ids = payload;
+        size_t buffer_size = kiss->buffer_size;
+
+        /* decoded in place (kiss_dispatch): move the IDs at the end of the buffer and build the answers in front of them */
+        if(payload == kiss->buffer)
+        {
+            if(length + 3 > buffer_size)
+            {
+                return kiss_send_nack(kiss);
+            }
+            for(size_t i = length; i > 0; i--)
+            {
+                kiss->buffer[buffer_size - length + i - 1] = payload[i - 1];
+            }
+            ids = &kiss->buffer[buffer_size - length];
+            kiss->buffer_size = buffer_size - length;
+        }
+
+        /* the IDs are read from the decoded payload while the answers are built in the instance buffer */
+        for(size_t i = 0; i < length; i += 2)
+        {
+            uint8_t head[3] = {ids[i], ids[i + 1], 0};
+            param = kiss_registry_find(registry, KISS_BYTE_TO_UINT16(ids[i], ids[i + 1]));
+
+            if(NULL == param || 0 == (param->flags & KISS_PARAM_READ))
+            {
+                err = kiss_batch_put(kiss, KISS_HEADER_BATCH_RESPONSE, &used, &frames, head, 3, NULL, 0);
+            }
+            else
+            {
+                head[2] = param->size;
+                err = kiss_batch_put(kiss, KISS_HEADER_BATCH_RESPONSE, &used, &frames, head, 3, (const uint8_t *)param->value, param->size);
+            }
+            if(err != KISS_OK)
+            {
+                break;
+            }
+        }
+        if(KISS_OK == err)
+        {
+            err = kiss_batch_flush(kiss, &used, &frames);
+        }
+
+        kiss->buffer_size = buffer_size;
+        return err;
+    }
+    else if(KISS_HEADER_BATCH_SET == header)
+    {
+        size_t offset = 0;
+        uint16_t ID = 0;
+        const uint8_t *value = NULL;
+        uint8_t value_len = 0;
+
+        if(NULL == payload || 0 == length)
+        {
+            return kiss_send_nack(kiss);
+        }
+
+        /* first pass: every item must be valid, so the set is all or nothing */
+        while(offset < length)
+        {
+            if(kiss_batch_next(payload, length, &offset, &ID, &value, &value_len) != KISS_OK)
+            {
+                return kiss_send_nack(kiss);
+            }
+            param = kiss_registry_find(registry, ID);
+            if(NULL == param || 0 == (param->flags & KISS_PARAM_WRITE) || value_len != param->size)
+            {
+                return kiss_send_nack(kiss);
+            }
+        }
+
+        /* second pass: write the values */
+        offset = 0;
+        while(offset < length)
+        {
+            kiss_batch_next(payload, length, &offset, &ID, &value, &value_len);
+            param = kiss_registry_find(registry, ID);
+
+            uint8_t *dst = (uint8_t *)param->value;
+            for(uint8_t i = 0; i < value_len; i++)
+            {
+                dst[i] = value[i];
+            }
+        }
+
+        return kiss_send_ack(kiss);
+    }
+
+    return KISS_ERR_NOT_HANDLED;
+}
+
+
+
+int32_t kiss_batch_get(kiss_instance_t *const kiss, const uint16_t *const IDs, size_t count, size_t *const frames)
+{
+    if(NULL == kiss || NULL == IDs || 0 == count)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    int32_t err = KISS_OK;
+    size_t used = 0;
+    size_t sent = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uint8_t id_[2] = {(uint8_t) IDs[i], (uint8_t)(IDs[i] >> 8)};
+        err = kiss_batch_put(kiss, KISS_HEADER_BATCH_GET, &used, &sent, id_, 2, NULL, 0);
+        if(err != KISS_OK)
+        {
+            break;
+        }
+    }
+    if(KISS_OK == err)
+    {
+        err = kiss_batch_flush(kiss, &used, &sent);
+    }
+
+    if(frames)
+    {
+        *frames = sent;
+    }
+    return err;
+}
+
+
+
+int32_t kiss_batch_set(kiss_instance_t *const kiss, const kiss_param_t *const params, size_t count, size_t *const frames)
+{
+    if(NULL == kiss || NULL == params || 0 == count)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    int32_t err = KISS_OK;
+    size_t used = 0;
+    size_t sent = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(NULL == params[i].value || 0 == params[i].size || params[i].size > 254)
+        {
+            err = KISS_ERR_INVALID_PARAMS;
+            break;
+        }
+
+        uint8_t head[3] = {(uint8_t) params[i].ID, (uint8_t)(params[i].ID >> 8), params[i].size};
+        err = kiss_batch_put(kiss, KISS_HEADER_BATCH_SET, &used, &sent, head, 3, (const uint8_t *)params[i].value, params[i].size);
+        if(err != KISS_OK)
+        {
+            break;
+        }
+    }
+    if(KISS_OK == err)
+    {
+        err = kiss_batch_flush(kiss, &used, &sent);
+    }
+
+    if(frames)
+    {
+        *frames = sent;
+    }
+    return err;
+}
+
+
+
+int32_t kiss_batch_next(const uint8_t *const payload, size_t length, size_t *const offset, uint16_t *const ID, const uint8_t **const value, uint8_t *const value_length)
+{
+    if(NULL == payload || NULL == offset || NULL == ID || NULL == value || NULL == value_length)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    size_t pos = *offset;
+
+    /* ID and length */
+    if(pos + 3 > length)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+    uint8_t len = payload[pos + 2];
+    if(pos + 3 + len > length)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    *ID = KISS_BYTE_TO_UINT16(payload[pos], payload[pos + 1]);
+    *value_length = len;
+    *value = &payload[pos + 3];
+    *offset = pos + 3 + len;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_send_command(kiss_instance_t *const kiss, uint16_t command)
+{
+    /* checking if parameters are ok */
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* create a byte array from the 2 bytes command */
+    uint8_t cmd_b[2] = {(uint8_t) (command), (uint8_t) ((command) >> 8)};
+
+    kiss->Status = KISS_STATUS_TRANSMITTING;
+
+    /* encode and send the command */
+    return kiss_encode_and_send(kiss, cmd_b, 2, KISS_HEADER_COMMAND);
+
+}
+
+
+
+int32_t kiss_dedup_init(kiss_dedup_t *const dedup, kiss_dedup_entry_t *const entries, uint8_t size)
+{
+    if(NULL == dedup || NULL == entries || 0 == size)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    dedup->entries = entries;
+    dedup->size = size;
+    dedup->count = 0;
+    dedup->next = 0;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_send_command_seq(kiss_instance_t *const kiss, uint16_t command, uint8_t seq)
+{
+    /* checking if parameters are ok */
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* 2 bytes command followed by the sequence number */
+    uint8_t cmd_b[3] = {(uint8_t) (command), (uint8_t) ((command) >> 8), seq};
+
+    /* encode and send the command */
+    return kiss_encode_and_send(kiss, cmd_b, 3, KISS_HEADER_COMMAND_SEQ);
+}
+
+
+
+int32_t kiss_extract_command_seq(kiss_dedup_t *const dedup, const uint8_t *const payload, size_t length, uint16_t *const command)
+{
+    if(NULL == dedup || NULL == payload || NULL == command)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(length != 3)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    uint16_t cmd = KISS_BYTE_TO_UINT16(payload[0], payload[1]);
+    uint8_t seq = payload[2];
+    *command = cmd;
+
+    /* the command ID is compared too, so a sender that restarts from the same sequence number
+    * is not mistaken for a retransmission unless it also repeats the same command */
+    for(uint8_t i = 0; i < dedup->count; i++)
+    {
+        if(dedup->entries[i].seq == seq && dedup->entries[i].command == cmd)
+        {
+            return KISS_ERR_DUPLICATE;
+        }
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_dedup_record(kiss_dedup_t *const dedup, uint16_t command, uint8_t seq)
+{
+    if(NULL == dedup)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* executed command, remember it overwriting the oldest one */
+    dedup->entries[dedup->next].command = command;
+    dedup->entries[dedup->next].seq = seq;
+    dedup->next++;
+    if(dedup->next >= dedup->size)
+    {
+        dedup->next = 0;
+    }
+    if(dedup->count < dedup->size)
+    {
+        dedup->count++;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_command_table_init(kiss_command_table_t *const table, const kiss_command_t *const commands, uint16_t count, uint8_t auto_ack, kiss_dedup_t *const dedup)
+{
+    if(NULL == table || NULL == commands || 0 == count)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    for(uint16_t i = 0; i < count; i++)
+    {
+        if(NULL == commands[i].handler)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        /* sorted without duplicates, needed by the binary search */
+        if(i > 0 && commands[i].command <= commands[i - 1].command)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+    }
+
+    table->commands = commands;
+    table->count = count;
+    table->auto_ack = (0 == auto_ack) ? 0 : 1;
+    table->dedup = dedup;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_command_dispatch(kiss_instance_t *const kiss, const kiss_command_table_t *const table, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == table)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(header != KISS_HEADER_COMMAND && header != KISS_HEADER_COMMAND_SEQ)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+    if(NULL == payload || length < 2)
+    {
+        kiss_send_nack(kiss);
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    int32_t err = KISS_OK;
+    uint16_t command = KISS_BYTE_TO_UINT16(payload[0], payload[1]);
+    uint8_t seq = 0;
+    const uint8_t *args = NULL;
+    size_t args_len = 0;
+
+    if(KISS_HEADER_COMMAND_SEQ == header)
+    {
+        if(table->dedup)
+        {
+            err = kiss_extract_command_seq(table->dedup, payload, length, &command);
+            if(KISS_ERR_DUPLICATE == err)
+            {
+                /* only the commands executed successfully are in the cache: it ran, only the ACK got lost */
+                return table->auto_ack ? kiss_send_ack(kiss) : KISS_ERR_DUPLICATE;
+            }
+            if(err != KISS_OK)
+            {
+                kiss_send_nack(kiss);
+                return err;
+            }
+        }
+        else if(length != 3)
+        {
+            kiss_send_nack(kiss);
+            return KISS_ERR_INVALID_FRAME;
+        }
+        /* payload may be the receive buffer, overwritten when the handler sends its answer */
+        seq = payload[2];
+    }
+    else if(length > 2)
+    {
+        /* the bytes after the command ID are the arguments */
+        args = &payload[2];
+        args_len = length - 2;
+    }
+
+    /* binary search on the sorted command IDs */
+    const kiss_command_t *cmd = NULL;
+    uint16_t low = 0;
+    uint16_t high = table->count;
+    while(low < high)
+    {
+        uint16_t mid = (uint16_t)(low + ((high - low) >> 1));
+        if(table->commands[mid].command == command)
+        {
+            cmd = &table->commands[mid];
+            break;
+        }
+        if(table->commands[mid].command < command)
+        {
+            low = (uint16_t)(mid + 1);
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    if(NULL == cmd)
+    {
+        err = kiss_send_nack(kiss);
+        return (KISS_OK == err) ? KISS_ERR_UNKNOWN_COMMAND : err;
+    }
+
+    err = cmd->handler(kiss, command, args, args_len, cmd->user);
+
+    /* a failed or unknown command is not recorded, so its retransmission is executed again */
+    if(KISS_OK == err && KISS_HEADER_COMMAND_SEQ == header && table->dedup)
+    {
+        (void)kiss_dedup_record(table->dedup, command, seq);
+    }
+
+    if(table->auto_ack)
+    {
+        int32_t ack_err = (KISS_OK == err) ? kiss_send_ack(kiss) : kiss_send_nack(kiss);
+        if(KISS_OK == err)
+        {
+            err = ack_err;
+        }
+    }
+
+    return err;
+}
+
+
+
+/* bytes of one element of a schema field, 0 if the type is not valid */
+static uint8_t kiss_field_width(uint8_t type)
+{
+    switch(type)
+    {
+        case KISS_FIELD_U8:
+        case KISS_FIELD_I8:
+            return 1;
+        case KISS_FIELD_U16:
+        case KISS_FIELD_I16:
+            return 2;
+        case KISS_FIELD_U32:
+        case KISS_FIELD_I32:
+        case KISS_FIELD_F32:
+            return 4;
+        case KISS_FIELD_U64:
+        case KISS_FIELD_I64:
+            return 8;
+        case KISS_FIELD_F64:
+            return (8 == sizeof(double)) ? 8 : 0;
+        default:
+            return 0;
+    }
+}
+
+
+
+/*
+* host copy of one element of a field: the bytes are copied one by one, so the field can be at any offset of the
+* structure (misaligned too) and floats are read as the integer with the same bits
+*/
+typedef union
+{
+    uint8_t bytes[8];
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+} kiss_field_value_t;
+
+
+
+/*
+* serialize one element of a field in `out` with the byte order of the link
+* the value is read with its own width and split with shifts, so it does not depend on the host byte order
+*/
+static uint8_t kiss_field_pack(const uint8_t *const src, uint8_t type, uint8_t endian, uint8_t *const out)
+{
+    uint8_t width = kiss_field_width(type);
+    kiss_field_value_t v;
+    uint64_t u;
+
+    for(uint8_t i = 0; i < width; i++)
+    {
+        v.bytes[i] = src[i];
+    }
+
+    switch(width)
+    {
+        case 1:
+            u = v.bytes[0];
+            break;
+        case 2:
+            u = v.u16;
+            break;
+        case 4:
+            u = v.u32;
+            break;
+        default:
+            u = v.u64;
+            break;
+    }
+
+    for(uint8_t i = 0; i < width; i++)
+    {
+        out[(KISS_FIELD_BE == endian) ? (width - 1 - i) : i] = (uint8_t)((u >> (8 * i)) & 0xFF);
+    }
+
+    return width;
+}
+
+
+
+/* write one element of a field from its serialized bytes, reverse of kiss_field_pack */
+static uint8_t kiss_field_unpack(const uint8_t *const in, uint8_t type, uint8_t endian, uint8_t *const dst)
+{
+    uint8_t width = kiss_field_width(type);
+    kiss_field_value_t v;
+    uint64_t u = 0;
+
+    for(uint8_t i = 0; i < width; i++)
+    {
+        u |= (uint64_t)in[(KISS_FIELD_BE == endian) ? (width - 1 - i) : i] << (8 * i);
+    }
+
+    switch(width)
+    {
+        case 1:
+            v.bytes[0] = (uint8_t)u;
+            break;
+        case 2:
+            v.u16 = (uint16_t)u;
+            break;
+        case 4:
+            v.u32 = (uint32_t)u;
+            break;
+        default:
+            v.u64 = u;
+            break;
+    }
+
+    for(uint8_t i = 0; i < width; i++)
+    {
+        dst[i] = v.bytes[i];
+    }
+
+    return width;
+}
+
+
+
+int32_t kiss_schema_init(kiss_schema_t *const schema, const kiss_field_t *const fields, uint8_t count)
+{
+    if(NULL == schema || (NULL == fields && count > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    size_t size = 0;
+    for(uint8_t i = 0; i < count; i++)
+    {
+        uint8_t width = kiss_field_width(fields[i].type);
+        if(0 == width || 0 == fields[i].count)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        size += (size_t)width * fields[i].count;
+    }
+
+    schema->fields = fields;
+    schema->count = count;
+    schema->size = size;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_encode_struct(kiss_instance_t *const kiss, const kiss_schema_t *const schema, const void *const data, uint8_t header)
+{
+    if(NULL == kiss || NULL == schema || NULL == data)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* the scrambling key depends on the whole payload, the elements are escaped as soon as they are serialized */
+    if(kiss->scramble_policy & (1U << KISS_HEADER_TYPE(header)))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    uint8_t use_crc = 0;
+    uint32_t crc = 0;
+
+    int32_t err = kiss_frame_begin(kiss, header, &use_crc, &crc);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    const uint8_t *base = (const uint8_t *)data;
+
+    /* every element is serialized in a small scratch and escaped straight in the frame */
+    for(uint8_t i = 0; i < schema->count; i++)
+    {
+        const kiss_field_t *field = &schema->fields[i];
+        uint8_t width = kiss_field_width(field->type);
+
+        for(uint8_t j = 0; j < field->count; j++)
+        {
+            uint8_t element[8];
+            kiss_field_pack(&base[field->offset + (size_t)j * width], field->type, field->endian, element);
+
+            err = kiss_append_escaped(kiss, element, width);
+            if(err != KISS_OK)
+            {
+                return err;
+            }
+            if(use_crc)
+            {
+                crc = kiss_crc32_push(kiss, crc, element, width);
+            }
+        }
+    }
+
+    return kiss_frame_end(kiss, use_crc, crc);
+}
+
+
+
+/* write all the serialized fields of `in` (schema->size bytes) in `data` */
+static void kiss_schema_unpack(const kiss_schema_t *const schema, const uint8_t *const in, void *const data)
+{
+    uint8_t *base = (uint8_t *)data;
+    size_t offset = 0;
+
+    for(uint8_t i = 0; i < schema->count; i++)
+    {
+        const kiss_field_t *field = &schema->fields[i];
+        uint8_t width = kiss_field_width(field->type);
+
+        for(uint8_t j = 0; j < field->count; j++)
+        {
+            offset += kiss_field_unpack(&in[offset], field->type, field->endian, &base[field->offset + (size_t)j * width]);
+        }
+    }
+}
+
+
+
+int32_t kiss_decode_struct(const kiss_schema_t *const schema, const uint8_t *const payload, size_t length, void *const data)
+{
+    if(NULL == schema || NULL == data || (NULL == payload && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(length != schema->size)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    kiss_schema_unpack(schema, payload, data);
+
+    return KISS_OK;
+}
+
+
+
+/* serialize all the fields of `data` in `out` (schema->size bytes) */
+static void kiss_schema_pack(const kiss_schema_t *const schema, const void *const data, uint8_t *const out)
+{
+    const uint8_t *base = (const uint8_t *)data;
+    size_t offset = 0;
+
+    for(uint8_t i = 0; i < schema->count; i++)
+    {
+        const kiss_field_t *field = &schema->fields[i];
+        uint8_t width = kiss_field_width(field->type);
+
+        for(uint8_t j = 0; j < field->count; j++)
+        {
+            offset += kiss_field_pack(&base[field->offset + (size_t)j * width], field->type, field->endian, &out[offset]);
+        }
+    }
+}
+
+
+
+/* read one serialized element as an unsigned number */
+static uint64_t kiss_packed_get(const uint8_t *const p, uint8_t width, uint8_t endian)
+{
+    uint64_t v = 0;
+    for(uint8_t i = 0; i < width; i++)
+    {
+        v |= (uint64_t)p[(KISS_FIELD_BE == endian) ? (width - 1 - i) : i] << (8 * i);
+    }
+    return v;
+}
+
+
+
+/* write the low `width` bytes of `v` as one serialized element */
+static void kiss_packed_set(uint8_t *const p, uint8_t width, uint8_t endian, uint64_t v)
+{
+    for(uint8_t i = 0; i < width; i++)
+    {
+        p[(KISS_FIELD_BE == endian) ? (width - 1 - i) : i] = (uint8_t)((v >> (8 * i)) & 0xFF);
+    }
+}
+
+
+
+/* 1 if depth is a power of two from 1 to KISS_DELTA_MAX_DEPTH, so seq % depth stays continuous when seq wraps */
+static uint8_t kiss_delta_depth_ok(uint8_t depth)
+{
+    return (depth > 0 && depth <= KISS_DELTA_MAX_DEPTH && 0 == (depth & (depth - 1))) ? 1 : 0;
+}
+
+
+
+int32_t kiss_delta_tx_init(kiss_delta_tx_t *const tx, const kiss_schema_t *const schema, uint8_t *const ref, uint8_t *const history, uint8_t depth, uint8_t key_interval)
+{
+    if(NULL == tx || NULL == schema || NULL == ref || NULL == history || 0 == kiss_delta_depth_ok(depth))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    tx->schema = schema;
+    tx->ref = ref;
+    tx->history = history;
+    tx->depth = depth;
+    tx->filled = 0;
+    tx->ref_seq = 0;
+    tx->seq = 0;
+    tx->has_ref = 0;
+    tx->key_interval = key_interval;
+    tx->since_key = 0;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_delta_send(kiss_instance_t *const kiss, kiss_delta_tx_t *const tx, const void *const data)
+{
+    if(NULL == kiss || NULL == tx || NULL == data)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* the varints are escaped as soon as they are computed, there is no payload to choose a scrambling key */
+    if(kiss->scramble_policy & (1U << KISS_HEADER_TYPE(KISS_HEADER_DELTA)))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    const kiss_schema_t *schema = tx->schema;
+
+    /*
+    * keyframe when the receiver has no reference, to resynchronize it from time to time
+    * and when no acknowledge arrived for `depth` frames: the reference has left the history of the receiver
+    */
+    uint8_t key = (0 == tx->has_ref) || ((uint8_t)(tx->seq - tx->ref_seq) >= tx->depth) ||
+                    (tx->key_interval > 0 && tx->since_key >= tx->key_interval);
+
+    /* the snapshot sent becomes the reference once the receiver acknowledges it, the oldest one is overwritten */
+    uint8_t *snapshot = &tx->history[(size_t)(tx->seq & (tx->depth - 1)) * schema->size];
+    if(tx->filled >= tx->depth)
+    {
+        tx->filled = (uint8_t)(tx->depth - 1);
+    }
+    kiss_schema_pack(schema, data, snapshot);
+
+    uint8_t use_crc = 0;
+    uint32_t crc = 0;
+
+    int32_t err = kiss_frame_begin(kiss, key ? KISS_HEADER_DELTA_KEY : KISS_HEADER_DELTA, &use_crc, &crc);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    uint8_t head[2] = {tx->seq, tx->ref_seq};
+    err = kiss_frame_put(kiss, use_crc, &crc, head, key ? 1 : 2);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    if(key)
+    {
+        err = kiss_frame_put(kiss, use_crc, &crc, snapshot, schema->size);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+    else
+    {
+        size_t offset = 0;
+        for(uint8_t i = 0; i < schema->count; i++)
+        {
+            const kiss_field_t *field = &schema->fields[i];
+            uint8_t width = kiss_field_width(field->type);
+            uint8_t bits = (uint8_t)(width * 8);
+
+            for(uint8_t j = 0; j < field->count; j++)
+            {
+                uint64_t d = kiss_packed_get(&snapshot[offset], width, field->endian) - kiss_packed_get(&tx->ref[offset], width, field->endian);
+                offset += width;
+
+                /* sign extend the difference from the width of the element */
+                if(bits < 64)
+                {
+                    uint64_t mask = ((uint64_t)1 << bits) - 1;
+                    d &= mask;
+                    if(d & ((uint64_t)1 << (bits - 1)))
+                    {
+                        d |= ~mask;
+                    }
+                }
+
+                /* zig-zag: small negative and positive differences become small numbers */
+                uint64_t zz = (d << 1) ^ (0 - (d >> 63));
+
+                /* varint: 7 bits per byte, the high bit tells that another byte follows */
+                uint8_t varint[10];
+                uint8_t n = 0;
+                while(zz >= 0x80)
+                {
+                    varint[n] = (uint8_t)((zz & 0x7F) | 0x80);
+                    n++;
+                    zz >>= 7;
+                }
+                varint[n] = (uint8_t)zz;
+                n++;
+
+                err = kiss_frame_put(kiss, use_crc, &crc, varint, n);
+                if(err != KISS_OK)
+                {
+                    return err;
+                }
+            }
+        }
+    }
+
+    err = kiss_frame_end(kiss, use_crc, crc);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    err = kiss_send_frame(kiss);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    tx->seq++;
+    tx->filled++;
+    tx->since_key = key ? 1 : (uint8_t)(tx->since_key + 1);
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_delta_tx_handle(kiss_instance_t *const kiss, kiss_delta_tx_t *const tx, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == tx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(header != KISS_HEADER_DELTA_ACK && header != KISS_HEADER_DELTA_NACK)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+    if(NULL == payload || length != 1)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    if(KISS_HEADER_DELTA_NACK == header)
+    {
+        /* the receiver does not know the reference: the next frame is a keyframe */
+        tx->has_ref = 0;
+        return KISS_OK;
+    }
+
+    /*
+    * the acknowledged snapshot must still be in the history (sent in the last `filled` frames)
+    * and newer than the reference, an old acknowledge arriving late is ignored
+    */
+    uint8_t age = (uint8_t)(tx->seq - payload[0]);
+    uint8_t newer = (uint8_t)(payload[0] - tx->ref_seq);
+    if(age >= 1 && age <= tx->filled && (0 == tx->has_ref || (newer >= 1 && newer < 128)))
+    {
+        const uint8_t *snapshot = &tx->history[(size_t)(payload[0] & (tx->depth - 1)) * tx->schema->size];
+        for(size_t i = 0; i < tx->schema->size; i++)
+        {
+            tx->ref[i] = snapshot[i];
+        }
+        tx->ref_seq = payload[0];
+        tx->has_ref = 1;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_delta_rx_init(kiss_delta_rx_t *const rx, const kiss_schema_t *const schema, void *const data, uint8_t *const history, uint8_t depth)
+{
+    if(NULL == rx || NULL == schema || NULL == data || NULL == history || 0 == kiss_delta_depth_ok(depth))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    rx->schema = schema;
+    rx->data = data;
+    rx->history = history;
+    rx->depth = depth;
+    rx->last_seq = 0;
+    rx->valid = 0;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_delta_rx_handle(kiss_instance_t *const kiss, kiss_delta_rx_t *const rx, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == rx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(header != KISS_HEADER_DELTA_KEY && header != KISS_HEADER_DELTA)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+    if(NULL == payload || length < 1)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    const kiss_schema_t *schema = rx->schema;
+    uint8_t seq = payload[0];
+    uint8_t ahead = (uint8_t)(seq - rx->last_seq);
+    uint8_t newer = (0 == rx->valid) || (ahead >= 1 && ahead < 128);
+    uint8_t *snapshot = &rx->history[(size_t)(seq & (rx->depth - 1)) * schema->size];
+    const uint8_t *ref = NULL;
+
+    if(KISS_HEADER_DELTA_KEY == header)
+    {
+        if(length != 1 + schema->size)
+        {
+            return KISS_ERR_INVALID_FRAME;
+        }
+        /* a keyframe that is not newer comes from a sender that restarted, the history is not valid anymore */
+        if(0 == newer)
+        {
+            rx->valid = 0;
+            ahead = 0;
+        }
+    }
+    else
+    {
+        if(length < 2)
+        {
+            return KISS_ERR_INVALID_FRAME;
+        }
+        if(0 == newer)
+        {
+            /* old frame arriving late */
+            return KISS_ERR_INVALID_FRAME;
+        }
+
+        /* the reference must be in the history and must not share the slot of the new structure */
+        uint8_t ref_seq = payload[1];
+        uint8_t age = (uint8_t)(rx->last_seq - ref_seq);
+        uint8_t distance = (uint8_t)(seq - ref_seq);
+        if(0 == rx->valid || age >= rx->depth || 0 == (rx->valid & ((uint32_t)1 << age)) || 0 == distance || distance >= rx->depth)
+        {
+            /* reference unknown, the sender answers the NACK with a keyframe */
+            int32_t err = kiss_encode_and_send(kiss, &seq, 1, KISS_HEADER_DELTA_NACK);
+            return (KISS_OK == err) ? KISS_ERR_INVALID_FRAME : err;
+        }
+        ref = &rx->history[(size_t)(ref_seq & (rx->depth - 1)) * schema->size];
+    }
+
+    /* slide the history to the new structure, the one `depth` frames older leaves it since its slot is reused */
+    rx->valid = (0 == rx->valid || ahead >= 32) ? 0 : (rx->valid << ahead);
+    if(rx->depth < 32)
+    {
+        rx->valid &= ((uint32_t)1 << rx->depth) - 1;
+    }
+    rx->last_seq = seq;
+
+    if(NULL == ref)
+    {
+        for(size_t i = 0; i < schema->size; i++)
+        {
+            snapshot[i] = payload[1 + i];
+        }
+    }
+    else
+    {
+        size_t pos = 2;
+        size_t offset = 0;
+        for(uint8_t i = 0; i < schema->count; i++)
+        {
+            const kiss_field_t *field = &schema->fields[i];
+            uint8_t width = kiss_field_width(field->type);
+
+            for(uint8_t j = 0; j < field->count; j++)
+            {
+                uint64_t zz = 0;
+                uint8_t shift = 0;
+                uint8_t b = 0x80;
+
+                while(b & 0x80)
+                {
+                    if(pos >= length || shift > 63)
+                    {
+                        /* the slot is left out of the history */
+                        return KISS_ERR_INVALID_FRAME;
+                    }
+                    b = payload[pos];
+                    pos++;
+                    zz |= (uint64_t)(b & 0x7F) << shift;
+                    shift += 7;
+                }
+
+                uint64_t d = (zz >> 1) ^ (0 - (zz & 1));
+                kiss_packed_set(&snapshot[offset], width, field->endian, kiss_packed_get(&ref[offset], width, field->endian) + d);
+                offset += width;
+            }
+        }
+        if(pos != length)
+        {
+            return KISS_ERR_INVALID_FRAME;
+        }
+    }
+
+    rx->valid |= 1;
+    kiss_schema_unpack(schema, snapshot, rx->data);
+
+    /* the payload may be in the instance buffer, it is not used anymore */
+    return kiss_encode_and_send(kiss, &seq, 1, KISS_HEADER_DELTA_ACK);
+}
+
+
+
+int32_t kiss_delta_tx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_delta_tx_handle(kiss, (kiss_delta_tx_t *)user, header, payload, length);
+}
+
+
+
+int32_t kiss_delta_rx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_delta_rx_handle(kiss, (kiss_delta_rx_t *)user, header, payload, length);
+}
+
+
+
+int32_t kiss_delta_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    const kiss_delta_link_t *link = (const kiss_delta_link_t *)user;
+    if(NULL == link)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the acknowledges are for the sender, the snapshots for the receiver */
+    if(KISS_HEADER_DELTA_ACK == header || KISS_HEADER_DELTA_NACK == header)
+    {
+        return link->tx ? kiss_delta_tx_handle(kiss, link->tx, header, payload, length) : KISS_ERR_NOT_HANDLED;
+    }
+    return link->rx ? kiss_delta_rx_handle(kiss, link->rx, header, payload, length) : KISS_ERR_NOT_HANDLED;
+}
+
+
+
+int32_t kiss_set_lzss(kiss_instance_t *const kiss, uint8_t header, uint8_t enable)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* a compressed frame is not compressed again */
+    if(KISS_HEADER_TYPE(header) == KISS_HEADER_TYPE(KISS_HEADER_LZSS))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    uint16_t bit = (uint16_t)(1U << KISS_HEADER_TYPE(header));
+
+    if(0 == enable)
+    {
+        kiss->lzss_policy &= (uint16_t)~bit;
+    }
+    else
+    {
+        kiss->lzss_policy |= bit;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_set_lzss_window(kiss_instance_t *const kiss, uint8_t window_bits)
+{
+    if(NULL == kiss || window_bits < KISS_LZSS_WINDOW_MIN || window_bits > KISS_LZSS_WINDOW_MAX)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss->lzss_window = window_bits;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_set_lzss_buffer(kiss_instance_t *const kiss, uint8_t *const buffer, size_t size)
+{
+    if(NULL == kiss || (NULL == buffer && size > 0) || (buffer != NULL && 0 == size))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss->lzss_buffer = buffer;
+    kiss->lzss_buffer_size = size;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_lzss_decompress(const uint8_t *const payload, size_t length, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header)
+{
+    if(NULL == payload || NULL == output || NULL == output_length)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(length < 2)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    kiss_bit_reader_t r;
+    r.p = &payload[2];
+    r.escaped = 0;
+    r.special = NULL;
+    r.remaining = length - 2;
+    r.acc = 0;
+    r.bits = 0;
+    r.block = 0;
+    r.zero = 0;
+
+    int32_t err = kiss_lzss_expand(&r, payload[1], output, output_max_size, output_length);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    if(header)
+    {
+        *header = payload[0];
+    }
+
+    return KISS_OK;
+}
+
+
+
+
+int32_t kiss_set_scramble(kiss_instance_t *const kiss, uint8_t header, uint8_t enable)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    uint16_t bit = (uint16_t)(1U << KISS_HEADER_TYPE(header));
+
+    if(0 == enable)
+    {
+        kiss->scramble_policy &= (uint16_t)~bit;
+    }
+    else
+    {
+        kiss->scramble_policy |= bit;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_gateway_forward(kiss_instance_t *const from, kiss_instance_t *const to, uint8_t port)
+{
+    if(NULL == from || NULL == to || NULL == from->buffer)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == to->write)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+    if(from->Status != KISS_STATUS_RECEIVED)
+    {
+        return KISS_ERR_STATUS;
+    }
+    /* only the framings escaped with FEND/FESC, and no CRC since on a KISS link it covers the header */
+    if((from->framing != KISS_FRAMING_KISS && from->framing != KISS_FRAMING_SLIP) ||
+       (to->framing != KISS_FRAMING_KISS && to->framing != KISS_FRAMING_SLIP) ||
+       from->CRC32 != KISS_CRC32_OFF || to->CRC32 != KISS_CRC32_OFF)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(to->padding > KISS_MAX_PADDING)
+    {
+        return KISS_ERR_PADDING_OVERFLOW;
+    }
+    if(from->index < 3)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    /* the escaped frame as received, FEND included at both ends */
+    uint8_t *frame = from->buffer;
+    size_t length = from->index;
+    /* 1 if the opening FEND and the header must be written before the payload */
+    uint8_t insert_header = 0;
+
+    if(KISS_FRAMING_KISS == from->framing)
+    {
+        /* only the data frames are forwarded, a data header never needs escaping */
+        if(KISS_HEADER_TYPE(frame[1]) != 0)
+        {
+            return KISS_ERR_NOT_HANDLED;
+        }
+
+        if(KISS_FRAMING_SLIP == to->framing)
+        {
+            /* the header becomes the opening FEND of the SLIP frame */
+            frame[1] = KISS_FEND;
+            frame++;
+            length--;
+        }
+        else
+        {
+            frame[1] = KISS_HEADER_DATA(port);
+        }
+    }
+    else if(KISS_FRAMING_KISS == to->framing)
+    {
+        /* the SLIP payload is already escaped as KISS, it goes after a new FEND and header */
+        frame++;
+        length--;
+        insert_header = 1;
+    }
+
+    int32_t err = KISS_OK;
+
+    if(insert_header)
+    {
+        /* padding, FEND and header in one write */
+        uint8_t chunk[KISS_MAX_PADDING + 2];
+        for(uint8_t i = 0; i < to->padding; i++)
+        {
+            chunk[i] = KISS_FEND;
+        }
+        chunk[to->padding] = KISS_FEND;
+        chunk[to->padding + 1] = KISS_HEADER_DATA(port);
+        err = to->write(to, chunk, (size_t)to->padding + 2);
+    }
+    else
+    {
+        err = kiss_send_padding(to);
+    }
+
+    if(KISS_OK == err)
+    {
+        err = to->write(to, frame, length);
+    }
+    if(err != KISS_OK)
+    {
+        to->Status = KISS_STATUS_ERROR_STATE;
+    }
+
+    /* the frame has been modified in place, it cannot be decoded anymore */
+    from->index = 0;
+    from->Status = KISS_STATUS_NOTHING;
+
+    return err;
+}
+
+
+
+static void kiss_blob_put_u32(uint8_t *const p, uint32_t value)
+{
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+
+
+static uint32_t kiss_blob_get_u32(const uint8_t *const p)
+{
+    return KISS_BYTE_TO_UINT32(p[0], p[1], p[2], p[3]);
+}
+
+
+
+static int32_t kiss_blob_send_offer(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx)
+{
+    uint8_t offer[10];
+    offer[0] = (uint8_t) tx->ID;
+    offer[1] = (uint8_t)(tx->ID >> 8);
+    kiss_blob_put_u32(&offer[2], tx->size);
+    kiss_blob_put_u32(&offer[6], tx->crc);
+
+    tx->deadline = kiss->clock(kiss) + tx->timeout_ms;
+
+    return kiss_encode_and_send(kiss, offer, sizeof(offer), KISS_HEADER_BLOB_OFFER);
+}
+
+
+
+static int32_t kiss_blob_send_chunk(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx)
+{
+    uint8_t *c = tx->chunk;
+    size_t n = tx->size - tx->next;
+    if(n > tx->chunk_size)
+    {
+        n = tx->chunk_size;
+    }
+
+    c[0] = (uint8_t) tx->ID;
+    c[1] = (uint8_t)(tx->ID >> 8);
+    kiss_blob_put_u32(&c[2], tx->next);
+
+    int32_t err = tx->read(tx->user, tx->next, &c[6], n);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    /* the chunk CRC covers ID and offset too, a chunk cannot be written at the wrong place */
+    kiss_blob_put_u32(&c[6 + n], kiss_crc32_push(kiss, 0, c, 6 + n));
+
+    err = kiss_encode_and_send(kiss, c, n + KISS_BLOB_CHUNK_OVERHEAD, KISS_HEADER_BLOB_CHUNK);
+    if(KISS_OK == err)
+    {
+        tx->next += (uint32_t)n;
+    }
+
+    return err;
+}
+
+
+
+int32_t kiss_blob_tx_init(kiss_blob_tx_t *const tx, kiss_blob_read_fn read, void *const user, uint8_t *const chunk, uint16_t chunk_size, uint8_t window, uint32_t timeout_ms)
+{
+    if(NULL == tx || NULL == read || NULL == chunk || 0 == chunk_size || 0 == window || 0 == timeout_ms)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    tx->read = read;
+    tx->user = user;
+    tx->chunk = chunk;
+    tx->chunk_size = chunk_size;
+    tx->window = window;
+    tx->timeout_ms = timeout_ms;
+    tx->ID = 0;
+    tx->size = 0;
+    tx->crc = 0;
+    tx->base = 0;
+    tx->next = 0;
+    tx->deadline = 0;
+    tx->state = KISS_BLOB_IDLE;
+    tx->retries = 0;
+    tx->rewound = 0;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_blob_tx_start(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx, uint16_t ID, uint32_t size)
+{
+    if(NULL == kiss || NULL == tx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+    if(KISS_BLOB_OFFERED == tx->state || KISS_BLOB_ACTIVE == tx->state)
+    {
+        return KISS_ERR_STATUS;
+    }
+
+    /* CRC32 of the whole object, read in chunks as the receiver will get it */
+    uint32_t crc = 0;
+    uint32_t offset = 0;
+    while(offset < size)
+    {
+        size_t n = size - offset;
+        if(n > tx->chunk_size)
+        {
+            n = tx->chunk_size;
+        }
+
+        int32_t err = tx->read(tx->user, offset, tx->chunk, n);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+
+        crc = kiss_crc32_push(kiss, crc, tx->chunk, n);
+        offset += (uint32_t)n;
+    }
+
+    tx->ID = ID;
+    tx->size = size;
+    tx->crc = crc;
+    tx->base = 0;
+    tx->next = 0;
+    tx->retries = 0;
+    tx->rewound = 0;
+    tx->state = KISS_BLOB_OFFERED;
+
+    return kiss_blob_send_offer(kiss, tx);
+}
+
+
+
+int32_t kiss_blob_tx_resume(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx)
+{
+    if(NULL == kiss || NULL == tx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+    if(tx->state != KISS_BLOB_STALLED && tx->state != KISS_BLOB_ACTIVE && tx->state != KISS_BLOB_OFFERED)
+    {
+        return KISS_ERR_STATUS;
+    }
+
+    /* the receiver answers with its offset, the chunks sent meanwhile may be lost */
+    tx->retries = 0;
+    tx->state = KISS_BLOB_OFFERED;
+
+    return kiss_blob_send_offer(kiss, tx);
+}
+
+
+
+int32_t kiss_blob_tx_poll(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx)
+{
+    if(NULL == kiss || NULL == tx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+    if(tx->state != KISS_BLOB_OFFERED && tx->state != KISS_BLOB_ACTIVE)
+    {
+        return KISS_OK;
+    }
+
+    int32_t err = KISS_OK;
+    uint32_t now = kiss->clock(kiss);
+
+    /* signed difference so the clock can wrap around */
+    if((int32_t)(now - tx->deadline) >= 0)
+    {
+        tx->retries++;
+        if(tx->retries > KISS_BLOB_MAX_RETRIES)
+        {
+            tx->state = KISS_BLOB_STALLED;
+            return KISS_ERR_TIMEOUT;
+        }
+
+        if(KISS_BLOB_OFFERED == tx->state)
+        {
+            return kiss_blob_send_offer(kiss, tx);
+        }
+
+        /* go back N: everything after the acknowledged offset is sent again */
+        tx->next = tx->base;
+        tx->rewound = 0;
+        tx->deadline = now + tx->timeout_ms;
+    }
+
+    if(KISS_BLOB_ACTIVE == tx->state)
+    {
+        uint32_t window = (uint32_t)tx->window * tx->chunk_size;
+        while(KISS_OK == err && tx->next < tx->size && (tx->next - tx->base) < window)
+        {
+            err = kiss_blob_send_chunk(kiss, tx);
+        }
+    }
+
+    return err;
+}
+
+
+
+int32_t kiss_blob_tx_handle(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == tx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(header != KISS_HEADER_BLOB_ACK)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+    if(NULL == payload || length < 7)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+
+    uint16_t ID = KISS_BYTE_TO_UINT16(payload[0], payload[1]);
+    uint32_t offset = kiss_blob_get_u32(&payload[2]);
+    uint8_t status = payload[6];
+
+    /* acknowledge of another (or an old) transfer */
+    if(ID != tx->ID || KISS_BLOB_IDLE == tx->state || KISS_BLOB_DONE == tx->state || KISS_BLOB_FAILED == tx->state)
+    {
+        return KISS_OK;
+    }
+    if(offset > tx->size)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    if(KISS_BLOB_ACK_DONE == status)
+    {
+        tx->base = tx->size;
+        tx->next = tx->size;
+        tx->state = KISS_BLOB_DONE;
+        return KISS_OK;
+    }
+    if(KISS_BLOB_ACK_CRC_ERROR == status)
+    {
+        tx->state = KISS_BLOB_FAILED;
+        return KISS_ERR_CRC32_MISMATCH;
+    }
+
+    if(tx->state != KISS_BLOB_ACTIVE)
+    {
+        /* answer to the offer: continue from what the receiver already has */
+        tx->base = offset;
+        tx->next = offset;
+        tx->state = KISS_BLOB_ACTIVE;
+    }
+    else if(offset > tx->next)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+    else if(offset > tx->base)
+    {
+        tx->base = offset;
+        tx->rewound = 0;
+    }
+    else if(offset < tx->base)
+    {
+        /* the receiver lost some data, start again from its offset */
+        tx->base = offset;
+        tx->next = offset;
+        tx->rewound = 0;
+    }
+    else
+    {
+        /* duplicate acknowledge: a chunk has been lost, send it again without waiting for the timeout (once per loss) */
+        if(0 == tx->rewound && tx->next > tx->base)
+        {
+            tx->next = tx->base;
+            tx->rewound = 1;
+        }
+        return KISS_OK;
+    }
+
+    tx->retries = 0;
+    tx->deadline = kiss->clock(kiss) + tx->timeout_ms;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_blob_rx_init(kiss_blob_rx_t *const rx, kiss_blob_write_fn write, void *const user)
+{
+    if(NULL == rx || NULL == write)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    rx->write = write;
+    rx->user = user;
+    rx->ID = 0;
+    rx->size = 0;
+    rx->crc = 0;
+    rx->running = 0;
+    rx->offset = 0;
+    rx->state = KISS_BLOB_IDLE;
+
+    return KISS_OK;
+}
+
+
+
+static int32_t kiss_blob_send_ack(kiss_instance_t *const kiss, const kiss_blob_rx_t *const rx)
+{
+    uint8_t ack[7];
+    ack[0] = (uint8_t) rx->ID;
+    ack[1] = (uint8_t)(rx->ID >> 8);
+    kiss_blob_put_u32(&ack[2], rx->offset);
+
+    if(KISS_BLOB_DONE == rx->state)
+    {
+        ack[6] = KISS_BLOB_ACK_DONE;
+    }
+    else if(KISS_BLOB_FAILED == rx->state)
+    {
+        ack[6] = KISS_BLOB_ACK_CRC_ERROR;
+    }
+    else
+    {
+        ack[6] = KISS_BLOB_ACK_PROGRESS;
+    }
+
+    return kiss_encode_and_send(kiss, ack, sizeof(ack), KISS_HEADER_BLOB_ACK);
+}
+
+
+
+/* when the whole object has been received its CRC32 is verified */
+static void kiss_blob_rx_check(kiss_blob_rx_t *const rx)
+{
+    if(KISS_BLOB_ACTIVE == rx->state && rx->offset == rx->size)
+    {
+        rx->state = (rx->running == rx->crc) ? KISS_BLOB_DONE : KISS_BLOB_FAILED;
+    }
+}
+
+
+
+int32_t kiss_blob_rx_handle(kiss_instance_t *const kiss, kiss_blob_rx_t *const rx, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == rx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    if(KISS_HEADER_BLOB_OFFER == header)
+    {
+        if(NULL == payload || length != 10)
+        {
+            return KISS_ERR_INVALID_FRAME;
+        }
+
+        uint16_t ID = KISS_BYTE_TO_UINT16(payload[0], payload[1]);
+        uint32_t size = kiss_blob_get_u32(&payload[2]);
+        uint32_t crc = kiss_blob_get_u32(&payload[6]);
+
+        /* same object: resume from the received offset, otherwise start from zero */
+        uint8_t same = (ID == rx->ID && size == rx->size && crc == rx->crc &&
+                       (KISS_BLOB_ACTIVE == rx->state || KISS_BLOB_DONE == rx->state));
+        if(0 == same)
+        {
+            rx->ID = ID;
+            rx->size = size;
+            rx->crc = crc;
+            rx->running = 0;
+            rx->offset = 0;
+            rx->state = KISS_BLOB_ACTIVE;
+            kiss_blob_rx_check(rx);
+        }
+
+        return kiss_blob_send_ack(kiss, rx);
+    }
+
+    if(KISS_HEADER_BLOB_CHUNK == header)
+    {
+        if(NULL == payload || length < KISS_BLOB_CHUNK_OVERHEAD)
+        {
+            return KISS_ERR_INVALID_FRAME;
+        }
+
+        size_t n = length - KISS_BLOB_CHUNK_OVERHEAD;
+        if(kiss_crc32_push(kiss, 0, payload, 6 + n) != kiss_blob_get_u32(&payload[6 + n]))
+        {
+            return KISS_ERR_CRC32_MISMATCH;
+        }
+
+        uint16_t ID = KISS_BYTE_TO_UINT16(payload[0], payload[1]);
+        uint32_t offset = kiss_blob_get_u32(&payload[2]);
+
+        /* chunk of a transfer not offered, it cannot be acknowledged */
+        if(ID != rx->ID || KISS_BLOB_IDLE == rx->state)
+        {
+            return KISS_OK;
+        }
+
+        /* only the next chunk in order is stored, the others are answered with the offset expected */
+        if(KISS_BLOB_ACTIVE == rx->state && offset == rx->offset && n > 0 && n <= (rx->size - rx->offset))
+        {
+            int32_t err = rx->write(rx->user, offset, &payload[6], n);
+            if(err != KISS_OK)
+            {
+                return err;
+            }
+
+            rx->running = kiss_crc32_push(kiss, rx->running, &payload[6], n);
+            rx->offset += (uint32_t)n;
+            kiss_blob_rx_check(rx);
+        }
+
+        return kiss_blob_send_ack(kiss, rx);
+    }
+
+    return KISS_ERR_NOT_HANDLED;
+}
+
+
+
+int32_t kiss_blob_tx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_blob_tx_handle(kiss, (kiss_blob_tx_t *)user, header, payload, length);
+}
+int32_t kiss_blob_rx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_blob_rx_handle(kiss, (kiss_blob_rx_t *)user, header, payload, length);
+}
+
+
+
+int32_t kiss_blob_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    const kiss_blob_link_t *link = (const kiss_blob_link_t *)user;
+    if(NULL == link)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the acknowledges are for the sender, the offers and chunks for the receiver */
+    if(KISS_HEADER_BLOB_ACK == header)
+    {
+        return link->tx ? kiss_blob_tx_handle(kiss, link->tx, header, payload, length) : KISS_ERR_NOT_HANDLED;
+    }
+    return link->rx ? kiss_blob_rx_handle(kiss, link->rx, header, payload, length) : KISS_ERR_NOT_HANDLED;
+}
+
+
+
+int32_t kiss_scheduler_init(kiss_scheduler_t *const sched, kiss_telemetry_t *const items, uint8_t count, kiss_sample_fn sample, void *const user)
+{
+    if(NULL == sched || NULL == items || 0 == count)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    for(uint8_t i = 0; i < count; i++)
+    {
+        if(NULL == items[i].value || 0 == items[i].size || 0 == items[i].period_ms)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        /* sorted by priority, so one pass in order sends the most important items first */
+        if(i > 0 && items[i].priority < items[i - 1].priority)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        items[i].due = 0;
+    }
+
+    sched->items = items;
+    sched->count = count;
+    sched->started = 0;
+    sched->sample = sample;
+    sched->user = user;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_scheduler_poll(kiss_instance_t *const kiss, kiss_scheduler_t *const sched, size_t max_frames, size_t *const frames)
+{
+    if(NULL == kiss || NULL == sched)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(NULL == kiss->clock)
+    {
+        return KISS_ERR_CALLBACK_MISSING;
+    }
+
+    uint32_t now = kiss->clock(kiss);
+    int32_t err = KISS_OK;
+    size_t used = 0;
+    size_t sent = 0;
+    size_t room = kiss_payload_room(kiss, KISS_HEADER_TELEMETRY);
+    uint8_t oversize = 0;
+
+    /* everything is sent at the first poll, then the items with the same period stay aligned */
+    if(0 == sched->started)
+    {
+        for(uint8_t i = 0; i < sched->count; i++)
+        {
+            sched->items[i].due = now;
+        }
+        sched->started = 1;
+    }
+
+    for(uint8_t i = 0; i < sched->count; i++)
+    {
+        kiss_telemetry_t *item = &sched->items[i];
+
+        /* signed difference so the clock can wrap around */
+        if((int32_t)(now - item->due) < 0)
+        {
+            continue;
+        }
+
+        if(NULL == sched->sample || KISS_OK == sched->sample(kiss, item->ID, sched->user))
+        {
+            const uint8_t *value = (const uint8_t *)item->value;
+            uint8_t head[3] = {(uint8_t) item->ID, (uint8_t)(item->ID >> 8), item->size};
+
+            size_t need = kiss_escaped_len(kiss, head, 3) + kiss_escaped_len(kiss, value, item->size);
+            size_t open = (used > 0) ? 1 : 0;
+
+            if(need > room)
+            {
+                /* it does not fit even in an empty frame: skip it for this period, the others are still sent */
+                oversize = 1;
+            }
+            else if(max_frames > 0 && (0 == used || used + need > room) && sent + open + 1 > max_frames)
+            {
+                /* a new frame would go over the limit: the rest waits for the next call */
+                break;
+            }
+            else
+            {
+                err = kiss_batch_put(kiss, KISS_HEADER_TELEMETRY, &used, &sent, head, 3, value, item->size);
+                if(err != KISS_OK)
+                {
+                    break;
+                }
+            }
+        }
+
+        /* next period, without sending again the periods already missed */
+        item->due += item->period_ms;
+        if((int32_t)(now - item->due) >= 0)
+        {
+            item->due = now + item->period_ms;
+        }
+    }
+
+    if(KISS_OK == err)
+    {
+        err = kiss_batch_flush(kiss, &used, &sent);
+    }
+    if(KISS_OK == err && oversize)
+    {
+        err = KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    if(frames)
+    {
+        *frames = sent;
+    }
+    return err;
+}
+
+
+
+int32_t kiss_std_encode(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const data, size_t length)
+{
+    if(NULL == kiss || NULL == kiss->buffer || (NULL == data && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    /* a TNC only speaks KISS */
+    if(kiss->framing != KISS_FRAMING_KISS)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(kiss->buffer_size < 3)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    /* FEND, command byte and data escaped, no CRC32 */
+    kiss->index = 0;
+    kiss->buffer[kiss->index] = KISS_FEND;
+    kiss->index++;
+
+    int32_t err = kiss_append_escaped(kiss, &header, 1);
+    if(KISS_OK == err && length > 0)
+    {
+        err = kiss_append_escaped(kiss, data, length);
+    }
+    if(err != KISS_OK)
+    {
+        kiss->Status = KISS_STATUS_ERROR_STATE;
+        return err;
+    }
+
+    return kiss_frame_end(kiss, 0, 0);
+}
+
+
+
+int32_t kiss_std_send(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const data, size_t length)
+{
+    int32_t err = kiss_std_encode(kiss, header, data, length);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    return kiss_send_frame(kiss);
+}
+
+
+
+int32_t kiss_std_decode(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header)
+{
+    if(NULL == kiss || NULL == output || NULL == output_length || NULL == header)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(kiss->Status != KISS_STATUS_RECEIVED)
+    {
+        return KISS_ERR_STATUS;
+    }
+    if(kiss->framing != KISS_FRAMING_KISS)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    *output_length = 0;
+    int32_t err = kiss_unescape_kiss(kiss, 1, output, output_max_size, output_length, header);
+
+    /* command without value */
+    if(KISS_ERR_NO_DATA_RECEIVED == err)
+    {
+        return KISS_OK;
+    }
+    return err;
+}
+
+
+
+int32_t kiss_std_handle(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length)
 {
-    /* check for parameters error or size of the buffer too small for the payload */
     if(NULL == kiss)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    if(NULL == kiss->buffer)
-    {
-        return KISS_ERR_INVALID_PARAMS;
-    }
-    if(kiss->buffer_size < 3) 
+
+    if(KISS_STD_RETURN == header)
     {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        kiss->frame_flag = KISS_FLAG_RETURN;
+        return KISS_OK;
     }
 
-    /* starting bytes of the frame */
-    kiss->index = 0;
-    kiss->buffer[kiss->index] = KISS_FEND;
-    kiss->index++;
+    uint8_t command = KISS_STD_COMMAND(header);
 
-    if(KISS_FESC == header)
+    if(KISS_STD_SETHARDWARE == command)
     {
-        kiss->buffer[kiss->index] = KISS_FESC;
-        kiss->index++;
-        kiss->buffer[kiss->index] = KISS_TFESC;
-        kiss->index++;
+        if(NULL == kiss->channel || NULL == kiss->channel->set_hardware)
+        {
+            return KISS_ERR_NOT_HANDLED;
+        }
+        return kiss->channel->set_hardware(kiss, KISS_STD_PORT(header), payload, length);
     }
-    else if(KISS_FEND == header)
+    if(KISS_STD_DATA == command || command > KISS_STD_SETHARDWARE)
     {
-        kiss->buffer[kiss->index] = KISS_FESC;
-        kiss->index++;
-        kiss->buffer[kiss->index] = KISS_TFEND;
-        kiss->index++;
+        return KISS_ERR_NOT_HANDLED;
     }
-    else
+
+    /* the other commands have a one byte value */
+    if(NULL == payload || length < 1)
     {
-        kiss->buffer[kiss->index] = header;
-        kiss->index++;
+        return KISS_ERR_INVALID_FRAME;
     }
 
-    /* adding payload data */
-    for (size_t i = 0; i < length; i++)
+    switch(command)
     {
-        uint8_t b = data[i];
-        /* if it is a special character */
-        if (KISS_FEND == b)
-        {
-            /* constantly check if there is enough space in the kiss buffer */
-            if(kiss->index + 2 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;
-            }
-            /* add escape and special char */
-            kiss->buffer[kiss->index] = KISS_FESC;
-            kiss->index++;
-            kiss->buffer[kiss->index] = KISS_TFEND;
-            kiss->index++;
-        }
-        else if (KISS_FESC == b)
-        {
-            /* check if there is enough space in the kiss buffer */
-            if(kiss->index + 2 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;
-            }
-            kiss->buffer[kiss->index] = KISS_FESC;
-            kiss->index++;
-            kiss->buffer[kiss->index] = KISS_TFESC;
-            kiss->index++;
-        }
-        else
-        {
-            /* check again if there is enough space in the kiss buffer */
-            if(kiss->index + 1 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;
-            }
-            /* add the byte in the buffer */
-            kiss->buffer[kiss->index] = b;
-            kiss->index++;
-        }
+        case KISS_STD_TXDELAY:
+            kiss->TXdelay = payload[0];
+            break;
+        case KISS_STD_PERSISTENCE:
+            kiss->persistence = payload[0];
+            break;
+        case KISS_STD_SLOTTIME:
+            kiss->slot_time = payload[0];
+            break;
+        case KISS_STD_TXTAIL:
+            kiss->TXtail = payload[0];
+            break;
+        default:
+            kiss->fullduplex = (payload[0] != 0) ? 1 : 0;
+            break;
     }
 
-    if(1 == kiss->CRC32)
-    {
+    return KISS_OK;
+}
 
-        uint32_t crc = 0;
-        crc = kiss_crc32_push(kiss, crc, &header, 1);
-        crc = kiss_crc32_push(kiss, crc, data, length);
-        crc = ~crc;
 
-        uint8_t crc_b[4];
-        crc_b[0] = (uint8_t)(crc & 0xFF);
-        crc_b[1] = (uint8_t)((crc >> 8) & 0xFF);
-        crc_b[2] = (uint8_t)((crc >> 16) & 0xFF);
-        crc_b[3] = (uint8_t)((crc >> 24) & 0xFF);
 
-        for(uint8_t i = 0; i < 4; i++)
-        {
-            if(KISS_FEND == crc_b[i])
-            {
-                if(kiss->index + 2 > kiss->buffer_size)
-                {
-                    kiss->Status = KISS_STATUS_ERROR_STATE;
-                    return KISS_ERR_BUFFER_OVERFLOW;
-                }
-                kiss->buffer[kiss->index] = KISS_FESC;
-                kiss->index++;
-                kiss->buffer[kiss->index] = KISS_TFEND;
-                kiss->index++;
-            }
-            else if(KISS_FESC == crc_b[i])
-            {
-                if(kiss->index + 2 > kiss->buffer_size)
-                {
-                    kiss->Status = KISS_STATUS_ERROR_STATE;
-                    return KISS_ERR_BUFFER_OVERFLOW;
-                }
-                kiss->buffer[kiss->index] = KISS_FESC;
-                kiss->index++;
-                kiss->buffer[kiss->index] = KISS_TFESC;
-                kiss->index++;                
-            }
-            else
-            {
-                if(kiss->index + 1 > kiss->buffer_size)
-                {
-                    kiss->Status = KISS_STATUS_ERROR_STATE;
-                    return KISS_ERR_BUFFER_OVERFLOW;
-                }    
-                kiss->buffer[kiss->index] = crc_b[i];
-                kiss->index++;           
-            }
+int32_t kiss_set_channel(kiss_instance_t *const kiss, const kiss_channel_t *const channel)
+{
+    if(NULL == kiss)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
 
-        }
+    kiss->channel = channel;
 
-    }
+    return KISS_OK;
+}
 
-    /* Terminate frame with check and KISS_FEND byte*/
-    if(kiss->index + 1 > kiss->buffer_size)
+
+
+int32_t kiss_set_csma(kiss_instance_t *const kiss, uint8_t persistence, uint8_t slot_time, uint8_t tx_tail, uint8_t fullduplex)
+{
+    if(NULL == kiss)
     {
-        kiss->Status = KISS_STATUS_ERROR_STATE;
-        return KISS_ERR_BUFFER_OVERFLOW;
+        return KISS_ERR_INVALID_PARAMS;
     }
-    kiss->buffer[kiss->index] = KISS_FEND;
-    kiss->index++;
 
-    /* we change the status to ready to transmit */
-    kiss->Status = KISS_STATUS_TRANSMITTING;
+    kiss->persistence = persistence;
+    kiss->slot_time = slot_time;
+    kiss->TXtail = tx_tail;
+    kiss->fullduplex = (fullduplex != 0) ? 1 : 0;
 
     return KISS_OK;
 }
 
 
 
-int32_t kiss_push_encode(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+/* length marking the end of the data in the queue, the next frame is at the start of the storage */
+#define KISS_MUX_WRAP 0xFFFFU
+
+
+
+int32_t kiss_mux_init(kiss_mux_t *const mux, kiss_port_t *const ports, uint8_t count, const kiss_instance_t *const kiss)
 {
-    
-    /* control that parameters are good */
-    if(NULL == kiss || NULL == data || 0 == length) 
+    if(NULL == mux || NULL == ports || 0 == count || count > KISS_MUX_MAX_PORTS)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    
-    if(KISS_STATUS_ERROR_STATE == kiss->Status)
-    {
-        return KISS_ERR_STATUS;
-    }
-    
-    if(kiss->Status != KISS_STATUS_TRANSMITTING)
+
+    for(uint8_t i = 0; i < count; i++)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        ports[i].storage = NULL;
+        ports[i].size = 0;
+        ports[i].head = 0;
+        ports[i].tail = 0;
+        ports[i].count = 0;
+        ports[i].quantum = 0;
+        ports[i].deficit = 0;
+        ports[i].dropped = 0;
+        ports[i].handler = NULL;
+        ports[i].user = NULL;
     }
-    if(0 == kiss->index)
+
+    mux->ports = ports;
+    mux->count = count;
+    mux->current = 0;
+    mux->credited = 0;
+    mux->max_length = 0;
+
+    /* a compressed payload may still fit, so only the uncompressed data frames are limited */
+    if(kiss != NULL && kiss->buffer != NULL && 0 == (kiss->lzss_policy & (1U << KISS_HEADER_TYPE(KISS_HEADER_DATA(0)))))
     {
-        return KISS_ERR_INVALID_PARAMS;
+        mux->max_length = kiss_payload_room(kiss, KISS_HEADER_DATA(0));
     }
 
+    return KISS_OK;
+}
+
 
-    if(KISS_FEND == kiss->buffer[kiss->index-1])
+
+int32_t kiss_mux_port_init(kiss_mux_t *const mux, uint8_t port, uint8_t *const storage, size_t size, uint16_t quantum, kiss_frame_fn handler, void *const user)
+{
+    if(NULL == mux || port >= mux->count || (NULL == storage && size > 0))
     {
-        kiss->index = kiss->index - 2;
+        return KISS_ERR_INVALID_PARAMS;
     }
-    else
+    /* a port that sends must get some bytes at each round */
+    if(size > 0 && 0 == quantum)
     {
-        kiss->Status = KISS_STATUS_ERROR_STATE;
-        return KISS_ERR_INVALID_FRAME;
+        return KISS_ERR_INVALID_PARAMS;
     }
 
+    kiss_port_t *p = &mux->ports[port];
+    p->storage = storage;
+    p->size = size;
+    p->head = 0;
+    p->tail = 0;
+    p->count = 0;
+    p->quantum = quantum;
+    p->deficit = 0;
+    p->dropped = 0;
+    p->handler = handler;
+    p->user = user;
+
+    return KISS_OK;
+}
 
-    uint8_t crc_b[4];
-    uint32_t crc = 0;
 
-    for(uint8_t i = 0; i < 4; i++)
+
+/* position where a record of need bytes can be written in one piece, size if there is no room */
+static size_t kiss_mux_reserve(kiss_port_t *const p, size_t need)
+{
+    if(0 == p->count)
     {
+        /* empty queue: start from the beginning to have all the storage in one piece */
+        p->head = 0;
+        p->tail = 0;
+        return (need <= p->size) ? 0 : p->size;
+    }
 
-        if(KISS_TFESC == kiss->buffer[kiss->index])
-        {
-            crc_b[i] = KISS_FESC;
-            kiss->index = kiss->index - 2;
-        }
-        else if(KISS_TFEND == kiss->buffer[kiss->index])
+    if(p->tail > p->head)
+    {
+        /* free space at the end and before head */
+        if(p->size - p->tail >= need)
         {
-            crc_b[i] = KISS_FEND;
-            kiss->index = kiss->index - 2;
+            return p->tail;
         }
-        else
+        if(p->head >= need)
         {
-            crc_b[i] = kiss->buffer[kiss->index];
-            kiss->index = kiss->index - 1;
+            /* the reader goes back to the start when it finds the marker (or less than a length at the end) */
+            if(p->size - p->tail >= KISS_MUX_RECORD_OVERHEAD)
+            {
+                p->storage[p->tail] = (uint8_t) KISS_MUX_WRAP;
+                p->storage[p->tail + 1] = (uint8_t)(KISS_MUX_WRAP >> 8);
+            }
+            p->tail = 0;
+            return 0;
         }
+        return p->size;
     }
 
-    crc = ((uint32_t)crc_b[0] << 24) |
-               ((uint32_t)crc_b[1] << 16) |
-               ((uint32_t)crc_b[2] <<  8) |
-               ((uint32_t)crc_b[3]);
-
-    crc = ~crc;
-    
-    crc = kiss_crc32_push(kiss, crc, data, length);
-    crc = ~crc;
+    /* tail behind head, head == tail means full */
+    if(p->tail < p->head && p->head - p->tail >= need)
+    {
+        return p->tail;
+    }
+    return p->size;
+}
 
-    crc_b[0] = (uint8_t)(crc & 0xFF);
-    crc_b[1] = (uint8_t)((crc >> 8) & 0xFF);
-    crc_b[2] = (uint8_t)((crc >> 16) & 0xFF);
-    crc_b[3] = (uint8_t)((crc >> 24) & 0xFF);
 
-    kiss->index++;
 
-    /* start putting at the end of the payload new data */
-    for(size_t i = 0; i < length; i++)
+/* oldest frame of the queue (the queue is not empty) */
+static const uint8_t *kiss_mux_peek(kiss_port_t *const p, size_t *const length)
+{
+    if(p->size - p->head < KISS_MUX_RECORD_OVERHEAD)
     {
-        /* if it is a fend special character */
-        if(KISS_FEND == data[i])
-        {
-            if(kiss->index + 2 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;
-            }
-            kiss->buffer[kiss->index] = KISS_FESC;
-            kiss->index++;
-            kiss->buffer[kiss->index] = KISS_TFEND;
-            kiss->index++;
-        }
-        /* if it is a fesc special character */
-        else if(KISS_FESC == data[i])
-        {
-            if(kiss->index + 2 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;
-            }
-            kiss->buffer[kiss->index] = KISS_FESC;
-            kiss->index++;
-            kiss->buffer[kiss->index] = KISS_TFESC;
-            kiss->index++;
-        }
-        /* otherwise just copy the data */
-        else
-        {
-            if(kiss->index + 1 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;
-            }
-            kiss->buffer[kiss->index] = data[i];
-            kiss->index++;
-        }
+        p->head = 0;
     }
 
-
-    for(uint8_t i = 0; i < 4; i++)
+    uint16_t len = KISS_BYTE_TO_UINT16(p->storage[p->head], p->storage[p->head + 1]);
+    if(KISS_MUX_WRAP == len)
     {
-        if(KISS_FEND == crc_b[i])
-        {
-            if(kiss->index + 2 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;             
-            }
-            kiss->buffer[kiss->index] = KISS_FESC;
-            kiss->index++;
-            kiss->buffer[kiss->index] = KISS_TFEND;
-            kiss->index++;
-        }
-        else if(KISS_FESC == crc_b[i])
-        {
-            if(kiss->index + 2 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;             
-            }
-            kiss->buffer[kiss->index] = KISS_FESC;
-            kiss->index++;
-            kiss->buffer[kiss->index] = KISS_TFESC;
-            kiss->index++;
-        }
-        else
-        {
-            if(kiss->index + 1 > kiss->buffer_size)
-            {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_BUFFER_OVERFLOW;             
-            }
-            kiss->buffer[kiss->index] = crc_b[i];
-            kiss->index++;
-        }
+        p->head = 0;
+        len = KISS_BYTE_TO_UINT16(p->storage[0], p->storage[1]);
     }
 
+    *length = len;
+    return &p->storage[p->head + KISS_MUX_RECORD_OVERHEAD];
+}
 
-    /* close the frame again */
-    if(kiss->index + 1 > kiss->buffer_size)
+
+
+static void kiss_mux_pop(kiss_port_t *const p, size_t length)
+{
+    p->head += KISS_MUX_RECORD_OVERHEAD + length;
+    p->count--;
+
+    if(0 == p->count)
     {
-        kiss->Status = KISS_STATUS_ERROR_STATE;
-        return KISS_ERR_BUFFER_OVERFLOW;
+        p->head = 0;
+        p->tail = 0;
     }
-    kiss->buffer[kiss->index] = KISS_FEND;
-    kiss->index++;
-    
-    return KISS_OK;
 }
 
 
 
-int32_t kiss_decode(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header)
+int32_t kiss_mux_enqueue(kiss_mux_t *const mux, uint8_t port, const uint8_t *const data, size_t length)
 {
-    /* check basic parameters */
-    if (NULL == kiss || NULL == output || NULL == output_length)
+    if(NULL == mux || port >= mux->count || (NULL == data && length > 0) || length >= KISS_MUX_WRAP)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    if (kiss->Status != KISS_STATUS_RECEIVED) 
+
+    kiss_port_t *p = &mux->ports[port];
+    if(NULL == p->storage || 0xFFFFU == p->count)
     {
-        return KISS_ERR_STATUS;
+        return KISS_ERR_BUFFER_OVERFLOW;
     }
-
-    /* pointers for fast access */
-    const uint8_t *src = kiss->buffer;
-    const uint8_t *src_end = kiss->buffer + kiss->index;
-    uint8_t *dst = output;
-    const uint8_t *dst_end = output + output_max_size;
-
-    /* fast skip for padding */
-    while (src < src_end && KISS_FEND == *src)
+    /* it would never be sent and would hold the queue */
+    if(mux->max_length > 0 && length > mux->max_length)
     {
-        src++;
+        return KISS_ERR_BUFFER_OVERFLOW;
     }
 
-    /* if buffer ended with only FEND */
-    if (src >= src_end) 
+    size_t pos = kiss_mux_reserve(p, length + KISS_MUX_RECORD_OVERHEAD);
+    if(pos == p->size)
     {
-        *output_length = 0;
-        kiss->Status = KISS_STATUS_ERROR_STATE;
-        return KISS_ERR_INVALID_FRAME; 
+        return KISS_ERR_BUFFER_OVERFLOW;
     }
 
-    /* first byte is always header, but it could be escaped  */
-    uint8_t val = *src++;
-
-    /* header escape management */
-    if (KISS_FESC == val) 
+    p->storage[pos] = (uint8_t) length;
+    p->storage[pos + 1] = (uint8_t)(length >> 8);
+    for(size_t i = 0; i < length; i++)
     {
-        if (src >= src_end) 
-        {
-            kiss->Status = KISS_STATUS_ERROR_STATE;
-            return KISS_ERR_INVALID_FRAME;
-        }
-        val = *src++;
-        if (KISS_TFEND == val) 
-        {
-            val = KISS_FEND;
-        }
-        else if (KISS_TFESC == val)
-        {
-            val = KISS_FESC;
-        } 
-        else 
-        {
-            /* illigal escape found */
-            kiss->Status = KISS_STATUS_ERROR_STATE;
-            return KISS_ERR_INVALID_FRAME;
-        } 
+        p->storage[pos + KISS_MUX_RECORD_OVERHEAD + i] = data[i];
     }
 
-    /* if we find another FEND it means there is no payload, it is ok */
-    else if (KISS_FEND == val)
-    {
-         *output_length = 0;
-         return KISS_OK; 
-    }
+    p->tail = pos + KISS_MUX_RECORD_OVERHEAD + length;
+    p->count++;
+
+    return KISS_OK;
+}
+
 
-    /* Header */
-    if (header) 
+
+int32_t kiss_mux_poll(kiss_instance_t *const kiss, kiss_mux_t *const mux, size_t max_frames, size_t *const frames)
+{
+    if(NULL == kiss || NULL == mux)
     {
-        *header = val;
+        return KISS_ERR_INVALID_PARAMS;
     }
 
-    /* 3. MAIN LOOP (Payload) */
-    while (src < src_end) 
-    {
-        uint8_t byte = *src++;
+    int32_t err = KISS_OK;
+    int32_t drop_err = KISS_OK;
+    size_t sent = 0;
 
-        /* final FEND */
-        if (KISS_FEND == byte) 
-        {
-            /* exiting from loop */
-            break; 
-        }
+    /* one visit per port, starting from where the last call stopped */
+    for(uint8_t visit = 0; visit < mux->count && KISS_OK == err; visit++)
+    {
+        kiss_port_t *p = &mux->ports[mux->current];
 
-        /* escape frequency found */
-        if (KISS_FESC == byte) 
+        if(p->count > 0)
         {
-            if (src >= src_end) 
+            if(0 == mux->credited)
             {
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                /* buffer ended before the frame was done */
-                return KISS_ERR_INVALID_FRAME; 
+                p->deficit += p->quantum;
+                mux->credited = 1;
             }
-            
-            /* read the next byte */
-            byte = *src++;
 
-            if (KISS_TFEND == byte)
-            {
-                byte = KISS_FEND;
-            }
-            else if (KISS_TFESC == byte) 
+            while(p->count > 0)
             {
-                byte = KISS_FESC;
-            }
-            else 
-            {
-                /* the sequence was not valid */
-                kiss->Status = KISS_STATUS_ERROR_STATE;
-                return KISS_ERR_INVALID_FRAME;
+                size_t length = 0;
+                const uint8_t *payload = kiss_mux_peek(p, &length);
+
+                /* the frame waits for the next round, its deficit is kept */
+                if(length > p->deficit)
+                {
+                    break;
+                }
+                /* no more frames in this call, the next one continues with this port */
+                if(max_frames > 0 && sent >= max_frames)
+                {
+                    if(frames)
+                    {
+                        *frames = sent;
+                    }
+                    return drop_err;
+                }
+
+                /* an encoding error does not go away: the frame is dropped so it does not hold the port */
+                int32_t encode_err = kiss_encode(kiss, payload, length, KISS_HEADER_DATA(mux->current));
+                if(encode_err != KISS_OK)
+                {
+                    drop_err = encode_err;
+                    p->dropped++;
+                    kiss_mux_pop(p, length);
+                    continue;
+                }
+
+                err = kiss_send_frame(kiss);
+                if(err != KISS_OK)
+                {
+                    break;
+                }
+
+                p->deficit -= (uint32_t)length;
+                kiss_mux_pop(p, length);
+                sent++;
             }
         }
 
-        /* normal byte */
-        if (dst >= dst_end)
+        /* an idle port does not save credit for later */
+        if(0 == p->count)
         {
-            return KISS_ERR_BUFFER_OVERFLOW;
+            p->deficit = 0;
         }
-        
-        *dst++ = byte;
-    }
-
-    /* final length read */
-    *output_length = (size_t)(dst - output);
-
-    if(1 == kiss->CRC32)
-    {
-        // Extract the received CRC (the last 4 bytes of the decoded payload)
-        size_t payload_len = *output_length - 4;
-        uint32_t received_crc = (uint32_t)output[payload_len] |
-                                ((uint32_t)output[payload_len + 1] << 8) |
-                                ((uint32_t)output[payload_len + 2] << 16) |
-                                ((uint32_t)output[payload_len + 3] << 24);
-        *output_length = payload_len;
 
-        uint32_t calc_crc = 0;
-        calc_crc = kiss_crc32_push(kiss, calc_crc, header, 1);
-        calc_crc = kiss_crc32_push(kiss, calc_crc, output, payload_len);
-        calc_crc = ~calc_crc;
-        // Verify the calculated CRC of the payload against the received one
-        if (calc_crc != received_crc)
-        {        
-            kiss->Status = KISS_STATUS_RECEIVED_ERROR;
-            return KISS_ERR_CRC32_MISMATCH;
+        /* the port keeps its turn after a write error, the frame is sent again at the next call */
+        if(KISS_OK == err)
+        {
+            mux->credited = 0;
+            mux->current = (uint8_t)((mux->current + 1) % mux->count);
         }
-    }   
-
-    if(KISS_HEADER_ACK == *header)
-    {
-        kiss->frame_flag = KISS_FLAG_ACK;
-    }
-    else if(KISS_HEADER_NACK == *header)
-    {
-        kiss->frame_flag = KISS_FLAG_NACK;
     }
-    else if(KISS_HEADER_PING == *header)
-    {    
-        kiss->frame_flag = KISS_FLAG_PING;
-    }
-    else
+
+    if(frames)
     {
-        kiss->frame_flag = KISS_FLAG_NONE;
+        *frames = sent;
     }
-
-    return KISS_OK;
+    return (KISS_OK == err) ? drop_err : err;
 }
 
 
 
-int32_t kiss_send_frame(kiss_instance_t *const kiss)
+int32_t kiss_mux_dispatch(kiss_instance_t *const kiss, const kiss_mux_t *const mux, uint8_t header, const uint8_t *const payload, size_t length)
 {
-    /* param check */
-    if (NULL == kiss) 
+    if(NULL == kiss || NULL == mux)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    /* check if the write callback function exists */
-    if(NULL == kiss->write)
+    if(KISS_HEADER_TYPE(header) != 0)
     {
-        return KISS_ERR_CALLBACK_MISSING;
+        return KISS_ERR_NOT_HANDLED;
     }
-    /* if we are not in the transmitting status it means there is nothing to transmit */
-    if(kiss->Status != KISS_STATUS_TRANSMITTING)
+
+    uint8_t port = (uint8_t)(header & 0x0F);
+    if(port >= mux->count || NULL == mux->ports[port].handler)
     {
-        return KISS_ERR_DATA_NOT_ENCODED;
+        return KISS_ERR_NOT_HANDLED;
     }
 
-    int32_t err = KISS_OK;
+    return mux->ports[port].handler(kiss, header, payload, length, mux->ports[port].user);
+}
 
-    /* check if padding size is not too large */
-    if(kiss->padding > KISS_MAX_PADDING)
-    {
-        return KISS_ERR_PADDING_OVERFLOW;
-    }
 
-    /* if kiss->padding is not zero we send some KISS_FEND padding bytes */
-    if(kiss->padding > 0)
-    {
-        /* adding arduino block for extra memory reduction */
-        #ifdef ARDUINO
-            uint8_t chunk[KISS_MAX_PADDING];
-            for(uint8_t i = 0; i < kiss->padding; i++)
-            {
-                chunk[i] = pgm_read_byte(&kiss_padding_block[i]);
-            }
-            err = kiss->write(kiss, chunk, kiss->padding);
-        #else
-            err = kiss->write(kiss, kiss_padding_block, kiss->padding);
-        #endif
 
-        if(err != KISS_OK)
-        {
-            kiss->Status = KISS_STATUS_ERROR_STATE;
-            return err;
-        }
-    }
+int32_t kiss_mux_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_mux_dispatch(kiss, (const kiss_mux_t *)user, header, payload, length);
+}
 
-    /* write the frame */
-    err = kiss->write(kiss, kiss->buffer, kiss->index);
-    /* if no error */
-    if(KISS_OK == err)
-    {
-        kiss->Status = KISS_STATUS_TRANSMITTED;
-        return KISS_OK;
-    }
 
-    /* here we have an error */
-    kiss->Status = KISS_STATUS_ERROR_STATE;
-    return err;
+
+/* empty slot of the callsign set */
+#define KISS_AX25_EMPTY 0ULL
+/* key bit of the entries matching any SSID */
+#define KISS_AX25_ANY_BIT (1ULL << 52)
+
+
+
+static uint16_t kiss_ax25_hash(uint64_t key, uint16_t size)
+{
+    /* Fibonacci hashing, the high bits are the best mixed */
+    return (uint16_t)((key * 0x9E3779B97F4A7C15ULL) >> 48) & (uint16_t)(size - 1);
 }
 
 
 
-int32_t kiss_encode_and_send(kiss_instance_t *const kiss, const uint8_t *const data, size_t length, uint8_t header)
+static uint8_t kiss_ax25_contains(const kiss_ax25_filter_t *const filter, uint64_t key)
 {
-    /* error container */
-    int32_t err = KISS_OK;
-    /* encoding the data */
-    err = kiss_encode(kiss, data, length, header);
-    /* check if the encoding went ok */
-    if(err != KISS_OK)
+    uint16_t i = kiss_ax25_hash(key, filter->size);
+
+    /* linear probing until an empty slot, there is always one */
+    while(filter->slots[i] != KISS_AX25_EMPTY)
     {
-        return err;
+        if(filter->slots[i] == key)
+        {
+            return 1;
+        }
+        i = (uint16_t)((i + 1) & (filter->size - 1));
     }
-    /* sending the frame immediatly */
-    return kiss_send_frame(kiss);
+    return 0;
 }
 
 
 
-int32_t kiss_receive_frame(kiss_instance_t *const kiss, uint32_t maxAttempts)
+/* key of an address field as received: the callsign characters and the SSID */
+static uint64_t kiss_ax25_key(const uint8_t *const address)
 {
-    /* check if parameters are ok */
-    if(NULL == kiss)
+    uint64_t key = 0;
+    for(uint8_t i = 0; i < 6; i++)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        key = (key << 8) | (uint8_t)((address[i] >> 1) & 0x7F);
     }
+    return (key << 4) | (uint8_t)((address[6] >> 1) & 0x0F);
+}
 
-    /* the reading callback function must exist */
-    if(NULL == kiss->read)
+
+
+int32_t kiss_ax25_filter_init(kiss_ax25_filter_t *const filter, uint64_t *const slots, uint16_t size, uint8_t match)
+{
+    if(NULL == filter || NULL == slots || size < 2 || (size & (size - 1)) != 0)
     {
-        return KISS_ERR_CALLBACK_MISSING;
+        return KISS_ERR_INVALID_PARAMS;
     }
-
-    // Validate inputs
-    if (NULL == kiss->buffer || 0 == maxAttempts)
+    if(0 == (match & (KISS_AX25_MATCH_DEST | KISS_AX25_MATCH_SOURCE)))
     {
         return KISS_ERR_INVALID_PARAMS;
     }
 
-    // we receive so we make sure that we start with index = 0
-    kiss->index = 0;
-    // we make sure that the status is receiving
-    kiss->Status = KISS_STATUS_RECEIVING;
-    // check if the frame is started or not
-    uint8_t frame_started = 0;
-    // error state of the read function (== 0 no error)
-    int32_t err = KISS_OK;
-    // frame size usage
-    size_t new_index = 0;
-    size_t new_read = 0;
-
-    // Read bytes until a full frame is received
-    for(uint32_t attempt = 0; attempt < maxAttempts; attempt++)
+    for(uint16_t i = 0; i < size; i++)
     {
-        // try to read, the caller make sure that the read starts when something arrives 
-        // if a frame starts in one read and ends in another read, the frame will be discarded
-        err = kiss->read(kiss, &(kiss->buffer[new_index]), kiss->buffer_size, &(new_read));
-
-        kiss->index += new_read;
-        /* if the read function returns an error we stop the function and return the error */
-        if(err != KISS_OK)
-        {
-            kiss->Status = KISS_STATUS_ERROR_STATE;
-            return err;
-        }
-        
-        /* we received something, hence we start searching for the frame inside */
-        for(size_t i = new_index; i < kiss->index; i++)
-        {
-
-            /* if the frame is not started we go inside */
-            if (!frame_started)
-            {
-                /* starting frame? */
-                if (KISS_FEND == kiss->buffer[i])
-                {
-                    /* frame is started we copy at the start of the buffer, remember that
-                    * in this case i >= new_index ALWAYS */
-                    frame_started = 1;
-                    kiss->buffer[new_index] = kiss->buffer[i];
-                    new_index++;
-                } 
-            }
-            else
-            {
-                /* if there are more C0 after the first one we just pass them since they are there for sync or padding */
-                if(i > 0 && KISS_FEND == kiss->buffer[i] && new_index <= 1)
-                {
-                    /* do nothing, continue the cycle and ignore the C0 padding */
-                }
-                else
-                {
-                    /* we copy back the byte */
-                    kiss->buffer[new_index] = kiss->buffer[i];
-                    new_index++;
-                
-                    /* if we are here the frame is already started and we are searching for the ending byte */
-                    if (KISS_FEND == kiss->buffer[i])
-                    {
-                        /* we have the ending byte so we set the received status */
-                        kiss->Status = KISS_STATUS_RECEIVED;
-                        /* we set the frame length */
-                        kiss->index = new_index;
+        slots[i] = KISS_AX25_EMPTY;
+    }
 
-                        /* if the frame length is not enough to be valid return error state */
-                        if(new_index < 3)
-                        {
-                            kiss->Status = KISS_STATUS_ERROR_STATE;                    
-                            return KISS_ERR_INVALID_FRAME;
-                        }
+    filter->slots = slots;
+    filter->size = size;
+    filter->count = 0;
+    filter->match = match;
 
-                        kiss->Status = KISS_STATUS_RECEIVED;
-                        kiss->frame_flag = KISS_FLAG_NONE;
-                        return KISS_OK;
-                    } 
-                }    
-            }   
-        }
-    }
-    /* if we arrive here it means no data is received */
-    return KISS_ERR_NO_DATA_RECEIVED;
+    return KISS_OK;
 }
 
 
 
-int32_t kiss_receive_and_decode(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint32_t maxAttempts, uint8_t *const header)
+int32_t kiss_ax25_filter_add(kiss_ax25_filter_t *const filter, const char *const callsign, uint8_t ssid)
 {
-    /* check if kiss is null*/
-    if(NULL == kiss)
+    if(NULL == filter || NULL == callsign || (ssid > 15 && ssid != KISS_AX25_SSID_ANY))
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    /* buffer size cannot be zero */
-    if(0 == kiss->buffer_size)
+
+    /* the address field of the callsign, padded with spaces */
+    uint8_t address[KISS_AX25_ADDR_LEN];
+    uint8_t len = 0;
+    while(callsign[len] != '\0')
     {
-        return KISS_ERR_INVALID_PARAMS;
+        char c = callsign[len];
+        if(len >= 6)
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        if(c >= 'a' && c <= 'z')
+        {
+            c = (char)(c - 'a' + 'A');
+        }
+        if(!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+        {
+            return KISS_ERR_INVALID_PARAMS;
+        }
+        address[len] = (uint8_t)((uint8_t)c << 1);
+        len++;
     }
-    /* check if output data pointer is null */
-    if(NULL == output)
+    if(0 == len)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    /* check if the ouput length pointer is null */
-    if(NULL == output_length)
+    for(uint8_t i = len; i < 6; i++)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        address[i] = (uint8_t)(' ' << 1);
     }
-    /* check if the maximum attempts are ok */
-    if(0 == maxAttempts)
+    address[6] = (KISS_AX25_SSID_ANY == ssid) ? 0 : (uint8_t)(ssid << 1);
+
+    uint64_t key = kiss_ax25_key(address);
+    if(KISS_AX25_SSID_ANY == ssid)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        key |= KISS_AX25_ANY_BIT;
     }
-    
-    // -----------------------
 
-    /* error container */
-    int32_t err = KISS_OK;
-    /* try to receive a frame */
-    err = kiss_receive_frame(kiss, maxAttempts);
-    /* check if the frame has been received */
-    if(err != KISS_OK)
+    if(kiss_ax25_contains(filter, key))
     {
-        return err;
+        return KISS_OK;
     }
-    /* decode the frame and return the output status */
-    return kiss_decode(kiss, output, output_max_size, output_length, header);
+    /* one slot always stays empty to end the probing */
+    if(filter->count + 1U >= filter->size)
+    {
+        return KISS_ERR_TABLE_FULL;
+    }
+
+    uint16_t i = kiss_ax25_hash(key, filter->size);
+    while(filter->slots[i] != KISS_AX25_EMPTY)
+    {
+        i = (uint16_t)((i + 1) & (filter->size - 1));
+    }
+    filter->slots[i] = key;
+    filter->count++;
+
+    return KISS_OK;
 }
 
 
 
-int32_t kiss_set_TXdelay(kiss_instance_t *const kiss, uint8_t tx_delay)
+/* 1 if the address (exact SSID or any SSID) is in the set */
+static uint8_t kiss_ax25_match(const kiss_ax25_filter_t *const filter, const uint8_t *const address)
 {
-    if (NULL == kiss || 0 == tx_delay)
-    {
-        return KISS_ERR_INVALID_PARAMS;
-    }
-    if(NULL == kiss->buffer)
+    uint64_t key = kiss_ax25_key(address);
+    if(kiss_ax25_contains(filter, key))
     {
-        return KISS_ERR_INVALID_PARAMS;
-    }
-    if(kiss->buffer_size < 4)
-    {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        return 1;
     }
+    return kiss_ax25_contains(filter, (key & ~0x0FULL) | KISS_AX25_ANY_BIT);
+}
 
-    kiss->TXdelay = tx_delay;
 
-    uint8_t payData = tx_delay;
-    size_t len = 1;
 
-    /* if we don't want CRC32 we enter here */
-    return kiss_encode_and_send(kiss, &payData, len, KISS_HEADER_TX_DELAY);
-    
+/* next byte of the received frame, 0 at the end of the frame (COBS codes and escaped bytes are never the delimiter) */
+static uint8_t kiss_ax25_read(kiss_bit_reader_t *const r, const uint8_t *const end, uint8_t delimiter, uint8_t *const b)
+{
+    if(r->p >= end || (r->escaped != 0 && delimiter == *r->p))
+    {
+        return 0;
+    }
+    *b = kiss_reader_byte(r);
+    return 1;
 }
 
 
 
-int32_t kiss_set_speed(kiss_instance_t *const kiss, uint32_t BaudRate)
+int32_t kiss_ax25_filter_check(kiss_instance_t *const kiss, const kiss_ax25_filter_t *const filter)
 {
-    if (NULL == kiss || 0 == BaudRate)
+    if(NULL == kiss || NULL == filter || NULL == kiss->buffer)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    if(NULL == kiss->buffer)
+    if(kiss->Status != KISS_STATUS_RECEIVED)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        return KISS_ERR_STATUS;
     }
-    if(kiss->buffer_size < 7)
+
+    const uint8_t *end = kiss->buffer + kiss->index;
+    uint8_t delimiter = kiss_delimiter(kiss);
+    kiss_bit_reader_t r;
+    kiss_reader_frame(&r, kiss);
+
+    uint8_t ok = 1;
+    uint8_t header = KISS_HEADER_DATA(0);
+    if(kiss->framing != KISS_FRAMING_SLIP)
     {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        ok = kiss_ax25_read(&r, end, delimiter, &header);
+    }
+    /* only the data frames carry AX.25, the compressed ones are checked after decoding */
+    if(ok && KISS_HEADER_TYPE(header) != 0)
+    {
+        return KISS_OK;
     }
 
-    uint8_t payData[4];
-    size_t len = 4;
+    uint8_t key = 0;
+    if(ok && (kiss->scramble_policy & 1U))
+    {
+        ok = kiss_ax25_read(&r, end, delimiter, &key);
+    }
 
-    payData[0] = (uint8_t)(BaudRate & 0xFF);
-    payData[1] = (uint8_t)((BaudRate >> 8) & 0xFF);
-    payData[2] = (uint8_t)((BaudRate >> 16) & 0xFF);
-    payData[3] = (uint8_t)((BaudRate >> 24) & 0xFF);
+    /* destination then source */
+    uint8_t addresses[2 * KISS_AX25_ADDR_LEN];
+    for(uint8_t i = 0; ok && i < 2 * KISS_AX25_ADDR_LEN; i++)
+    {
+        ok = kiss_ax25_read(&r, end, delimiter, &addresses[i]);
+        addresses[i] ^= key;
+    }
+    /* the CRC32 trailer is not part of the payload, a shorter frame cannot hold both addresses */
+    uint8_t trailer;
+    for(uint8_t i = 0; ok && kiss_header_has_crc(kiss, header) && i < 4; i++)
+    {
+        ok = kiss_ax25_read(&r, end, delimiter, &trailer);
+    }
 
-    return kiss_encode_and_send(kiss, payData, len, KISS_HEADER_SPEED);
+    if(ok && (((filter->match & KISS_AX25_MATCH_DEST) && kiss_ax25_match(filter, &addresses[0])) ||
+              ((filter->match & KISS_AX25_MATCH_SOURCE) && kiss_ax25_match(filter, &addresses[KISS_AX25_ADDR_LEN]))))
+    {
+        return KISS_OK;
+    }
 
+    /* not for us: the frame is dropped without decoding it */
+    kiss->index = 0;
+    kiss->Status = KISS_STATUS_NOTHING;
+    return KISS_ERR_FILTERED;
 }
 
 
 
-int32_t kiss_send_ack(kiss_instance_t *const kiss)
+
+/* length of the address block at the start of an AX.25 frame (the last address has the extension bit set), 0 if it cannot be kept in a context */
+static size_t kiss_ax25_address_length(const uint8_t *const frame, size_t length)
 {
-    if (NULL == kiss)
+    for(size_t end = KISS_AX25_ADDR_LEN; end <= length && end <= KISS_AX25_CONTEXT_MAX_ADDR; end += KISS_AX25_ADDR_LEN)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        if(frame[end - 1] & 0x01)
+        {
+            return (end >= 2 * KISS_AX25_ADDR_LEN) ? end : 0;
+        }
     }
-    if(NULL == kiss->buffer)
+    return 0;
+}
+
+
+
+/* clear the contexts of a sender or a receiver */
+static int32_t kiss_ax25_contexts_init(kiss_ax25_context_t *const contexts, uint8_t count)
+{
+    if(NULL == contexts || 0 == count)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    if(kiss->buffer_size < 3)
+
+    for(uint8_t i = 0; i < count; i++)
     {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        contexts[i].length = 0;
+        contexts[i].port = 0;
+        contexts[i].generation = 0;
+        contexts[i].acked = 0;
+        contexts[i].last_used = 0;
     }
 
-    return kiss_encode_and_send(kiss, NULL, 0, KISS_HEADER_ACK);
+    return KISS_OK;
 }
 
 
 
-int32_t kiss_send_nack(kiss_instance_t *const kiss)
+int32_t kiss_ax25_tx_init(kiss_ax25_tx_t *const tx, kiss_ax25_context_t *const contexts, uint8_t count)
 {
-    if(NULL == kiss)
+    if(NULL == tx)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    if(NULL == kiss->buffer)
-    {
-        return KISS_ERR_INVALID_PARAMS;
-    }
-    if(kiss->buffer_size < 3) 
+
+    int32_t err = kiss_ax25_contexts_init(contexts, count);
+    if(err != KISS_OK)
     {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        return err;
     }
 
-    return kiss_encode_and_send(kiss, NULL, 0, KISS_HEADER_NACK);
+    tx->contexts = contexts;
+    tx->count = count;
+    tx->clock = 0;
 
+    return KISS_OK;
 }
 
 
 
-
-int32_t kiss_send_ping(kiss_instance_t *const kiss)
+int32_t kiss_ax25_send(kiss_instance_t *const kiss, kiss_ax25_tx_t *const tx, uint8_t port, const uint8_t *const frame, size_t length)
 {
-    if(NULL == kiss)
+    if(NULL == kiss || NULL == tx || NULL == frame || port > 0x0F)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-    if(NULL == kiss->buffer)
+
+    size_t address_length = kiss_ax25_address_length(frame, length);
+    if(0 == address_length)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        return kiss_encode_and_send(kiss, frame, length, KISS_HEADER_DATA(port));
     }
-    if(kiss->buffer_size < 3) 
+    /* the compressed frame is written in pieces, it cannot be scrambled */
+    if(kiss->scramble_policy & (1U << KISS_HEADER_TYPE(KISS_HEADER_AX25_FULL)))
     {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        return KISS_ERR_INVALID_PARAMS;
     }
 
-    return kiss_encode_and_send(kiss, NULL, 0, KISS_HEADER_PING);
+    tx->clock++;
 
-}
+    /* context of this address block, otherwise a free one or the least recently used */
+    uint8_t id = 0;
+    uint8_t found = 0;
+    uint16_t oldest = 0;
+    for(uint8_t i = 0; i < tx->count && 0 == found; i++)
+    {
+        kiss_ax25_context_t *context = &tx->contexts[i];
+        uint8_t same = (context->length == address_length && context->port == port);
+        for(size_t j = 0; same && j < address_length; j++)
+        {
+            same = (context->address[j] == frame[j]);
+        }
+        if(same)
+        {
+            id = i;
+            found = 1;
+        }
+        else if(0 == context->length)
+        {
+            id = i;
+            oldest = 0xFFFF;
+        }
+        else if((uint16_t)(tx->clock - context->last_used) > oldest)
+        {
+            id = i;
+            oldest = (uint16_t)(tx->clock - context->last_used);
+        }
+    }
 
+    kiss_ax25_context_t *context = &tx->contexts[id];
+    if(0 == found)
+    {
+        /* a new generation: the acknowledges of the old address block do not count anymore */
+        for(size_t j = 0; j < address_length; j++)
+        {
+            context->address[j] = frame[j];
+        }
+        context->length = (uint8_t)address_length;
+        context->port = port;
+        context->generation++;
+        context->acked = 0;
+    }
+    context->last_used = tx->clock;
 
+    uint8_t use_crc = 0;
+    uint32_t crc = 0;
+    uint8_t head[3] = {id, context->generation, port};
 
+    int32_t err = kiss_frame_begin(kiss, context->acked ? KISS_HEADER_AX25_COMPRESSED : KISS_HEADER_AX25_FULL, &use_crc, &crc);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
 
-int32_t kiss_set_param(kiss_instance_t *const kiss, uint16_t ID, const uint8_t *const param, size_t len)
-{
-    /* check if kiss instance is null or parameter pointer is null */
-    if(NULL == kiss || NULL == param) 
+    if(context->acked)
     {
-        return KISS_ERR_INVALID_PARAMS;
+        err = kiss_frame_put(kiss, use_crc, &crc, head, 1);
+        if(err == KISS_OK)
+        {
+            err = kiss_frame_put(kiss, use_crc, &crc, &frame[address_length], length - address_length);
+        }
     }
-    /* check if buffer size is large enough */
-    if(kiss->buffer_size < 5 + len) 
+    else
     {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        /* sent in full until the receiver has the context */
+        err = kiss_frame_put(kiss, use_crc, &crc, head, 3);
+        if(err == KISS_OK)
+        {
+            err = kiss_frame_put(kiss, use_crc, &crc, frame, length);
+        }
     }
-
-    /* error container */
-    int32_t err = KISS_OK;
-    
-    /* ID of the parameter to send as byte array */
-    uint8_t id_[2] = {(uint8_t) ID, (uint8_t)(ID >> 8)};
-    
-    /* encode the parameter ID */
-    err = kiss_encode(kiss, id_, 2, KISS_HEADER_SET_PARAM);
-    /* check for errors */
-    if(err != KISS_OK) 
+    if(err != KISS_OK)
     {
         return err;
-    }  
-    
-    /* push encode the parameter */
-    err = kiss_push_encode(kiss, param, len);
-    /* check for errors */
-    if(err != KISS_OK) 
+    }
+
+    err = kiss_frame_end(kiss, use_crc, crc);
+    if(err != KISS_OK)
     {
         return err;
     }
 
-
-    /* status is transmitting */
-    kiss->Status = KISS_STATUS_TRANSMITTING;
-
-    /* send the frame and return the result */
     return kiss_send_frame(kiss);
-
 }
 
 
 
+int32_t kiss_ax25_tx_handle(kiss_instance_t *const kiss, kiss_ax25_tx_t *const tx, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == kiss || NULL == tx)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(header != KISS_HEADER_AX25_CONTEXT_ACK)
+    {
+        return KISS_ERR_NOT_HANDLED;
+    }
+    if(NULL == payload || length < 1 || length > 2 || payload[0] >= tx->count)
+    {
+        return KISS_ERR_INVALID_FRAME;
+    }
+
+    kiss_ax25_context_t *context = &tx->contexts[payload[0]];
+    if(1 == length)
+    {
+        /* the receiver lost the context */
+        context->acked = 0;
+    }
+    else if(context->length != 0 && payload[1] == context->generation)
+    {
+        /* an acknowledge of an older generation is ignored */
+        context->acked = 1;
+    }
 
+    return KISS_OK;
+}
 
 
 
+int32_t kiss_ax25_rx_init(kiss_ax25_rx_t *const rx, kiss_ax25_context_t *const contexts, uint8_t count, uint8_t *const output, size_t output_size, kiss_frame_fn handler, void *const user)
+{
+    if(NULL == rx || NULL == output || NULL == handler)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
 
+    int32_t err = kiss_ax25_contexts_init(contexts, count);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
 
+    rx->contexts = contexts;
+    rx->count = count;
+    rx->output = output;
+    rx->output_size = output_size;
+    rx->handler = handler;
+    rx->user = user;
 
+    return KISS_OK;
+}
 
 
 
-int32_t kiss_request_param(kiss_instance_t *const kiss, uint16_t ID)
+int32_t kiss_ax25_rx_handle(kiss_instance_t *const kiss, kiss_ax25_rx_t *const rx, uint8_t header, const uint8_t *const payload, size_t length)
 {
-    if(NULL == kiss)
+    if(NULL == kiss || NULL == rx)
     {
         return KISS_ERR_INVALID_PARAMS;
     }
-
-    /* check if buffer size is large enough */
-    if(kiss->buffer_size < 5) 
+    if(header != KISS_HEADER_AX25_FULL && header != KISS_HEADER_AX25_COMPRESSED)
     {
-        return KISS_ERR_BUFFER_OVERFLOW;
+        return KISS_ERR_NOT_HANDLED;
+    }
+    if(NULL == payload || length < 1 || payload[0] >= rx->count)
+    {
+        return KISS_ERR_INVALID_FRAME;
     }
 
-    /* error container */
+    uint8_t id = payload[0];
+    kiss_ax25_context_t *context = &rx->contexts[id];
+    size_t restored = 0;
     int32_t err = KISS_OK;
-    
-    /* ID of the parameter to send as byte array */
-    uint8_t id_[2] = {(uint8_t) ID, (uint8_t)(ID >> 8)};
 
-    /* encode the parameter ID */
-    err = kiss_encode(kiss, id_, 2, KISS_HEADER_REQUEST_PARAM);
+    if(KISS_HEADER_AX25_FULL == header)
+    {
+        if(length < 3 || payload[2] > 0x0F)
+        {
+            return KISS_ERR_INVALID_FRAME;
+        }
 
-    /* check for errors */
-    if(err != KISS_OK) 
+        size_t address_length = kiss_ax25_address_length(&payload[3], length - 3);
+        if(0 == address_length)
+        {
+            return KISS_ERR_INVALID_FRAME;
+        }
+        restored = length - 3;
+        if(restored > rx->output_size)
+        {
+            return KISS_ERR_BUFFER_OVERFLOW;
+        }
+
+        context->length = (uint8_t)address_length;
+        context->port = payload[2];
+        context->generation = payload[1];
+        context->acked = 1;
+        for(size_t i = 0; i < restored; i++)
+        {
+            rx->output[i] = payload[3 + i];
+        }
+        for(size_t i = 0; i < address_length; i++)
+        {
+            context->address[i] = payload[3 + i];
+        }
+
+        /* the payload may be in the instance buffer, it is not used anymore */
+        uint8_t ack[2] = {id, context->generation};
+        err = kiss_encode_and_send(kiss, ack, 2, KISS_HEADER_AX25_CONTEXT_ACK);
+    }
+    else
+    {
+        if(0 == context->acked)
+        {
+            /* unknown context (e.g. after a reset): ask the sender to send it in full again */
+            err = kiss_encode_and_send(kiss, &id, 1, KISS_HEADER_AX25_CONTEXT_ACK);
+            return (err != KISS_OK) ? err : KISS_ERR_INVALID_FRAME;
+        }
+
+        restored = context->length + (length - 1);
+        if(restored > rx->output_size)
+        {
+            return KISS_ERR_BUFFER_OVERFLOW;
+        }
+        for(size_t i = 0; i < context->length; i++)
+        {
+            rx->output[i] = context->address[i];
+        }
+        for(size_t i = 1; i < length; i++)
+        {
+            rx->output[context->length + i - 1] = payload[i];
+        }
+    }
+
+    if(err != KISS_OK)
     {
         return err;
     }
-    
-    /* status is transmitting */
-    kiss->Status = KISS_STATUS_TRANSMITTING;
 
-    /* send the frame and return the result */
-    return kiss_send_frame(kiss);    
+    return rx->handler(kiss, KISS_HEADER_DATA(context->port), rx->output, restored, rx->user);
 }
 
 
 
-int32_t kiss_send_command(kiss_instance_t *const kiss, uint16_t command)
+int32_t kiss_ax25_tx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
 {
-    /* checking if parameters are ok */
-    if(NULL == kiss)
-    {
-        return KISS_ERR_INVALID_PARAMS;
-    }
-    /* create a byte array from the 2 bytes command */
-    uint8_t cmd_b[2] = {(uint8_t) (command), (uint8_t) ((command) >> 8)};
+    return kiss_ax25_tx_handle(kiss, (kiss_ax25_tx_t *)user, header, payload, length);
+}
 
-    kiss->Status = KISS_STATUS_TRANSMITTING;
 
-    /* encode and send the command */
-    return kiss_encode_and_send(kiss, cmd_b, 2, KISS_HEADER_COMMAND);
 
+int32_t kiss_ax25_rx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    return kiss_ax25_rx_handle(kiss, (kiss_ax25_rx_t *)user, header, payload, length);
 }
 
 
 
+int32_t kiss_ax25_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user)
+{
+    const kiss_ax25_link_t *link = (const kiss_ax25_link_t *)user;
+    if(NULL == link)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the acknowledges are for the sender, the data frames for the receiver */
+    if(KISS_HEADER_AX25_CONTEXT_ACK == header)
+    {
+        return link->tx ? kiss_ax25_tx_handle(kiss, link->tx, header, payload, length) : KISS_ERR_NOT_HANDLED;
+    }
+    return link->rx ? kiss_ax25_rx_handle(kiss, link->rx, header, payload, length) : KISS_ERR_NOT_HANDLED;
+}
+
+
 
 
 
@@ -59,6 +59,16 @@ extern "C" {
 #define KISS_ERR_HEADER_ESCAPE 8
 #define KISS_ERR_STATUS 9
 #define KISS_ERR_PADDING_OVERFLOW 10
+#define KISS_ERR_DUPLICATE 11
+#define KISS_ERR_NOT_HANDLED 12
+#define KISS_ERR_TIMEOUT 13
+#define KISS_ERR_TABLE_FULL 14
+#define KISS_ERR_UNKNOWN_PARAM 15
+#define KISS_ERR_PARAM_ACCESS 16
+#define KISS_ERR_UNKNOWN_COMMAND 17
+#define KISS_ERR_FILTERED 18
+#define KISS_ERR_IO 19
+#define KISS_ERR_REMOTE 20
 
 #define KISS_OK 0   
 
@@ -93,8 +103,20 @@ extern "C" {
  * - KISS_HEADER_ACK: control frame for acknowledgments. 0xA0
  * - KISS_HEADER_NACK: control frame for negative acknowledgments. 0xC0
  * - KISS_HEADER_REQUEST_PARAM: control frame to request a parameter. 0x40
+ * - KISS_HEADER_REQUEST_PARAM_TAG: parameter request carrying a tag to match the response. 0x41
+ * - KISS_HEADER_PARAM_RESPONSE_TAG: response to a tagged parameter request. 0x42
+ * - KISS_HEADER_BATCH_GET: request of many parameters, list of IDs. 0x43
+ * - KISS_HEADER_BATCH_RESPONSE: response to a batch get, list of (ID, length, value). 0x44
  * - KISS_HEADER_SET_PARAM: control frame to set a parameter. 0x50
+ * - KISS_HEADER_BATCH_SET: set many parameters, list of (ID, length, value). 0x51
  * - KISS_HEADER_COMMAND: control frame to send a command. 0x70
+ * - KISS_HEADER_COMMAND_SEQ: command frame with a sequence number for duplicate suppression. 0x71
+ * - KISS_HEADER_TELEMETRY: periodic telemetry sent by the scheduler, list of (ID, length, value). 0x30
+ * - KISS_HEADER_AX25_FULL / KISS_HEADER_AX25_COMPRESSED / KISS_HEADER_AX25_CONTEXT_ACK: AX.25 header compression. 0xE0 / 0xE1 / 0xE2
+ *   The three share the handler slot 0xE: a node that both sends and receives uses kiss_ax25_handler.
+ *
+ * The handler table has one slot per type (header >> 4): the two sides of a service share a slot, so a node that uses
+ * both installs the combined adapter (kiss_param_handler, kiss_delta_handler, kiss_blob_handler, kiss_ax25_handler).
  * - Additional control frame types may be defined in the future.
  */
 #define KISS_HEADER_DATA(port) ((uint8_t)(port & 0x0F))
@@ -104,8 +126,59 @@ extern "C" {
 #define KISS_HEADER_ACK 0xA0
 #define KISS_HEADER_NACK 0xA5
 #define KISS_HEADER_REQUEST_PARAM 0x40
+#define KISS_HEADER_REQUEST_PARAM_TAG 0x41
+#define KISS_HEADER_PARAM_RESPONSE_TAG 0x42
+#define KISS_HEADER_BATCH_GET 0x43
+#define KISS_HEADER_BATCH_RESPONSE 0x44
 #define KISS_HEADER_SET_PARAM 0x50
+#define KISS_HEADER_BATCH_SET 0x51
 #define KISS_HEADER_COMMAND 0x70
+#define KISS_HEADER_COMMAND_SEQ 0x71
+#define KISS_HEADER_DELTA_KEY 0x90
+#define KISS_HEADER_DELTA 0x91
+#define KISS_HEADER_DELTA_ACK 0x92
+#define KISS_HEADER_DELTA_NACK 0x93
+#define KISS_HEADER_LZSS 0xD0
+#define KISS_HEADER_BLOB_OFFER 0xB0
+#define KISS_HEADER_BLOB_CHUNK 0xB1
+#define KISS_HEADER_BLOB_ACK 0xB2
+#define KISS_HEADER_TELEMETRY 0x30
+#define KISS_HEADER_AX25_FULL 0xE0
+#define KISS_HEADER_AX25_COMPRESSED 0xE1
+#define KISS_HEADER_AX25_CONTEXT_ACK 0xE2
+
+
+
+/** Standard KISS command byte (KISS TNC protocol), used with kiss_std_encode / kiss_std_decode
+ *
+ * The standard command byte has the port in the high nibble and the command in the low nibble,
+ * the opposite of the headers above, so these frames are encoded and decoded apart.
+ * - KISS_STD_DATA: data frame to be sent on the radio port.
+ * - KISS_STD_TXDELAY: keyup delay in 10 ms units.
+ * - KISS_STD_PERSISTENCE: p-persistence parameter, p = (value + 1) / 256.
+ * - KISS_STD_SLOTTIME: slot interval in 10 ms units.
+ * - KISS_STD_TXTAIL: time to hold the transmitter up after the frame, in 10 ms units.
+ * - KISS_STD_FULLDUPLEX: 0 half duplex (channel access), anything else full duplex.
+ * - KISS_STD_SETHARDWARE: hardware specific data.
+ * - KISS_STD_RETURN: exit KISS mode (the whole command byte is 0xFF).
+ */
+#define KISS_STD_DATA 0x00
+#define KISS_STD_TXDELAY 0x01
+#define KISS_STD_PERSISTENCE 0x02
+#define KISS_STD_SLOTTIME 0x03
+#define KISS_STD_TXTAIL 0x04
+#define KISS_STD_FULLDUPLEX 0x05
+#define KISS_STD_SETHARDWARE 0x06
+#define KISS_STD_RETURN 0xFF
+#define KISS_STD_HEADER(port, command) ((uint8_t)((((port) & 0x0F) << 4) | ((command) & 0x0F)))
+#define KISS_STD_PORT(header) ((uint8_t)(((header) >> 4) & 0x0F))
+#define KISS_STD_COMMAND(header) ((uint8_t)((header) & 0x0F))
+
+/* default channel access parameters of the KISS specification */
+#define KISS_STD_PERSISTENCE_DEFAULT 63
+#define KISS_STD_SLOTTIME_DEFAULT 10
+/* slots waited for a clear channel before kiss_send_frame gives up with KISS_ERR_TIMEOUT */
+#define KISS_CSMA_MAX_SLOTS 1000
 
 
 
@@ -115,12 +188,77 @@ extern "C" {
 #define KISS_FLAG_ACK 0x01
 #define KISS_FLAG_NACK 0x02
 #define KISS_FLAG_PING 0x03
+#define KISS_FLAG_RETURN 0x04
 
 
 
 
 #define KISS_MAX_PADDING 32
 
+/* maximum ping payload echoed back in the ACK by kiss_send_ping_reply */
+#define KISS_PING_ECHO_MAX 8
+
+
+
+
+/** CRC32 modes selected with kiss_init
+ * - KISS_CRC32_OFF: frames never carry a CRC32.
+ * - KISS_CRC32_ON: every frame carries a CRC32.
+ * - KISS_CRC32_PER_FRAME: each frame type chooses (see kiss_set_crc_policy). A frame carrying
+ *   a CRC32 has KISS_HEADER_CRC_FLAG set in its header byte, so in this mode data ports are limited to 0-7.
+ */
+#define KISS_CRC32_OFF 0
+#define KISS_CRC32_ON 1
+#define KISS_CRC32_PER_FRAME 2
+
+/** framing modes, ORed with the CRC32 mode in kiss_init
+ * - KISS_FRAMING_KISS: FEND delimited frames with FESC escapes (worst case twice the size).
+ * - KISS_FRAMING_COBS: 0x00 delimited frames with Consistent Overhead Byte Stuffing (worst case one byte every 254).
+ *   Not compatible with KISS peers, both sides must use it.
+ * - KISS_FRAMING_SLIP: RFC 1055 SLIP, same bytes as KISS but without the header byte. The payload is sent whatever
+ *   the header and received with KISS_HEADER_DATA(0). KISS_CRC32_PER_FRAME and LZSS need the header, they are not available.
+ * - KISS_FRAMING_HDLC: HDLC asynchronous byte stuffing, 0x7E flags and 0x7D escapes of the byte XOR 0x20, with the header byte.
+ * - KISS_FRAMING_DATAGRAM: no delimiters and no escapes, for links that keep the frame boundaries (UDP, message queues).
+ *   Every write and every read is one whole frame: header, payload and CRC32 as they are. No padding is sent.
+ */
+#define KISS_FRAMING_KISS 0x00
+#define KISS_FRAMING_COBS 0x10
+#define KISS_FRAMING_SLIP 0x20
+#define KISS_FRAMING_HDLC 0x30
+#define KISS_FRAMING_DATAGRAM 0x40
+
+/* bits of the kiss_init mode selecting the framing */
+#define KISS_FRAMING_MASK 0x70
+
+/* special bytes of the HDLC asynchronous framing */
+#define KISS_HDLC_FLAG 0x7E
+#define KISS_HDLC_ESC 0x7D
+#define KISS_HDLC_TFLAG 0x5E
+#define KISS_HDLC_TESC 0x5D
+
+/* bits of the kiss_init mode selecting the CRC32 mode */
+#define KISS_CRC32_MODE_MASK 0x0F
+
+/* delimiter of the COBS frames */
+#define KISS_COBS_DELIMITER 0x00
+
+/* header bit telling the decoder that the frame carries a CRC32 (KISS_CRC32_PER_FRAME only) */
+#define KISS_HEADER_CRC_FLAG 0x08
+
+/* frame type of a header byte (most significant hex), used to index the per-type policies */
+#define KISS_HEADER_TYPE(header) ((uint8_t)(((header) >> 4) & 0x0F))
+
+/* LZSS window bits: from 256 bytes to 4 KiB of back-references */
+#define KISS_LZSS_WINDOW_MIN 8
+#define KISS_LZSS_WINDOW_MAX 12
+#define KISS_LZSS_WINDOW_DEFAULT 10
+/* bits of the match length, the matches are from 2 to 17 bytes */
+#define KISS_LZSS_LENGTH_BITS 4
+#define KISS_LZSS_MATCH_MIN 2
+
+/* default per-frame CRC32 policy: every frame type carries the CRC32 except ping, ACK and NACK */
+#define KISS_CRC_POLICY_DEFAULT ((uint16_t)~((1U << KISS_HEADER_TYPE(KISS_HEADER_PING)) | (1U << KISS_HEADER_TYPE(KISS_HEADER_ACK))))
+
 
 
 
@@ -140,7 +278,9 @@ typedef struct kiss_instance_t kiss_instance_t;
 typedef int32_t (*kiss_write_fn)(kiss_instance_t *const kiss, const uint8_t *const data, size_t length);
 
 /**
- * @brief The library calls this with small lengths (typically 1). Implementations should attempt to return exactly `length` bytes (may block).
+ * @brief The library calls this with the space left in the instance buffer. Implementations return the bytes available (possibly fewer,
+ *  or 0 if nothing arrived yet). The bytes after the delimiter that ends a frame are not kept by kiss_receive_frame,
+ *  an implementation that reads several frames at once must stop at the delimiter (see kiss_frame_delimiter) and keep the rest.
  *  @param kiss kiss instance, inside the instance there is the context variable for using specific physical layers
  *  @param buffer buffer array where the data arrived is written
  *  @param dataLen maximum data length of the buffer array
@@ -151,6 +291,57 @@ typedef int32_t (*kiss_write_fn)(kiss_instance_t *const kiss, const uint8_t *con
 typedef int32_t (*kiss_read_fn)(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const read);
 
 
+/**
+ * @brief Monotonic clock used by the services that need timeouts (e.g. HAL_GetTick or millis).
+ *  @param kiss kiss instance, inside the instance there is the context variable
+ *  @returns milliseconds from any fixed point in time, it may wrap around
+ */
+typedef uint32_t (*kiss_clock_fn)(kiss_instance_t *const kiss);
+
+
+
+/**
+ * @brief Radio channel hooks used by kiss_send_frame when the instance keys a transmitter (kiss_set_channel).
+ *  Every hook may be NULL.
+ */
+typedef struct
+{
+    int32_t (*busy)(kiss_instance_t *const kiss); /**< returns non zero while the channel is busy (carrier detect), NULL = always clear */
+    void (*ptt)(kiss_instance_t *const kiss, uint8_t on); /**< keys (1) and unkeys (0) the transmitter */
+    void (*delay)(kiss_instance_t *const kiss, uint32_t ms); /**< blocking wait, used for TXdelay, TXtail and the slot time */
+    uint8_t (*random)(kiss_instance_t *const kiss); /**< random byte for the p-persistence, NULL = internal generator */
+    int32_t (*set_hardware)(kiss_instance_t *const kiss, uint8_t port, const uint8_t *const data, size_t length); /**< KISS_STD_SETHARDWARE command */
+} kiss_channel_t;
+
+
+
+/**
+ * @brief Frame handler called by kiss_dispatch for the frames of one type.
+ *  @param kiss instance that received the frame, kiss->frame_flag is already set
+ *  @param header header of the frame (the port is in the least significant hex)
+ *  @param payload decoded payload inside the instance buffer, valid until the instance encodes another frame
+ *  @param length payload length
+ *  @param user user pointer of the handler
+ *  @retval KISS_OK if the frame has been handled
+ *  @retval KISS_ERR_NOT_HANDLED to give the frame back to the caller of kiss_dispatch
+ *  @retval Any other number for error
+ */
+typedef int32_t (*kiss_frame_fn)(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+/**
+ * @brief one entry of the handler table
+ */
+typedef struct
+{
+    kiss_frame_fn fn; /**< handler, NULL if the frames of this type are left to the application */
+    void *user; /**< user pointer passed to the handler (e.g. the registry or the command table) */
+} kiss_handler_t;
+
+/* the handler table has one entry per frame type (header >> 4) */
+#define KISS_HANDLER_COUNT 16
+
+
 
 /**
  * @brief this structure contains the entire kiss instance that has been created for each link
@@ -166,8 +357,24 @@ struct kiss_instance_t
     uint8_t Status; /**< current frame status (KISS_NOTHING, KISS_TRANSMITTING, etc). */
     void *context; /**< context used in the write/read functions (for instance: context for UART, I2C, SPI, etc..) */
     uint8_t padding; /**< padding number is the number of FEND bytes to write before actually starting sending the frame. Typically used for synch */
-    uint8_t CRC32; /**< flag for using crc32 or not. If you want to use CRC32 put it to 1, 0 otherwise */
+    uint8_t CRC32; /**< CRC32 mode: KISS_CRC32_OFF, KISS_CRC32_ON or KISS_CRC32_PER_FRAME */
+    uint8_t framing; /**< KISS_FRAMING_KISS, KISS_FRAMING_COBS, KISS_FRAMING_SLIP, KISS_FRAMING_HDLC or KISS_FRAMING_DATAGRAM */
+    size_t cobs_code; /**< COBS framing: position of the code byte of the block being encoded */
+    uint16_t crc_policy; /**< bit n set: frames of type n (header >> 4) carry a CRC32, used only in KISS_CRC32_PER_FRAME mode */
     uint8_t frame_flag;
+    kiss_clock_fn clock; /**< optional millisecond clock (kiss_set_clock), NULL if not used */
+    const kiss_handler_t *handlers; /**< optional table of KISS_HANDLER_COUNT handlers indexed by frame type (kiss_set_handlers) */
+    uint16_t lzss_policy; /**< bit n set: the payload of the frames of type n is LZSS compressed by kiss_encode (kiss_set_lzss) */
+    uint8_t lzss_window; /**< LZSS window of 2^lzss_window bytes, KISS_LZSS_WINDOW_MIN to KISS_LZSS_WINDOW_MAX */
+    uint8_t *lzss_buffer; /**< optional buffer where kiss_dispatch expands the compressed frames (kiss_set_lzss_buffer), NULL if not used */
+    size_t lzss_buffer_size; /**< size of `lzss_buffer` in bytes */
+    uint16_t scramble_policy; /**< bit n set: the payload of the frames of type n is XOR scrambled with a key prefix (kiss_set_scramble) */
+    const kiss_channel_t *channel; /**< optional radio channel hooks (kiss_set_channel), NULL if the instance does not key a transmitter */
+    uint8_t persistence; /**< p-persistence, the channel is taken when a random byte is <= persistence */
+    uint8_t slot_time; /**< slot time in 10 ms units */
+    uint8_t TXtail; /**< time the transmitter stays up after the frame in 10 ms units */
+    uint8_t fullduplex; /**< 1: no channel access, the frames are sent right away */
+    uint32_t csma_seed; /**< state of the internal random generator of the channel access */
 };
 
 
@@ -184,11 +391,36 @@ struct kiss_instance_t
  *  @param write transport write callback.
  *  @param read transport read callback.
  *  @param context user-defined context passed to read/write callbacks.
+ *  @param padding number of FEND bytes sent before each frame (0 to KISS_MAX_PADDING).
+ *  @param crc32 KISS_CRC32_OFF, KISS_CRC32_ON or KISS_CRC32_PER_FRAME (any other non zero value means KISS_CRC32_ON),
+ *   ORed with KISS_FRAMING_COBS, KISS_FRAMING_SLIP, KISS_FRAMING_HDLC or KISS_FRAMING_DATAGRAM to use another framing instead of KISS.
 * @return Any number of errors or KISS_OK(0) if everything went ok
  */
 int32_t kiss_init(kiss_instance_t *const kiss, uint8_t *const buffer, size_t buffer_size, uint8_t TXdelay, kiss_write_fn write, kiss_read_fn read, void *const context, uint8_t padding, uint8_t crc32);
 
 
+/**
+ * @brief Choose whether frames of the same type as `header` carry a CRC32 when the instance is in KISS_CRC32_PER_FRAME mode.
+ * The policy is per frame type (header >> 4), e.g. all data ports share the same setting.
+ * @param kiss initialized instance
+ * @param header any header of the frame type to configure (e.g. KISS_HEADER_ACK)
+ * @param enable 1 to append a CRC32 to these frames, 0 to send them without
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_crc_policy(kiss_instance_t *const kiss, uint8_t header, uint8_t enable);
+
+
+
+/**
+ * @brief Set the millisecond clock used by the services with timeouts (tagged requests, etc..)
+ * @param kiss initialized instance
+ * @param clock clock callback, NULL to remove it
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_clock(kiss_instance_t *const kiss, kiss_clock_fn clock);
+
+
+
 /** 
  * @brief Encode `length` bytes from `data` into the instance working buffer.
  *  @param kiss initialized instance.
@@ -224,6 +456,19 @@ int32_t kiss_push_encode(kiss_instance_t *const kiss, const uint8_t *const data,
 int32_t kiss_decode(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header);
 
 
+
+/** 
+ * @brief Decode the frame stored in `kiss->buffer` in place, without copying the payload to another buffer.
+ * The payload stays valid until the instance encodes or receives another frame, and the frame cannot be decoded again.
+ *  @param kiss instance containing a received frame.
+ *  @param payload pointer set to the decoded payload inside `kiss->buffer`.
+ *  @param length pointer to receive the payload length.
+ *  @param header optional pointer to receive the KISS header byte (may be NULL).
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_decode_inplace(kiss_instance_t *const kiss, const uint8_t **const payload, size_t *const length, uint8_t *const header);
+
+
 /** 
 * @brief Send an encoded frame over the transport using the `write` callback.
 * @retval KISS_OK(0) on success 
@@ -263,12 +508,24 @@ int32_t kiss_encode_and_send(kiss_instance_t *const kiss, const uint8_t *const d
 * @retval KISS_ERR_INVALID_PARAMS for bad inputs
 * @retval KISS_ERR_INVALID_FRAME for bad escape sequences
 * @retval KISS_ERR_BUFFER_OVERFLOW if decoded data exceeds `kiss->buffer_size`
-* @retval KISS_ERR_NO_DATA_RECEIVED if no complete frame is received within maxAttempts
+* @retval KISS_ERR_NO_DATA_RECEIVED if no complete frame is received within maxAttempts. The part of a frame already received
+*  is kept and the next call goes on with it, unless the instance is used to encode a frame in between.
+*  With KISS_FRAMING_DATAGRAM every read that gives some bytes is a whole frame.
 */
 int32_t kiss_receive_frame(kiss_instance_t *const kiss, uint32_t maxAttempts);
 
 
 
+/**
+* @brief Byte that delimits the frames with the framing of the instance (KISS_FEND, KISS_COBS_DELIMITER or KISS_HDLC_FLAG),
+*  for the transports that split the received data in frames. KISS_FRAMING_DATAGRAM has no delimiter (KISS_FEND is returned).
+*  @param kiss initialized instance
+* @returns the delimiter byte
+*/
+uint8_t kiss_frame_delimiter(const kiss_instance_t *const kiss);
+
+
+
 /** 
 * @brief Receive a KISS frame and decode it into `output`.
 *  @param kiss instance with working buffer and `read` callback.
@@ -290,6 +547,62 @@ int32_t kiss_receive_and_decode(kiss_instance_t *const kiss, uint8_t *const outp
 
 
 
+/**
+ * @brief Set the handler table used by kiss_dispatch and kiss_poll.
+ * @param kiss initialized instance
+ * @param handlers array of KISS_HANDLER_COUNT handlers indexed by frame type (header >> 4), must remain valid. NULL to remove it.
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_handlers(kiss_instance_t *const kiss, const kiss_handler_t *const handlers);
+
+
+
+/**
+ * @brief Decode the received frame in place and call the handler of its frame type, one indirect call per frame.
+ * If there is no handler, or the handler gives the frame back, the decoded frame is returned to the caller.
+ * A KISS_HEADER_LZSS frame is expanded in the buffer set with kiss_set_lzss_buffer and dispatched with its original header,
+ * without that buffer it is returned to the caller still compressed (KISS_ERR_NOT_HANDLED) to be expanded with kiss_lzss_decompress.
+ * @param kiss instance with a received frame (KISS_STATUS_RECEIVED)
+ * @param payload optional pointer set to the decoded payload inside the instance buffer or the LZSS buffer (may be NULL)
+ * @param length optional pointer to receive the payload length (may be NULL)
+ * @param header optional pointer to receive the header (may be NULL)
+ * @retval KISS_OK the frame has been handled
+ * @retval KISS_ERR_NOT_HANDLED the frame has no handler, use payload, length and header to handle it
+ * @return the error of the handler or any other number of errors
+ */
+int32_t kiss_dispatch(kiss_instance_t *const kiss, const uint8_t **const payload, size_t *const length, uint8_t *const header);
+
+
+
+/**
+ * @brief Receive a frame and dispatch it (kiss_receive_frame followed by kiss_dispatch). Call it from the main loop.
+ * @param kiss initialized instance with a read callback
+ * @param maxAttempts maximum number of read attempts before giving up
+ * @param payload optional pointer set to the payload of a frame not handled (may be NULL)
+ * @param length optional pointer to receive the payload length (may be NULL)
+ * @param header optional pointer to receive the header (may be NULL)
+ * @retval KISS_OK a frame has been received and handled
+ * @retval KISS_ERR_NO_DATA_RECEIVED no frame received within maxAttempts
+ * @retval KISS_ERR_NOT_HANDLED a frame has been received but it has no handler
+ * @return Any other number of errors
+ */
+int32_t kiss_poll(kiss_instance_t *const kiss, uint32_t maxAttempts, const uint8_t **const payload, size_t *const length, uint8_t *const header);
+
+
+
+/**
+ * @brief Adapters with the kiss_frame_fn signature, to put the library services in the handler table.
+ * The user pointer of the entry is the service: kiss_registry_t, kiss_command_table_t, kiss_request_table_t or kiss_link_monitor_t.
+ * The registry and the request table share the slot of KISS_HEADER_REQUEST_PARAM: a node that uses both uses kiss_param_handler.
+ */
+int32_t kiss_registry_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+int32_t kiss_command_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+int32_t kiss_request_table_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+int32_t kiss_link_monitor_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+
 
 /**
 * @brief Set the TX delay on the KISS device by sending a control frame. The delay is specified in milliseconds (10ms to 2550ms).
@@ -341,6 +654,101 @@ int32_t kiss_send_ping(kiss_instance_t *const kiss);
 
 
 
+/**
+* @brief Answer a PING frame with an ACK carrying the same payload, so the other device can match it with its ping.
+* @param kiss initialized instance.
+* @param payload decoded payload of the PING frame (may be NULL if length is 0)
+* @param length payload length (at most KISS_PING_ECHO_MAX bytes)
+* @return Any number of errors or KISS_OK(0) if everything went ok
+*/
+int32_t kiss_send_ping_reply(kiss_instance_t *const kiss, const uint8_t *const payload, size_t length);
+
+
+
+
+/**
+ * @brief link quality estimated by the link monitor
+ */
+typedef struct
+{
+    uint32_t srtt_ms; /**< smoothed round trip time */
+    uint32_t jitter_ms; /**< smoothed mean deviation of the round trip time */
+    uint32_t rto_ms; /**< suggested retransmission timeout: srtt + 4 * jitter */
+    uint16_t loss_permille; /**< smoothed ping loss in 1/1000 */
+    uint32_t sent; /**< pings sent */
+    uint32_t received; /**< pings answered before the timeout */
+} kiss_link_stats_t;
+
+
+/**
+ * @brief link monitor, it sends a ping every interval and measures the ACK that comes back.
+ * RTT and jitter are smoothed as in RFC 6298 (gains 1/8 and 1/4), the loss with gain 1/8.
+ */
+typedef struct
+{
+    uint32_t interval_ms; /**< time between pings */
+    uint32_t timeout_ms; /**< time after which a ping is considered lost */
+    uint32_t sent_at; /**< clock value when the last ping was sent */
+    uint32_t srtt; /**< smoothed RTT in ms, scaled by 8 */
+    uint32_t rttvar; /**< RTT mean deviation in ms, scaled by 4 */
+    uint32_t loss; /**< smoothed loss, 0 to 65536 scaled by 8 */
+    uint32_t sent; /**< pings sent */
+    uint32_t received; /**< pings answered */
+    uint8_t seq; /**< sequence number of the last ping */
+    uint8_t outstanding; /**< 1 while waiting for the ACK of the last ping */
+    uint8_t started; /**< 1 after the first ping has been sent */
+} kiss_link_monitor_t;
+
+
+
+/**
+ * @brief Initialize a link monitor.
+ * @param monitor monitor to initialize
+ * @param interval_ms time between pings
+ * @param timeout_ms time after which a ping without ACK is counted as lost (not larger than interval_ms)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_link_monitor_init(kiss_link_monitor_t *const monitor, uint32_t interval_ms, uint32_t timeout_ms);
+
+
+
+/**
+ * @brief Send the pings when they are due and count the lost ones. Call it periodically, the instance clock must be set.
+ * The ping is a KISS_HEADER_PING frame with one sequence byte, so keep the instance buffer free when calling it.
+ * @param kiss initialized instance with a clock
+ * @param monitor link monitor
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_link_monitor_poll(kiss_instance_t *const kiss, kiss_link_monitor_t *const monitor);
+
+
+
+/**
+ * @brief Give a decoded frame to the link monitor. The ACK of the outstanding ping gives a new RTT sample
+ * and the PING frames of the other device are answered with kiss_send_ping_reply.
+ * @param kiss instance that received the frame
+ * @param monitor link monitor
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_OK the frame has been used by the monitor
+ * @retval KISS_ERR_NOT_HANDLED the frame is not for the monitor, the application must handle it
+ * @return Any other number of errors
+ */
+int32_t kiss_link_monitor_handle(kiss_instance_t *const kiss, kiss_link_monitor_t *const monitor, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Read the current link estimates.
+ * @param monitor link monitor
+ * @param stats pointer where the estimates are written
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_link_monitor_stats(const kiss_link_monitor_t *const monitor, kiss_link_stats_t *const stats);
+
+
+
 
 
 
@@ -367,6 +775,270 @@ int32_t kiss_request_param(kiss_instance_t *const kiss, uint16_t ID);
 
 
 
+/**
+ * @brief called when the response of a tagged request arrives or when the request times out
+ * @param kiss instance used for the request
+ * @param ID parameter ID requested
+ * @param status KISS_OK, KISS_ERR_TIMEOUT, or KISS_ERR_REMOTE if the other device answered with a non zero status
+ * @param value parameter value, or the status byte of the other device with KISS_ERR_REMOTE (e.g. KISS_ERR_UNKNOWN_PARAM),
+ *  NULL on timeout. Valid only during the call.
+ * @param length value length (1 with KISS_ERR_REMOTE)
+ * @param user user pointer given with the request
+ */
+typedef void (*kiss_param_cb)(kiss_instance_t *const kiss, uint16_t ID, int32_t status, const uint8_t *const value, size_t length, void *const user);
+
+
+/**
+ * @brief one outstanding tagged request
+ */
+typedef struct
+{
+    kiss_param_cb callback; /**< callback for the response or the timeout */
+    void *user; /**< user pointer passed to the callback */
+    uint32_t deadline; /**< clock value after which the request has timed out */
+    uint16_t ID; /**< parameter ID requested */
+    uint8_t tag; /**< tag sent with the request */
+    uint8_t in_use; /**< 1 if the request is waiting for the response */
+} kiss_request_t;
+
+
+/**
+ * @brief table of outstanding tagged requests, the slots are provided by the user.
+ * The number of slots is the number of requests that can be in flight at the same time.
+ */
+typedef struct
+{
+    kiss_request_t *slots; /**< user-provided array of slots */
+    uint8_t size; /**< number of slots */
+    uint8_t pending; /**< number of slots in use */
+    uint8_t next_tag; /**< next tag to use */
+} kiss_request_table_t;
+
+
+
+/**
+ * @brief Initialize a table of outstanding tagged requests.
+ * @param table table to initialize
+ * @param slots user-provided array of slots (must remain valid)
+ * @param size number of slots (1 to 255)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_request_table_init(kiss_request_table_t *const table, kiss_request_t *const slots, uint8_t size);
+
+
+
+/**
+ * @brief Send a tagged parameter request (KISS_HEADER_REQUEST_PARAM_TAG) without waiting for the response.
+ * Many requests can be in flight and the responses can arrive in any order. The instance clock must be set.
+ * @param kiss initialized instance with a clock
+ * @param table request table
+ * @param ID parameter ID to request
+ * @param timeout_ms time after which the callback is called with KISS_ERR_TIMEOUT
+ * @param callback function called with the response or the timeout
+ * @param user user pointer passed to the callback
+ * @retval KISS_ERR_TABLE_FULL if all the slots are waiting for a response
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_request_param_async(kiss_instance_t *const kiss, kiss_request_table_t *const table, uint16_t ID, uint32_t timeout_ms, kiss_param_cb callback, void *const user);
+
+
+
+/**
+ * @brief Give a decoded frame to the request table. If it is the response of an outstanding request the callback is called.
+ * Late responses (after the timeout) are silently dropped.
+ * @param kiss instance that received the frame
+ * @param table request table
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_OK the frame was a tagged response
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a tagged response, the application must handle it
+ * @return Any other number of errors
+ */
+int32_t kiss_request_table_handle(kiss_instance_t *const kiss, kiss_request_table_t *const table, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Call the callback with KISS_ERR_TIMEOUT for every request that has timed out. Call it periodically.
+ * @param kiss instance with a clock
+ * @param table request table
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_request_table_poll(kiss_instance_t *const kiss, kiss_request_table_t *const table);
+
+
+
+/**
+ * @brief Extract tag and ID from a decoded KISS_HEADER_REQUEST_PARAM_TAG frame (responder side).
+ * @param payload decoded payload
+ * @param length payload length
+ * @param tag pointer where the tag is written
+ * @param ID pointer where the parameter ID is written
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_extract_request_tag(const uint8_t *const payload, size_t length, uint8_t *const tag, uint16_t *const ID);
+
+
+
+/**
+ * @brief Send the response to a tagged request (KISS_HEADER_PARAM_RESPONSE_TAG).
+ * @param kiss initialized instance
+ * @param tag tag of the request
+ * @param ID parameter ID of the request
+ * @param status 0 if the value is valid, any other value tells the requester why there is no value (e.g. unknown ID)
+ * @param value parameter value (may be NULL if length is 0)
+ * @param length value length
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_send_param_response(kiss_instance_t *const kiss, uint8_t tag, uint16_t ID, uint8_t status, const uint8_t *const value, size_t length);
+
+
+
+
+
+/** Parameter access flags
+ * - KISS_PARAM_READ: the parameter can be requested by the other device.
+ * - KISS_PARAM_WRITE: the parameter can be set by the other device.
+ */
+#define KISS_PARAM_READ 0x01
+#define KISS_PARAM_WRITE 0x02
+#define KISS_PARAM_RW (KISS_PARAM_READ | KISS_PARAM_WRITE)
+
+
+/**
+ * @brief one parameter of the registry, it points directly to the variable of the application
+ */
+typedef struct
+{
+    uint16_t ID; /**< parameter ID */
+    uint8_t size; /**< size of the variable in bytes (1 to 254) */
+    uint8_t flags; /**< KISS_PARAM_READ, KISS_PARAM_WRITE or both */
+    void *value; /**< pointer to the variable, sent and written as it is in memory */
+} kiss_param_t;
+
+
+/**
+ * @brief parameter registry. The array of parameters is provided by the user and must be sorted by ID.
+ * If the IDs are consecutive the lookup is a direct index, otherwise a binary search.
+ */
+typedef struct
+{
+    const kiss_param_t *params; /**< user-provided array of parameters sorted by ID */
+    uint16_t count; /**< number of parameters */
+    uint8_t dense; /**< 1 if the IDs are consecutive */
+} kiss_registry_t;
+
+
+
+/**
+ * @brief Initialize a parameter registry.
+ * @param registry registry to initialize
+ * @param params array of parameters sorted by ID without duplicates (must remain valid)
+ * @param count number of parameters
+ * @retval KISS_ERR_INVALID_PARAMS if the array is not sorted or a size is not valid
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_registry_init(kiss_registry_t *const registry, const kiss_param_t *const params, uint16_t count);
+
+
+
+/**
+ * @brief Find a parameter in the registry.
+ * @param registry initialized registry
+ * @param ID parameter ID
+ * @returns the parameter or NULL if the ID is not in the registry
+ */
+const kiss_param_t *kiss_registry_find(const kiss_registry_t *const registry, uint16_t ID);
+
+
+
+/**
+ * @brief Answer a decoded parameter frame directly from the registry:
+ * - KISS_HEADER_REQUEST_PARAM: the value is sent back with the same header (ID followed by the value), NACK if unknown.
+ * - KISS_HEADER_REQUEST_PARAM_TAG: the value is sent with kiss_send_param_response, the status tells if it is unknown.
+ * - KISS_HEADER_SET_PARAM: the value is written in the variable and an ACK is sent, NACK if unknown, read only or wrong size.
+ * - KISS_HEADER_BATCH_GET: all the values are sent in as few KISS_HEADER_BATCH_RESPONSE frames as fit,
+ *   unknown or write only parameters are answered with length 0.
+ * - KISS_HEADER_BATCH_SET: if every item is valid all the values are written and an ACK is sent, otherwise nothing is written and a NACK is sent.
+ * @param kiss instance that received the frame
+ * @param registry initialized registry
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_OK the frame has been answered (with ACK, NACK or the value)
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a parameter frame, the application must handle it
+ * @return Any other number of errors
+ */
+int32_t kiss_registry_serve(kiss_instance_t *const kiss, const kiss_registry_t *const registry, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief registry and request table of one node, for the handler slot shared by the parameter frames.
+ */
+typedef struct
+{
+    const kiss_registry_t *registry; /**< served parameters, gets the requests and the KISS_HEADER_SET_PARAM frames (NULL if the node does not serve) */
+    kiss_request_table_t *requests; /**< pending requests, gets the KISS_HEADER_PARAM_RESPONSE_TAG frames (NULL if the node does not request) */
+} kiss_param_link_t;
+
+
+
+/**
+ * @brief Adapter with the kiss_frame_fn signature for a node that both serves and requests parameters,
+ *  the user pointer is the kiss_param_link_t. Put it in the slots of KISS_HEADER_REQUEST_PARAM and KISS_HEADER_SET_PARAM.
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a parameter frame, or its side is NULL
+ * @return the value returned by kiss_registry_serve or kiss_request_table_handle
+ */
+int32_t kiss_param_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+
+/**
+ * @brief Request many parameters with KISS_HEADER_BATCH_GET frames. The IDs are packed in as few frames as fit
+ * in the instance buffer and the frames are sent one after the other.
+ * The answers arrive in KISS_HEADER_BATCH_RESPONSE frames, read them with kiss_batch_next.
+ * @param kiss initialized instance
+ * @param IDs parameter IDs to request
+ * @param count number of IDs
+ * @param frames optional pointer where the number of frames sent is written (may be NULL)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_batch_get(kiss_instance_t *const kiss, const uint16_t *const IDs, size_t count, size_t *const frames);
+
+
+
+/**
+ * @brief Set many parameters with KISS_HEADER_BATCH_SET frames. The values are packed in as few frames as fit
+ * in the instance buffer, the other device answers every frame with ACK or NACK.
+ * @param kiss initialized instance
+ * @param params parameters to send (ID, size and pointer to the value, the flags are not used)
+ * @param count number of parameters
+ * @param frames optional pointer where the number of frames sent (ACKs to expect) is written (may be NULL)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_batch_set(kiss_instance_t *const kiss, const kiss_param_t *const params, size_t count, size_t *const frames);
+
+
+
+/**
+ * @brief Read the next (ID, length, value) item of a decoded KISS_HEADER_BATCH_RESPONSE, KISS_HEADER_BATCH_SET or KISS_HEADER_TELEMETRY frame.
+ * Start with offset 0 and call it while offset < length. A length of 0 in a response means the parameter could not be read.
+ * @param payload decoded payload
+ * @param length payload length
+ * @param offset position of the next item, updated after the call
+ * @param ID pointer where the parameter ID is written
+ * @param value pointer set to the value inside the payload
+ * @param value_length pointer where the value length is written
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_batch_next(const uint8_t *const payload, size_t length, size_t *const offset, uint16_t *const ID, const uint8_t **const value, uint8_t *const value_length);
+
+
+
+
 /**
  * @brief Send a command to the other device. The command is a 2 bytes value.
  * @param kiss: initialized instance
@@ -378,6 +1050,1166 @@ int32_t kiss_send_command(kiss_instance_t *const kiss, uint16_t command);
 
 
 
+/**
+ * @brief one command already executed by the receiver
+ */
+typedef struct
+{
+    uint16_t command; /**< command ID */
+    uint8_t seq; /**< sequence number used by the sender */
+} kiss_dedup_entry_t;
+
+
+/**
+ * @brief receiver-side cache of the last commands executed, used to recognise retransmissions.
+ * The entries are provided by the user (static or dynamic memory) and are overwritten in a ring.
+ */
+typedef struct
+{
+    kiss_dedup_entry_t *entries; /**< user-provided array of entries */
+    uint8_t size; /**< number of entries in `entries` */
+    uint8_t count; /**< number of valid entries */
+    uint8_t next; /**< next entry to overwrite */
+} kiss_dedup_t;
+
+
+
+/**
+ * @brief Initialize a duplicate suppression cache.
+ * @param dedup cache to initialize
+ * @param entries user-provided array of entries (must remain valid)
+ * @param size number of entries, a few entries are enough (the sender has only a few commands waiting for ACK)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_dedup_init(kiss_dedup_t *const dedup, kiss_dedup_entry_t *const entries, uint8_t size);
+
+
+
+/**
+ * @brief Send a command with a sequence number (header KISS_HEADER_COMMAND_SEQ). Use a new sequence number
+ * for every new command and the same one when retransmitting it, so the receiver executes it only once.
+ * @param kiss initialized instance
+ * @param command 2 bytes command to send
+ * @param seq sequence number of the command
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_send_command_seq(kiss_instance_t *const kiss, uint16_t command, uint8_t seq);
+
+
+
+/**
+ * @brief Extract the command from a decoded KISS_HEADER_COMMAND_SEQ frame and check it against the cache.
+ * The cache is not modified: call kiss_dedup_record after the command has been executed successfully,
+ * so a command that failed is executed again when it is retransmitted. A duplicate must be ACKed again but not executed.
+ * The sequence number is payload[2]: keep a copy before executing the command if its answer reuses the buffer.
+ * @param dedup initialized cache
+ * @param payload decoded payload of the frame
+ * @param length payload length
+ * @param command pointer where the command ID is written
+ * @retval KISS_OK the command is new and must be executed
+ * @retval KISS_ERR_DUPLICATE the command has already been executed
+ * @retval KISS_ERR_INVALID_PARAMS / KISS_ERR_INVALID_FRAME for bad inputs
+ */
+int32_t kiss_extract_command_seq(kiss_dedup_t *const dedup, const uint8_t *const payload, size_t length, uint16_t *const command);
+
+
+
+/**
+ * @brief Record a KISS_HEADER_COMMAND_SEQ command in the cache after it has been executed successfully,
+ * overwriting the oldest entry when the cache is full.
+ * @param dedup initialized cache
+ * @param command command ID returned by kiss_extract_command_seq
+ * @param seq sequence number of the frame (payload[2])
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_dedup_record(kiss_dedup_t *const dedup, uint16_t command, uint8_t seq);
+
+
+
+
+
+/**
+ * @brief command handler
+ * @param kiss instance that received the command
+ * @param command command ID
+ * @param args bytes after the command ID (NULL if none), valid until the handler encodes a frame on the instance
+ * @param length number of bytes in args
+ * @param user user pointer of the command
+ * @retval KISS_OK if the command has been executed
+ * @retval Any other number if the command failed
+ */
+typedef int32_t (*kiss_command_fn)(kiss_instance_t *const kiss, uint16_t command, const uint8_t *const args, size_t length, void *const user);
+
+
+/**
+ * @brief one command of the dispatch table
+ */
+typedef struct
+{
+    uint16_t command; /**< command ID */
+    kiss_command_fn handler; /**< function executing the command */
+    void *user; /**< user pointer passed to the handler */
+} kiss_command_t;
+
+
+/**
+ * @brief command dispatch table. The array of commands is provided by the user and must be sorted by command ID.
+ */
+typedef struct
+{
+    const kiss_command_t *commands; /**< user-provided array of commands sorted by ID */
+    uint16_t count; /**< number of commands */
+    uint8_t auto_ack; /**< 1 to answer ACK when the handler succeeds and NACK when it fails */
+    kiss_dedup_t *dedup; /**< optional duplicate cache for KISS_HEADER_COMMAND_SEQ frames (may be NULL) */
+} kiss_command_table_t;
+
+
+
+/**
+ * @brief Initialize a command dispatch table.
+ * @param table table to initialize
+ * @param commands array of commands sorted by ID without duplicates (must remain valid)
+ * @param count number of commands
+ * @param auto_ack 1 to ACK the commands executed and NACK the failed ones, 0 to leave the answer to the handlers
+ * @param dedup optional duplicate cache used for KISS_HEADER_COMMAND_SEQ frames (may be NULL)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_command_table_init(kiss_command_table_t *const table, const kiss_command_t *const commands, uint16_t count, uint8_t auto_ack, kiss_dedup_t *const dedup);
+
+
+
+/**
+ * @brief Execute the command of a decoded KISS_HEADER_COMMAND or KISS_HEADER_COMMAND_SEQ frame.
+ * Unknown commands are always NACKed. With a dedup cache only the commands executed successfully are recorded,
+ * their duplicates are not executed again (and are ACKed with auto_ack), failed commands are executed again when retransmitted.
+ * It can be used with kiss_decode_inplace so the command goes from the receive buffer to the handler without copies.
+ * @param kiss instance that received the frame
+ * @param table initialized command table
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_OK the command has been executed (or was a duplicate ACKed again with auto_ack)
+ * @retval KISS_ERR_DUPLICATE the command has already been executed, without auto_ack the application answers it
+ * @retval KISS_ERR_UNKNOWN_COMMAND the command is not in the table (a NACK has been sent)
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a command, the application must handle it
+ * @return the error of the handler or any other number of errors
+ */
+int32_t kiss_command_dispatch(kiss_instance_t *const kiss, const kiss_command_table_t *const table, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+
+/* types of the schema fields, signed and unsigned integers are serialized in the same way */
+#define KISS_FIELD_U8 0
+#define KISS_FIELD_I8 1
+#define KISS_FIELD_U16 2
+#define KISS_FIELD_I16 3
+#define KISS_FIELD_U32 4
+#define KISS_FIELD_I32 5
+#define KISS_FIELD_U64 6
+#define KISS_FIELD_I64 7
+#define KISS_FIELD_F32 8
+#define KISS_FIELD_F64 9 /* only where double is 8 bytes (not on AVR) */
+
+/* byte order of a field on the link */
+#define KISS_FIELD_LE 0
+#define KISS_FIELD_BE 1
+
+/* descriptor of the member `member` of the structure `type` */
+#define KISS_FIELD(type, member, field_type, endian) {(uint16_t)offsetof(type, member), (field_type), (endian), 1}
+/* descriptor of the array member `member` of `count` elements */
+#define KISS_FIELD_ARRAY(type, member, field_type, endian, count) {(uint16_t)offsetof(type, member), (field_type), (endian), (count)}
+
+
+/**
+ * @brief one field of a schema
+ */
+typedef struct
+{
+    uint16_t offset; /**< offset of the member inside the structure (offsetof) */
+    uint8_t type; /**< KISS_FIELD_* type of one element */
+    uint8_t endian; /**< KISS_FIELD_LE or KISS_FIELD_BE */
+    uint8_t count; /**< number of elements, 1 for a scalar member */
+} kiss_field_t;
+
+
+/**
+ * @brief schema of a structure sent as frame payload. The fields are serialized in the order of the array.
+ */
+typedef struct
+{
+    const kiss_field_t *fields; /**< user-provided array of fields */
+    uint8_t count; /**< number of fields */
+    size_t size; /**< payload bytes of a serialized structure (set by kiss_schema_init) */
+} kiss_schema_t;
+
+
+
+/**
+ * @brief Initialize a schema and compute the size of the serialized payload.
+ * @param schema schema to initialize
+ * @param fields array of fields (must remain valid)
+ * @param count number of fields
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_schema_init(kiss_schema_t *const schema, const kiss_field_t *const fields, uint8_t count);
+
+
+
+/**
+ * @brief Encode a frame with the fields of a structure serialized directly in the instance buffer (no packing buffer).
+ *  The frame is sent with kiss_send_frame as the ones made by kiss_encode.
+ * @param kiss initialized instance
+ * @param schema initialized schema of the structure
+ * @param data structure to serialize
+ * @param header KISS header byte to use
+ * @retval KISS_ERR_INVALID_PARAMS also when the frames of the header type are scrambled (kiss_set_scramble)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_encode_struct(kiss_instance_t *const kiss, const kiss_schema_t *const schema, const void *const data, uint8_t header);
+
+
+
+/**
+ * @brief Write the fields of a decoded payload directly in a structure.
+ * @param schema initialized schema of the structure
+ * @param payload decoded payload
+ * @param length payload length, must be the size of the schema
+ * @param data structure to fill
+ * @retval KISS_ERR_INVALID_FRAME if the payload length is not the size of the schema
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_decode_struct(const kiss_schema_t *const schema, const uint8_t *const payload, size_t length, void *const data);
+
+
+
+
+/* longest history of a delta stream, the receiver marks the valid snapshots in a 32 bit mask */
+#define KISS_DELTA_MAX_DEPTH 32
+
+
+/**
+ * @brief sender side of a delta compressed stream of structures.
+ * The snapshots sent and not acknowledged yet are kept in a ring indexed by sequence number, so the acknowledges
+ * can arrive after the next frames have been sent (round trip longer than the send period).
+ */
+typedef struct
+{
+    const kiss_schema_t *schema; /**< schema of the structure */
+    uint8_t *ref; /**< serialized structure acknowledged by the receiver, the deltas are computed against it */
+    uint8_t *history; /**< ring of depth serialized structures sent last, slot seq % depth */
+    uint8_t depth; /**< number of slots of history */
+    uint8_t filled; /**< slots of history holding one of the last frames sent */
+    uint8_t ref_seq; /**< sequence number of ref */
+    uint8_t seq; /**< next sequence number */
+    uint8_t has_ref; /**< 1 when ref is valid */
+    uint8_t key_interval; /**< a keyframe is sent every key_interval frames (0 = only when needed) */
+    uint8_t since_key; /**< frames sent since the last keyframe */
+} kiss_delta_tx_t;
+
+
+/**
+ * @brief receiver side of a delta compressed stream of structures.
+ * The last structures decoded are kept in a ring indexed by sequence number, any of them can be the reference of the sender.
+ */
+typedef struct
+{
+    const kiss_schema_t *schema; /**< schema of the structure */
+    void *data; /**< structure written with the decoded values */
+    uint8_t *history; /**< ring of depth serialized structures decoded last, slot seq % depth */
+    uint8_t depth; /**< number of slots of history */
+    uint8_t last_seq; /**< sequence number of the newest structure */
+    uint32_t valid; /**< bit k set when the structure last_seq - k is in history */
+} kiss_delta_rx_t;
+
+
+
+/**
+ * @brief Initialize the sender of a delta compressed stream.
+ * @param tx sender to initialize
+ * @param schema initialized schema of the structure (must remain valid)
+ * @param ref user buffer of schema->size bytes
+ * @param history user buffer of depth * schema->size bytes
+ * @param depth frames that can wait for the acknowledge, a power of two up to KISS_DELTA_MAX_DEPTH (the same of the receiver).
+ *  When no acknowledge arrives for depth frames a keyframe is sent.
+ * @param key_interval a keyframe is sent every key_interval frames to resynchronize the receiver (0 = only when needed)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_delta_tx_init(kiss_delta_tx_t *const tx, const kiss_schema_t *const schema, uint8_t *const ref, uint8_t *const history, uint8_t depth, uint8_t key_interval);
+
+
+
+/**
+ * @brief Encode and send a structure of the stream.
+ *  It is a KISS_HEADER_DELTA_KEY frame [seq][fields as kiss_encode_struct] when there is no acknowledged reference or the keyframe is due,
+ *  otherwise a KISS_HEADER_DELTA frame [seq][ref seq][one zig-zag varint per element] with the difference from the reference.
+ * @param kiss initialized instance
+ * @param tx initialized sender
+ * @param data structure to send
+ * @retval KISS_ERR_INVALID_PARAMS also when the delta frames are scrambled (kiss_set_scramble)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_delta_send(kiss_instance_t *const kiss, kiss_delta_tx_t *const tx, const void *const data);
+
+
+
+/**
+ * @brief Handle the KISS_HEADER_DELTA_ACK and KISS_HEADER_DELTA_NACK frames of the receiver.
+ *  An acknowledged structure becomes the reference, a NACK makes the next frame a keyframe.
+ * @param kiss initialized instance
+ * @param tx initialized sender
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a delta ACK or NACK
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_delta_tx_handle(kiss_instance_t *const kiss, kiss_delta_tx_t *const tx, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Initialize the receiver of a delta compressed stream.
+ * @param rx receiver to initialize
+ * @param schema initialized schema of the structure (must remain valid)
+ * @param data structure written with the received values
+ * @param history user buffer of depth * schema->size bytes
+ * @param depth structures kept as possible references, a power of two up to KISS_DELTA_MAX_DEPTH (the same of the sender)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_delta_rx_init(kiss_delta_rx_t *const rx, const kiss_schema_t *const schema, void *const data, uint8_t *const history, uint8_t depth);
+
+
+
+/**
+ * @brief Handle the keyframes and delta frames of the stream: the structure is written and the frame acknowledged with [seq].
+ * @param kiss initialized instance
+ * @param rx initialized receiver
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_OK the structure has been updated
+ * @retval KISS_ERR_NOT_HANDLED the frame is not part of a delta stream
+ * @retval KISS_ERR_INVALID_FRAME malformed or old frame, or reference not known (a KISS_HEADER_DELTA_NACK asks the sender for a keyframe)
+ * @return Any other number of errors
+ */
+int32_t kiss_delta_rx_handle(kiss_instance_t *const kiss, kiss_delta_rx_t *const rx, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Adapters with the kiss_frame_fn signature, the user pointer is the kiss_delta_tx_t or kiss_delta_rx_t.
+ *  All the delta frames have the same handler slot, so they fit a node that only sends or only receives.
+ */
+int32_t kiss_delta_tx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+int32_t kiss_delta_rx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+/**
+ * @brief sender and receiver of the delta streams of one node, for the handler slot shared by their frames.
+ */
+typedef struct
+{
+    kiss_delta_tx_t *tx; /**< sender, gets the KISS_HEADER_DELTA_ACK and KISS_HEADER_DELTA_NACK frames (NULL if the node does not send) */
+    kiss_delta_rx_t *rx; /**< receiver, gets the KISS_HEADER_DELTA_KEY and KISS_HEADER_DELTA frames (NULL if the node does not receive) */
+} kiss_delta_link_t;
+
+
+
+/**
+ * @brief Adapter with the kiss_frame_fn signature for a node that both sends and receives a delta stream,
+ *  the user pointer is the kiss_delta_link_t. Each frame goes to kiss_delta_tx_handle or kiss_delta_rx_handle by its header.
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a delta frame, or its side is NULL
+ * @return the value returned by kiss_delta_tx_handle or kiss_delta_rx_handle
+ */
+int32_t kiss_delta_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+
+/**
+ * @brief Enable or disable the LZSS compression of the frames of one type (header >> 4).
+ *  kiss_encode sends these frames as KISS_HEADER_LZSS [original header][window bits][bit stream] when it makes them shorter,
+ *  kiss_decode expands them and gives back the original header. kiss_push_encode cannot add data to a compressed frame.
+ * @param kiss initialized instance
+ * @param header any header of the type
+ * @param enable 1 to compress, 0 to send the payload as it is
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_lzss(kiss_instance_t *const kiss, uint8_t header, uint8_t enable);
+
+
+
+/**
+ * @brief Set the LZSS window of the compressor. A bigger window finds more matches but the search takes longer.
+ *  The receiver reads the window from the frame, it does not need the same setting.
+ * @param kiss initialized instance
+ * @param window_bits window of 2^window_bits bytes, KISS_LZSS_WINDOW_MIN to KISS_LZSS_WINDOW_MAX
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_lzss_window(kiss_instance_t *const kiss, uint8_t window_bits);
+
+
+
+/**
+ * @brief Set the buffer where kiss_dispatch and kiss_poll expand the KISS_HEADER_LZSS frames before calling the handler
+ *  of the original header. The payload given to the handler stays valid until the next frame is dispatched.
+ * @param kiss initialized instance
+ * @param buffer buffer as big as the longest original payload (must remain valid), NULL to remove it
+ * @param size size of buffer
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_lzss_buffer(kiss_instance_t *const kiss, uint8_t *const buffer, size_t size);
+
+
+
+/**
+ * @brief Expand the payload of a KISS_HEADER_LZSS frame decoded with kiss_decode_inplace (kiss_decode does it by itself).
+ * @param payload decoded payload of the KISS_HEADER_LZSS frame
+ * @param length payload length
+ * @param output buffer for the original payload (it must not overlap the payload)
+ * @param output_max_size size of output
+ * @param output_length pointer to receive the original payload length
+ * @param header optional pointer to receive the original header (may be NULL)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_lzss_decompress(const uint8_t *const payload, size_t length, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header);
+
+
+
+
+/**
+ * @brief Enable or disable the scrambling of the frames of one type (header >> 4), it must be set in the same way on both sides.
+ *  kiss_encode picks the XOR key that leaves the fewest FEND/FESC bytes in the payload and sends it as first payload byte,
+ *  kiss_decode removes it. The escaping overhead goes from up to 2x to almost nothing for payloads dense in 0xC0/0xDB.
+ *  The LZSS compressed frames are not scrambled. kiss_push_encode, kiss_encode_struct, kiss_delta_send and kiss_ax25_send
+ *  write the payload in pieces and return KISS_ERR_INVALID_PARAMS for a scrambled type.
+ * @param kiss initialized instance
+ * @param header any header of the type
+ * @param enable 1 to scramble, 0 to send the payload as it is
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_scramble(kiss_instance_t *const kiss, uint8_t header, uint8_t enable);
+
+
+
+
+/**
+ * @brief Forward the data frame received on one instance to another instance, converting between KISS and SLIP framing
+ *  without decoding it: both use the same FEND/FESC escaping, so only the header byte is removed or added and the
+ *  escaped payload is written straight from the receive buffer of `from` (two write calls at most, plus padding).
+ *  Both instances must use KISS_FRAMING_KISS or KISS_FRAMING_SLIP with KISS_CRC32_OFF, scrambled payloads pass through unchanged.
+ *  The frame is consumed: the receive buffer of `from` is modified and its status goes back to KISS_STATUS_NOTHING.
+ * @param from instance with a frame received by kiss_receive_frame
+ * @param to instance used to write the frame, its buffer is not used
+ * @param port port of the header written when `to` uses KISS framing
+ * @return KISS_ERR_NOT_HANDLED if the KISS frame is not a data frame (it is left in `from` to be decoded),
+ *  any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_gateway_forward(kiss_instance_t *const from, kiss_instance_t *const to, uint8_t port);
+
+
+
+
+
+/* bytes added to the data of a chunk: [ID][offset] before it and the chunk CRC32 after it */
+#define KISS_BLOB_CHUNK_OVERHEAD 10
+/* consecutive timeouts without progress before the sender gives up (kiss_blob_tx_resume restarts it) */
+#define KISS_BLOB_MAX_RETRIES 5
+
+/* state of a blob sender or receiver */
+#define KISS_BLOB_IDLE 0x00      // nothing to transfer
+#define KISS_BLOB_OFFERED 0x01   // offer sent, waiting for the offset of the receiver
+#define KISS_BLOB_ACTIVE 0x02    // chunks are being transferred
+#define KISS_BLOB_DONE 0x03      // whole object transferred and its CRC32 verified
+#define KISS_BLOB_FAILED 0x04    // whole object CRC32 mismatch
+#define KISS_BLOB_STALLED 0x05   // no progress after KISS_BLOB_MAX_RETRIES timeouts
+
+/* status byte of a KISS_HEADER_BLOB_ACK frame */
+#define KISS_BLOB_ACK_PROGRESS 0x00
+#define KISS_BLOB_ACK_DONE 0x01
+#define KISS_BLOB_ACK_CRC_ERROR 0x02
+
+
+/**
+ * @brief read part of the object to send (e.g. from flash)
+ * @param user user pointer given to kiss_blob_tx_init
+ * @param offset offset of the first byte in the object
+ * @param data buffer to fill
+ * @param length number of bytes to read
+ * @return KISS_OK or an error that stops the transfer function
+ */
+typedef int32_t (*kiss_blob_read_fn)(void *const user, uint32_t offset, uint8_t *const data, size_t length);
+
+/**
+ * @brief store part of the received object, the chunks arrive in order and only once
+ * @param user user pointer given to kiss_blob_rx_init
+ * @param offset offset of the first byte in the object
+ * @param data received bytes
+ * @param length number of bytes
+ * @return KISS_OK or an error (the chunk is not acknowledged and it will be sent again)
+ */
+typedef int32_t (*kiss_blob_write_fn)(void *const user, uint32_t offset, const uint8_t *const data, size_t length);
+
+
+/**
+ * @brief sender side of a blob transfer.
+ * Go-back-N: up to `window` chunks are sent ahead of the acknowledged offset, after a timeout or a duplicate
+ * acknowledge the sender starts again from the acknowledged offset.
+ */
+typedef struct
+{
+    kiss_blob_read_fn read; /**< callback reading the object */
+    void *user; /**< user pointer of the read callback */
+    uint8_t *chunk; /**< user buffer of chunk_size + KISS_BLOB_CHUNK_OVERHEAD bytes */
+    uint16_t chunk_size; /**< data bytes per chunk */
+    uint8_t window; /**< chunks sent without acknowledge */
+    uint32_t timeout_ms; /**< time without progress before going back to the acknowledged offset */
+    uint16_t ID; /**< identifier of the object */
+    uint32_t size; /**< size of the object */
+    uint32_t crc; /**< CRC32 of the whole object */
+    uint32_t base; /**< offset acknowledged by the receiver */
+    uint32_t next; /**< offset of the next chunk to send */
+    uint32_t deadline; /**< clock value of the next timeout */
+    uint8_t state; /**< KISS_BLOB_IDLE, KISS_BLOB_OFFERED, ... */
+    uint8_t retries; /**< consecutive timeouts */
+    uint8_t rewound; /**< 1 after going back on a duplicate acknowledge, until base moves */
+} kiss_blob_tx_t;
+
+
+/**
+ * @brief receiver side of a blob transfer.
+ * The state is kept after a link drop, an offer of the same object resumes from the received offset.
+ */
+typedef struct
+{
+    kiss_blob_write_fn write; /**< callback storing the object */
+    void *user; /**< user pointer of the write callback */
+    uint16_t ID; /**< identifier of the object */
+    uint32_t size; /**< size of the object */
+    uint32_t crc; /**< CRC32 of the whole object given by the sender */
+    uint32_t running; /**< CRC32 of the bytes received so far */
+    uint32_t offset; /**< bytes received so far */
+    uint8_t state; /**< KISS_BLOB_IDLE, KISS_BLOB_ACTIVE, KISS_BLOB_DONE or KISS_BLOB_FAILED */
+} kiss_blob_rx_t;
+
+
+
+/**
+ * @brief Initialize a blob sender.
+ * @param tx sender to initialize
+ * @param read callback reading the object
+ * @param user user pointer of the read callback
+ * @param chunk user buffer of chunk_size + KISS_BLOB_CHUNK_OVERHEAD bytes (the frame must fit in the kiss buffer too)
+ * @param chunk_size data bytes per chunk
+ * @param window chunks sent without acknowledge (1 = stop and wait)
+ * @param timeout_ms time without progress before sending again from the acknowledged offset
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_blob_tx_init(kiss_blob_tx_t *const tx, kiss_blob_read_fn read, void *const user, uint8_t *const chunk, uint16_t chunk_size, uint8_t window, uint32_t timeout_ms);
+
+
+
+/**
+ * @brief Start the transfer of an object: its CRC32 is computed (reading it once) and a
+ *  KISS_HEADER_BLOB_OFFER frame [ID][size][CRC32] is sent. The instance needs a clock (kiss_set_clock).
+ * @param kiss initialized instance
+ * @param tx initialized sender
+ * @param ID identifier of the object, an offer with the same ID, size and CRC32 resumes the transfer on the receiver
+ * @param size size of the object
+ * @retval KISS_ERR_STATUS another transfer is in progress
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_blob_tx_start(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx, uint16_t ID, uint32_t size);
+
+
+
+/**
+ * @brief Resume a transfer after a link drop: the offer is sent again and the receiver answers with the offset it has.
+ * @param kiss initialized instance
+ * @param tx sender with a transfer not finished
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_blob_tx_resume(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx);
+
+
+
+/**
+ * @brief Send the chunks allowed by the window as KISS_HEADER_BLOB_CHUNK frames [ID][offset][data][CRC32 of the previous bytes]
+ *  and handle the timeouts. Call it periodically, the transfer is over when tx->state is KISS_BLOB_DONE or KISS_BLOB_FAILED.
+ * @param kiss initialized instance
+ * @param tx initialized sender
+ * @retval KISS_ERR_TIMEOUT no progress after KISS_BLOB_MAX_RETRIES timeouts, the state is KISS_BLOB_STALLED
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_blob_tx_poll(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx);
+
+
+
+/**
+ * @brief Handle the KISS_HEADER_BLOB_ACK frames [ID][next offset][status] of the receiver.
+ * @param kiss initialized instance
+ * @param tx initialized sender
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a blob acknowledge
+ * @retval KISS_ERR_CRC32_MISMATCH the receiver got the whole object with a different CRC32, the state is KISS_BLOB_FAILED
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_blob_tx_handle(kiss_instance_t *const kiss, kiss_blob_tx_t *const tx, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Initialize a blob receiver.
+ * @param rx receiver to initialize
+ * @param write callback storing the object
+ * @param user user pointer of the write callback
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_blob_rx_init(kiss_blob_rx_t *const rx, kiss_blob_write_fn write, void *const user);
+
+
+
+/**
+ * @brief Handle the offers and chunks of the sender, every offer and chunk is answered with the offset received so far.
+ *  The object is complete when rx->state is KISS_BLOB_DONE.
+ * @param kiss initialized instance
+ * @param rx initialized receiver
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a blob offer or chunk
+ * @retval KISS_ERR_CRC32_MISMATCH the chunk is corrupted, it is dropped
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_blob_rx_handle(kiss_instance_t *const kiss, kiss_blob_rx_t *const rx, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Adapters with the kiss_frame_fn signature, the user pointer is the kiss_blob_tx_t or kiss_blob_rx_t.
+ *  All the blob frames have the same handler slot, so they fit a node that only sends or only receives.
+ */
+int32_t kiss_blob_tx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+int32_t kiss_blob_rx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+/**
+ * @brief sender and receiver of the blob transfers of one node, for the handler slot shared by their frames.
+ */
+typedef struct
+{
+    kiss_blob_tx_t *tx; /**< sender, gets the KISS_HEADER_BLOB_ACK frames (NULL if the node does not send) */
+    kiss_blob_rx_t *rx; /**< receiver, gets the KISS_HEADER_BLOB_OFFER and KISS_HEADER_BLOB_CHUNK frames (NULL if the node does not receive) */
+} kiss_blob_link_t;
+
+
+
+/**
+ * @brief Adapter with the kiss_frame_fn signature for a node that both sends and receives blobs,
+ *  the user pointer is the kiss_blob_link_t. Each frame goes to kiss_blob_tx_handle or kiss_blob_rx_handle by its header.
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a blob frame, or its side is NULL
+ * @return the value returned by kiss_blob_tx_handle or kiss_blob_rx_handle
+ */
+int32_t kiss_blob_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+
+
+/**
+ * @brief called by the scheduler right before the value of a due item is packed, to refresh the variable (e.g. read a sensor)
+ * @param kiss instance sending the telemetry
+ * @param ID identifier of the item
+ * @param user user pointer given to kiss_scheduler_init
+ * @return KISS_OK to send the value, any error to skip it until the next period
+ */
+typedef int32_t (*kiss_sample_fn)(kiss_instance_t *const kiss, uint16_t ID, void *const user);
+
+
+/**
+ * @brief one periodic telemetry item, it points directly to the variable of the application
+ */
+typedef struct
+{
+    uint16_t ID; /**< identifier sent with the value */
+    uint8_t size; /**< size of the variable in bytes (1 to 255) */
+    uint8_t priority; /**< 0 is the highest, the items of higher priority go first when the frames are limited */
+    uint32_t period_ms; /**< sending period, the items with the same period are sent together */
+    const void *value; /**< pointer to the variable, sent as it is in memory */
+    uint32_t due; /**< clock value of the next sending, managed by the scheduler */
+} kiss_telemetry_t;
+
+
+/**
+ * @brief telemetry scheduler. The array of items is provided by the user and must be sorted by priority.
+ */
+typedef struct
+{
+    kiss_telemetry_t *items; /**< user-provided array of items sorted by priority */
+    uint8_t count; /**< number of items */
+    uint8_t started; /**< 0 until the first poll, which makes every item due */
+    kiss_sample_fn sample; /**< optional callback refreshing the variables, NULL if not used */
+    void *user; /**< user pointer of the sample callback */
+} kiss_scheduler_t;
+
+
+
+/**
+ * @brief Initialize a telemetry scheduler.
+ * @param sched scheduler to initialize
+ * @param items array of items sorted by priority (must remain valid, the scheduler writes the due field)
+ * @param count number of items
+ * @param sample optional callback called before packing a value (may be NULL)
+ * @param user user pointer of the sample callback
+ * @retval KISS_ERR_INVALID_PARAMS if the array is not sorted or a size or period is 0
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_scheduler_init(kiss_scheduler_t *const sched, kiss_telemetry_t *const items, uint8_t count, kiss_sample_fn sample, void *const user);
+
+
+
+/**
+ * @brief Send the items that are due in as few KISS_HEADER_TELEMETRY frames [ID][length][value]... as fit in the instance buffer,
+ *  in order of priority. Call it periodically, the instance needs a clock (kiss_set_clock). Read the frames with kiss_batch_next.
+ *  A period that has been missed entirely is not sent twice.
+ * @param kiss initialized instance
+ * @param sched initialized scheduler
+ * @param max_frames maximum number of frames sent by this call (0 = no limit), the items left out stay due for the next call
+ * @param frames optional pointer where the number of frames sent is written (may be NULL)
+ * @retval KISS_ERR_BUFFER_OVERFLOW an item does not fit in a frame of the instance buffer: it has been skipped for this period,
+ *  the other items have been sent
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_scheduler_poll(kiss_instance_t *const kiss, kiss_scheduler_t *const sched, size_t max_frames, size_t *const frames);
+
+
+
+
+
+/**
+ * @brief Encode a standard KISS frame (KISS_STD_HEADER(port, command) or KISS_STD_RETURN) to be sent to a TNC.
+ *  The frame has no CRC32 and it is not compressed or scrambled, the instance must use KISS framing.
+ * @param kiss initialized instance
+ * @param header standard command byte
+ * @param data payload (frame data or command value), may be NULL if length is 0
+ * @param length payload length
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_std_encode(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const data, size_t length);
+
+
+
+/**
+ * @brief kiss_std_encode followed by kiss_send_frame.
+ * @param kiss initialized instance
+ * @param header standard command byte
+ * @param data payload (frame data or command value), may be NULL if length is 0
+ * @param length payload length
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_std_send(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const data, size_t length);
+
+
+
+/**
+ * @brief Decode a received standard KISS frame: only the escaping is removed, the command byte is given as it is.
+ * @param kiss instance with a received frame
+ * @param output buffer for the payload (may be the instance buffer)
+ * @param output_max_size size of output
+ * @param output_length pointer where the payload length is written
+ * @param header pointer where the standard command byte is written
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_std_decode(kiss_instance_t *const kiss, uint8_t *const output, size_t output_max_size, size_t *const output_length, uint8_t *const header);
+
+
+
+/**
+ * @brief Apply a standard KISS command received from the host to the instance (TNC side):
+ *  TXDELAY, PERSISTENCE, SLOTTIME, TXTAIL and FULLDUPLEX change the channel access of kiss_send_frame,
+ *  SETHARDWARE goes to the set_hardware hook and RETURN sets kiss->frame_flag to KISS_FLAG_RETURN.
+ *  The parameters are the same for every port.
+ * @param kiss initialized instance
+ * @param header standard command byte
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_ERR_NOT_HANDLED data frame (to be sent on the radio), unknown command or no set_hardware hook
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_std_handle(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Set the radio channel hooks. With a channel, kiss_send_frame waits for the channel with p-persistence CSMA
+ *  (not in full duplex), keys the transmitter, waits TXdelay, sends the frame, waits TXtail and unkeys the transmitter.
+ * @param kiss initialized instance
+ * @param channel hooks (must remain valid), NULL to send the frames right away as before
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_channel(kiss_instance_t *const kiss, const kiss_channel_t *const channel);
+
+
+
+/**
+ * @brief Set the channel access parameters locally, as the standard KISS commands do.
+ * @param kiss initialized instance
+ * @param persistence p-persistence, p = (persistence + 1) / 256
+ * @param slot_time slot time in 10 ms units
+ * @param tx_tail time the transmitter stays up after the frame in 10 ms units
+ * @param fullduplex 1 to send without channel access
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_set_csma(kiss_instance_t *const kiss, uint8_t persistence, uint8_t slot_time, uint8_t tx_tail, uint8_t fullduplex);
+
+
+
+
+
+/* maximum number of ports of a mux, the port is the low nibble of KISS_HEADER_DATA(port) */
+#define KISS_MUX_MAX_PORTS 16
+/* bytes taken in the queue of a port by each frame besides its payload (length) */
+#define KISS_MUX_RECORD_OVERHEAD 2
+
+
+/**
+ * @brief one port of the multiplexer: a queue of data frames to send and an optional receive handler.
+ * The queue is a user buffer where each payload is stored in one piece, preceded by its length.
+ */
+typedef struct
+{
+    uint8_t *storage; /**< user buffer of the queue */
+    size_t size; /**< size of storage in bytes */
+    size_t head; /**< position of the oldest frame */
+    size_t tail; /**< position where the next frame is written */
+    uint16_t count; /**< frames in the queue */
+    uint16_t quantum; /**< bytes added to the deficit at each round, the share of the link of this port */
+    uint32_t deficit; /**< bytes the port can still send in this round */
+    uint32_t dropped; /**< frames dropped by kiss_mux_poll because the instance could not encode them */
+    kiss_frame_fn handler; /**< handler of the received data frames of this port, NULL if not used */
+    void *user; /**< user pointer of the handler */
+} kiss_port_t;
+
+
+/**
+ * @brief multiplexer of data frames over one instance, with a deficit round robin between the ports
+ */
+typedef struct
+{
+    kiss_port_t *ports; /**< user-provided array of ports, the index is the port number */
+    uint8_t count; /**< number of ports (1 to KISS_MUX_MAX_PORTS) */
+    uint8_t current; /**< port served by the round robin */
+    uint8_t credited; /**< 1 if the current port already got its quantum in this round */
+    size_t max_length; /**< longest payload accepted by kiss_mux_enqueue, 0 = no limit */
+} kiss_mux_t;
+
+
+
+/**
+ * @brief Initialize a multiplexer, every port starts without queue and handler.
+ * @param mux multiplexer to initialize
+ * @param ports user array of count ports (must remain valid)
+ * @param count number of ports (1 to KISS_MUX_MAX_PORTS)
+ * @param kiss instance that sends the frames, configured (CRC, framing, compression): the payloads that can never fit
+ *  in its buffer are refused by kiss_mux_enqueue. May be NULL to accept every payload that fits in a queue.
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_mux_init(kiss_mux_t *const mux, kiss_port_t *const ports, uint8_t count, const kiss_instance_t *const kiss);
+
+
+
+/**
+ * @brief Configure one port of the multiplexer.
+ * @param mux initialized multiplexer
+ * @param port port number
+ * @param storage user buffer for the transmit queue (may be NULL with size 0 for a receive only port)
+ * @param size size of storage, each frame takes its length + KISS_MUX_RECORD_OVERHEAD bytes
+ * @param quantum bytes per round: the ports share the link in proportion to their quantum
+ * @param handler handler of the received data frames of this port (may be NULL)
+ * @param user user pointer of the handler
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_mux_port_init(kiss_mux_t *const mux, uint8_t port, uint8_t *const storage, size_t size, uint16_t quantum, kiss_frame_fn handler, void *const user);
+
+
+
+/**
+ * @brief Copy a payload in the transmit queue of a port, it is sent as KISS_HEADER_DATA(port) by kiss_mux_poll.
+ * @param mux initialized multiplexer
+ * @param port port number
+ * @param data payload
+ * @param length payload length
+ * @retval KISS_ERR_BUFFER_OVERFLOW the queue of the port is full, the other ports are not affected,
+ *  or the payload is longer than a frame of the instance given to kiss_mux_init
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_mux_enqueue(kiss_mux_t *const mux, uint8_t port, const uint8_t *const data, size_t length);
+
+
+
+/**
+ * @brief Send the queued frames with a deficit round robin: at each round a port gets its quantum of bytes
+ *  and sends the frames that fit in its deficit, so a port with a long queue cannot starve the others.
+ *  One call does at most one round.
+ * @param kiss initialized instance
+ * @param mux initialized multiplexer
+ * @param max_frames maximum number of frames sent by this call (0 = no limit), the next call continues the round
+ * @param frames optional pointer where the number of frames sent is written (may be NULL)
+ * @return Any number of errors or KISS_OK(0) if everything went ok. A frame that the instance cannot encode (e.g. too long
+ *  once escaped) is dropped and counted in the dropped field of its port, the other frames are still sent and the encoding
+ *  error is returned. A frame that could not be written (e.g. KISS_ERR_TIMEOUT of the CSMA) stays in the queue
+ *  and its port keeps its turn.
+ */
+int32_t kiss_mux_poll(kiss_instance_t *const kiss, kiss_mux_t *const mux, size_t max_frames, size_t *const frames);
+
+
+
+/**
+ * @brief Give a received data frame to the handler of its port.
+ * @param kiss instance that received the frame
+ * @param mux initialized multiplexer
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_ERR_NOT_HANDLED not a data frame, port out of range or port without handler
+ * @return the result of the handler
+ */
+int32_t kiss_mux_dispatch(kiss_instance_t *const kiss, const kiss_mux_t *const mux, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Adapter with the kiss_frame_fn signature for the data entry of the handler table, the user pointer is the kiss_mux_t.
+ */
+int32_t kiss_mux_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+
+
+/* an AX.25 address field: 6 callsign characters and the SSID byte, each shifted left by one bit */
+#define KISS_AX25_ADDR_LEN 7
+/* SSID of kiss_ax25_filter_add matching every SSID of the callsign */
+#define KISS_AX25_SSID_ANY 0xFF
+/* address checked by the filter */
+#define KISS_AX25_MATCH_DEST 0x01
+#define KISS_AX25_MATCH_SOURCE 0x02
+
+
+/**
+ * @brief set of AX.25 callsigns in a user-provided open addressing hash table.
+ * Each entry is the callsign and SSID packed in 52 bits, 0 marks an empty slot.
+ */
+typedef struct
+{
+    uint64_t *slots; /**< user array of size entries */
+    uint16_t size; /**< number of slots, a power of 2 */
+    uint16_t count; /**< callsigns in the set (at most size - 1) */
+    uint8_t match; /**< KISS_AX25_MATCH_DEST, KISS_AX25_MATCH_SOURCE or both: the frame is accepted if one of them is in the set */
+} kiss_ax25_filter_t;
+
+
+
+/**
+ * @brief Initialize an empty callsign set.
+ * @param filter filter to initialize
+ * @param slots user array of size entries (must remain valid)
+ * @param size number of slots, a power of 2 at least twice the number of callsigns keeps the lookups short
+ * @param match KISS_AX25_MATCH_DEST, KISS_AX25_MATCH_SOURCE or both
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_ax25_filter_init(kiss_ax25_filter_t *const filter, uint64_t *const slots, uint16_t size, uint8_t match);
+
+
+
+/**
+ * @brief Add a callsign to the set.
+ * @param filter initialized filter
+ * @param callsign 1 to 6 letters or digits, NUL terminated (lower case is converted)
+ * @param ssid 0 to 15, or KISS_AX25_SSID_ANY
+ * @retval KISS_ERR_TABLE_FULL no free slot
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_ax25_filter_add(kiss_ax25_filter_t *const filter, const char *const callsign, uint8_t ssid);
+
+
+
+/**
+ * @brief Check the addresses of a received data frame before decoding it. The address fields are read directly
+ *  from the escaped (or COBS stuffed) receive buffer, only the first 14 bytes of the payload are looked at.
+ *  A frame not addressed to the set is discarded: the instance goes back to KISS_STATUS_NOTHING.
+ *  The CRC32 is not verified here, kiss_decode does it for the accepted frames.
+ * @param kiss instance with a frame received by kiss_receive_frame
+ * @param filter initialized filter
+ * @retval KISS_OK the frame is accepted, or it is not a data frame (or it is LZSS compressed) and it must be decoded as usual
+ * @retval KISS_ERR_FILTERED the frame has been discarded (too short for two addresses or not addressed to the set)
+ * @return Any other number of errors
+ */
+int32_t kiss_ax25_filter_check(kiss_instance_t *const kiss, const kiss_ax25_filter_t *const filter);
+
+
+
+
+
+/* longest address block kept in a compression context: destination, source and two digipeaters */
+#define KISS_AX25_CONTEXT_MAX_ADDR (4 * KISS_AX25_ADDR_LEN)
+/* maximum number of contexts, the context ID is one byte */
+#define KISS_AX25_MAX_CONTEXTS 255
+
+
+/**
+ * @brief AX.25 header compression context: the address block of the frames of one port.
+ */
+typedef struct
+{
+    uint8_t address[KISS_AX25_CONTEXT_MAX_ADDR]; /**< address block (destination, source, digipeaters) as it is in the frame */
+    uint8_t length; /**< address block length, 0 = context not in use */
+    uint8_t port; /**< data port of the frames */
+    uint8_t generation; /**< incremented every time the sender assigns the context to another address block */
+    uint8_t acked; /**< sender: 1 when the receiver acknowledged this generation. Receiver: 1 when the context is valid */
+    uint16_t last_used; /**< sender: frame counter of the last use, the least recently used context is replaced */
+} kiss_ax25_context_t;
+
+
+/**
+ * @brief sender side of the AX.25 header compression.
+ */
+typedef struct
+{
+    kiss_ax25_context_t *contexts; /**< user array, the index is the context ID */
+    uint8_t count; /**< number of contexts, at most the number of contexts of the receiver */
+    uint16_t clock; /**< frame counter for the least recently used replacement */
+} kiss_ax25_tx_t;
+
+
+/**
+ * @brief receiver side of the AX.25 header compression.
+ */
+typedef struct
+{
+    kiss_ax25_context_t *contexts; /**< user array, the index is the context ID */
+    uint8_t count; /**< number of contexts */
+    uint8_t *output; /**< user buffer where the frames are restored */
+    size_t output_size; /**< size of output, the longest AX.25 frame expected */
+    kiss_frame_fn handler; /**< called with the restored frame and KISS_HEADER_DATA(port) */
+    void *user; /**< user pointer of the handler */
+} kiss_ax25_rx_t;
+
+
+
+/**
+ * @brief Initialize the sender of the AX.25 header compression.
+ * @param tx sender to initialize
+ * @param contexts user array of count contexts
+ * @param count number of contexts (1 to KISS_AX25_MAX_CONTEXTS)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_ax25_tx_init(kiss_ax25_tx_t *const tx, kiss_ax25_context_t *const contexts, uint8_t count);
+
+
+
+/**
+ * @brief Send an AX.25 frame on a data port with its address block compressed.
+ *  The first frames of an address block are KISS_HEADER_AX25_FULL frames [ID][generation][port][frame]
+ *  that install the context in the receiver. Once the receiver acknowledges the context, the frames with the same port and
+ *  address block are KISS_HEADER_AX25_COMPRESSED frames [ID][frame without the address block].
+ *  Frames without a valid address block, or with one longer than KISS_AX25_CONTEXT_MAX_ADDR, are sent as KISS_HEADER_DATA(port) frames.
+ * @param kiss initialized instance
+ * @param tx initialized sender
+ * @param port data port (0-15)
+ * @param frame AX.25 frame starting with the address block
+ * @param length frame length
+ * @retval KISS_ERR_INVALID_PARAMS also when the AX.25 compressed frames are scrambled (kiss_set_scramble)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_ax25_send(kiss_instance_t *const kiss, kiss_ax25_tx_t *const tx, uint8_t port, const uint8_t *const frame, size_t length);
+
+
+
+/**
+ * @brief Handle the KISS_HEADER_AX25_CONTEXT_ACK frames of the receiver.
+ *  [ID][generation] acknowledges a context, [ID] alone tells that the receiver does not know it (e.g. after a reset)
+ *  and the next frames of the context are sent in full again.
+ * @param kiss initialized instance
+ * @param tx initialized sender
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a context acknowledge
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_ax25_tx_handle(kiss_instance_t *const kiss, kiss_ax25_tx_t *const tx, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Initialize the receiver of the AX.25 header compression.
+ * @param rx receiver to initialize
+ * @param contexts user array of count contexts
+ * @param count number of contexts (1 to KISS_AX25_MAX_CONTEXTS)
+ * @param output user buffer where the frames are restored
+ * @param output_size size of output
+ * @param handler called with every restored frame
+ * @param user user pointer of the handler
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_ax25_rx_init(kiss_ax25_rx_t *const rx, kiss_ax25_context_t *const contexts, uint8_t count, uint8_t *const output, size_t output_size, kiss_frame_fn handler, void *const user);
+
+
+
+/**
+ * @brief Restore the frames compressed by kiss_ax25_send and pass them to the handler as KISS_HEADER_DATA(port) frames.
+ *  The contexts installed by KISS_HEADER_AX25_FULL frames are acknowledged before calling the handler.
+ * @param kiss initialized instance
+ * @param rx initialized receiver
+ * @param header header of the decoded frame
+ * @param payload decoded payload
+ * @param length payload length
+ * @retval KISS_ERR_NOT_HANDLED the frame is not a compressed AX.25 frame
+ * @retval KISS_ERR_INVALID_FRAME malformed frame or unknown context (the sender is told to send it in full)
+ * @retval KISS_ERR_BUFFER_OVERFLOW the restored frame does not fit the output buffer
+ * @return Any other number of errors, or the return value of the handler
+ */
+int32_t kiss_ax25_rx_handle(kiss_instance_t *const kiss, kiss_ax25_rx_t *const rx, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief Adapters with the kiss_frame_fn signature, the user pointer is the kiss_ax25_tx_t or kiss_ax25_rx_t.
+ *  All the AX.25 compression frames have the same handler slot, so they fit a node that only sends or only receives.
+ */
+int32_t kiss_ax25_tx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+int32_t kiss_ax25_rx_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+/**
+ * @brief sender and receiver of the AX.25 header compression of one node, for the handler slot shared by their frames.
+ */
+typedef struct
+{
+    kiss_ax25_tx_t *tx; /**< sender, gets the KISS_HEADER_AX25_CONTEXT_ACK frames (NULL if the node does not send) */
+    kiss_ax25_rx_t *rx; /**< receiver, gets the KISS_HEADER_AX25_FULL and KISS_HEADER_AX25_COMPRESSED frames (NULL if the node does not receive) */
+} kiss_ax25_link_t;
+
+
+
+/**
+ * @brief Adapter with the kiss_frame_fn signature for a node that both sends and receives compressed AX.25 frames,
+ *  the user pointer is the kiss_ax25_link_t. Each frame goes to kiss_ax25_tx_handle or kiss_ax25_rx_handle by its header.
+ * @retval KISS_ERR_NOT_HANDLED the frame is not an AX.25 compression frame, or its side is NULL
+ * @return the value returned by kiss_ax25_tx_handle or kiss_ax25_rx_handle
+ */
+int32_t kiss_ax25_handler(kiss_instance_t *const kiss, uint8_t header, const uint8_t *const payload, size_t length, void *const user);
+
+
+
+
 
 
 
@@ -0,0 +1,329 @@
+/* cfmakeraw and the speeds above 38400 are not in strict C99 */
+#define _DEFAULT_SOURCE
+
+#include "kiss_serial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+
+
+
+/* termios speed of a baud rate */
+typedef struct
+{
+    uint32_t baudrate;
+    speed_t speed;
+} kiss_serial_speed_t;
+
+static const kiss_serial_speed_t kiss_serial_speeds[] =
+{
+    {1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200}, {38400, B38400},
+    {57600, B57600}, {115200, B115200}, {230400, B230400},
+#ifdef B460800
+    {460800, B460800},
+#endif
+#ifdef B921600
+    {921600, B921600},
+#endif
+#ifdef B1000000
+    {1000000, B1000000},
+#endif
+#ifdef B2000000
+    {2000000, B2000000},
+#endif
+#ifdef B4000000
+    {4000000, B4000000},
+#endif
+};
+
+
+
+/* raw 8N1 without flow control, the reads never block in the driver (the waits are done with poll) */
+static int32_t kiss_serial_raw(int fd, const speed_t *const speed)
+{
+    struct termios tio;
+    if(tcgetattr(fd, &tio) != 0)
+    {
+        return KISS_ERR_IO;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= (tcflag_t)(CLOCAL | CREAD);
+    tio.c_cflag &= (tcflag_t)~(CSTOPB | CRTSCTS);
+    tio.c_iflag &= (tcflag_t)~(IXON | IXOFF | IXANY);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if(speed != NULL && (cfsetispeed(&tio, *speed) != 0 || cfsetospeed(&tio, *speed) != 0))
+    {
+        return KISS_ERR_IO;
+    }
+    if(tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+        return KISS_ERR_IO;
+    }
+
+    /* the bytes received before the port was configured are not meaningful */
+    (void)tcflush(fd, TCIOFLUSH);
+    return KISS_OK;
+}
+
+
+
+/* wait for the descriptor, 1 if ready, 0 on timeout */
+static int32_t kiss_serial_wait(const kiss_serial_t *const serial, short events, short *const revents)
+{
+    struct pollfd pfd;
+    pfd.fd = serial->fd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    int n;
+    do
+    {
+        n = poll(&pfd, 1, (int)serial->timeout_ms);
+    }
+    while(n < 0 && EINTR == errno);
+
+    if(n < 0)
+    {
+        return -KISS_ERR_IO;
+    }
+    *revents = pfd.revents;
+    return (n > 0) ? 1 : 0;
+}
+
+
+
+int32_t kiss_serial_open(kiss_serial_t *const serial, const char *const path, uint32_t baudrate, int32_t timeout_ms)
+{
+    if(NULL == serial || NULL == path)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    const speed_t *speed = NULL;
+    for(size_t i = 0; i < sizeof(kiss_serial_speeds) / sizeof(kiss_serial_speeds[0]); i++)
+    {
+        if(kiss_serial_speeds[i].baudrate == baudrate)
+        {
+            speed = &kiss_serial_speeds[i].speed;
+        }
+    }
+    if(NULL == speed)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    serial->fd = -1;
+    serial->rx_pos = 0;
+    serial->rx_len = 0;
+    serial->frame = 0;
+    serial->timeout_ms = timeout_ms;
+
+    /* O_NONBLOCK also keeps open from waiting for the carrier detect */
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return KISS_ERR_IO;
+    }
+
+    int32_t err = kiss_serial_raw(fd, speed);
+    if(err != KISS_OK)
+    {
+        int saved = errno;
+        (void)close(fd);
+        errno = saved;
+        return err;
+    }
+
+    serial->fd = fd;
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_serial_attach(kiss_serial_t *const serial, int fd, int32_t timeout_ms)
+{
+    if(NULL == serial || fd < 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    if(isatty(fd) && kiss_serial_raw(fd, NULL) != KISS_OK)
+    {
+        return KISS_ERR_IO;
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        return KISS_ERR_IO;
+    }
+
+    serial->fd = fd;
+    serial->rx_pos = 0;
+    serial->rx_len = 0;
+    serial->frame = 0;
+    serial->timeout_ms = timeout_ms;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_serial_close(kiss_serial_t *const serial)
+{
+    if(NULL == serial || serial->fd < 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    int n = close(serial->fd);
+    serial->fd = -1;
+    serial->rx_pos = 0;
+    serial->rx_len = 0;
+
+    return (0 == n) ? KISS_OK : KISS_ERR_IO;
+}
+
+
+
+int32_t kiss_serial_write(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    if(NULL == kiss || NULL == kiss->context || (NULL == data && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_serial_t *serial = (kiss_serial_t *)kiss->context;
+    size_t sent = 0;
+
+    while(sent < length)
+    {
+        ssize_t n = write(serial->fd, &data[sent], length - sent);
+        if(n > 0)
+        {
+            sent += (size_t)n;
+        }
+        else if(n < 0 && EINTR == errno)
+        {
+            /* interrupted before writing anything, try again */
+        }
+        else if(n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+        {
+            /* the driver buffer is full, wait until it drains */
+            short revents = 0;
+            int32_t ready = kiss_serial_wait(serial, POLLOUT, &revents);
+            if(ready < 0)
+            {
+                return -ready;
+            }
+            if(0 == ready)
+            {
+                return KISS_ERR_TIMEOUT;
+            }
+            if(revents & (POLLERR | POLLHUP | POLLNVAL))
+            {
+                return KISS_ERR_IO;
+            }
+        }
+        else
+        {
+            return KISS_ERR_IO;
+        }
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_serial_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received)
+{
+    if(NULL == kiss || NULL == kiss->context || NULL == buffer || NULL == received)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_serial_t *serial = (kiss_serial_t *)kiss->context;
+    *received = 0;
+
+    if(serial->rx_pos == serial->rx_len)
+    {
+        serial->rx_pos = 0;
+        serial->rx_len = 0;
+
+        short revents = 0;
+        int32_t ready = kiss_serial_wait(serial, POLLIN, &revents);
+        if(ready < 0)
+        {
+            return -ready;
+        }
+        if(0 == ready)
+        {
+            return KISS_OK;
+        }
+
+        /* everything the driver has, in one system call */
+        ssize_t n = read(serial->fd, serial->rx, sizeof(serial->rx));
+        if(n < 0)
+        {
+            return (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) ? KISS_OK : KISS_ERR_IO;
+        }
+        if(0 == n)
+        {
+            /* nothing to read and the other side is gone */
+            return (revents & (POLLHUP | POLLERR)) ? KISS_ERR_IO : KISS_OK;
+        }
+        serial->rx_len = (size_t)n;
+    }
+
+    /*
+    * give the bytes up to the delimiter that ends the frame, kiss_receive_frame drops what comes after it.
+    * The state follows the one of kiss_receive_frame: 0 outside a frame, 1 after the opening delimiter
+    * (more delimiters are padding), 2 in the frame data
+    */
+    uint8_t delimiter = kiss_frame_delimiter(kiss);
+    size_t n = serial->rx_len - serial->rx_pos;
+    if(n > dataLen)
+    {
+        n = dataLen;
+    }
+
+    size_t i = 0;
+    uint8_t end = 0;
+    while(i < n && 0 == end)
+    {
+        uint8_t b = serial->rx[serial->rx_pos + i];
+        buffer[i] = b;
+        i++;
+
+        if(delimiter == b)
+        {
+            end = (2 == serial->frame);
+            serial->frame = end ? 0 : 1;
+        }
+        else if(1 == serial->frame)
+        {
+            serial->frame = 2;
+        }
+    }
+
+    serial->rx_pos += i;
+    *received = i;
+
+    return KISS_OK;
+}
+
+
+
+size_t kiss_serial_pending(const kiss_serial_t *const serial)
+{
+    return (NULL == serial) ? 0 : serial->rx_len - serial->rx_pos;
+}
@@ -0,0 +1,114 @@
+#ifndef KISS_SERIAL_H
+#define KISS_SERIAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../kissLIB.h"
+
+
+/*
+* POSIX serial transport for kissLIB (Linux termios).
+* The port is in raw mode with a non-blocking descriptor: the reads take everything the driver has
+* in one system call and the transport hands it to kissLIB one frame at a time.
+*/
+
+
+
+
+
+/* bytes read from the port in one system call, one or more frames */
+#ifndef KISS_SERIAL_RX_SIZE
+#define KISS_SERIAL_RX_SIZE 4096
+#endif
+
+
+/**
+ * @brief serial port used as the context of a kiss instance.
+ */
+typedef struct
+{
+    int fd; /**< descriptor of the port, -1 when closed */
+    uint8_t rx[KISS_SERIAL_RX_SIZE]; /**< data read from the port and not given to kissLIB yet */
+    size_t rx_pos; /**< first byte of rx not given to kissLIB */
+    size_t rx_len; /**< bytes in rx */
+    uint8_t frame; /**< where the bytes given to kissLIB stopped: 0 between frames, 1 after the opening delimiter, 2 inside the frame */
+    int32_t timeout_ms; /**< time a read waits for data and a write waits for room in the driver, -1 = forever */
+} kiss_serial_t;
+
+
+
+/**
+ * @brief Open a serial port (or the slave side of a pty) in raw mode, 8N1 without flow control.
+ *  The descriptor is non-blocking and the termios VMIN/VTIME are 0: the waits are done with poll() and timeout_ms.
+ * @param serial port to open
+ * @param path device (e.g. "/dev/ttyUSB0")
+ * @param baudrate 1200 to 4000000, the standard termios speeds only
+ * @param timeout_ms time a read waits for data and a write waits for room in the driver, -1 = forever
+ * @retval KISS_ERR_INVALID_PARAMS the baud rate is not a termios speed
+ * @retval KISS_ERR_IO the port cannot be opened or configured (errno tells why)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_serial_open(kiss_serial_t *const serial, const char *const path, uint32_t baudrate, int32_t timeout_ms);
+
+
+
+/**
+ * @brief Use a descriptor already open (e.g. a pty or a socket pair), it is set in raw mode when it is a terminal and made non-blocking.
+ * @param serial port to initialize
+ * @param fd open descriptor, closed by kiss_serial_close
+ * @param timeout_ms time a read waits for data and a write waits for room, -1 = forever
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_serial_attach(kiss_serial_t *const serial, int fd, int32_t timeout_ms);
+
+
+
+/**
+ * @brief Close the port, the data not read yet is lost.
+ * @param serial open port
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_serial_close(kiss_serial_t *const serial);
+
+
+
+/**
+ * @brief kiss_write_fn of the transport, the context of the instance is the kiss_serial_t.
+ *  It returns when the whole frame is in the driver.
+ * @retval KISS_ERR_TIMEOUT the driver had no room for timeout_ms
+ * @retval KISS_ERR_IO write error (errno tells why)
+ */
+int32_t kiss_serial_write(kiss_instance_t *const kiss, const uint8_t *const data, size_t length);
+
+
+
+/**
+ * @brief kiss_read_fn of the transport, the context of the instance is the kiss_serial_t.
+ *  It waits up to timeout_ms only when nothing is buffered, then reads everything available with one system call.
+ *  The data is given up to the delimiter that ends a frame, the rest stays buffered for the next frames.
+ *  No data after timeout_ms is not an error: it returns KISS_OK with *received = 0 and kiss_receive_frame tries again.
+ * @retval KISS_ERR_IO read error or hang up (errno tells why)
+ */
+int32_t kiss_serial_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received);
+
+
+
+/**
+ * @brief Bytes received and not given to kissLIB yet. When it is not 0, kiss_poll can be called again
+ *  before waiting on the descriptor: poll() only tells about the data still in the driver.
+ * @param serial open port
+ * @returns buffered bytes
+ */
+size_t kiss_serial_pending(const kiss_serial_t *const serial);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,582 @@
+/* accept4 and the socket flags are not in strict C99 */
+#define _GNU_SOURCE
+
+#include "kiss_tcp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+
+
+
+
+/* epoll tokens that are not a client index */
+#define KISS_TCP_TOKEN_LISTEN 0xFFFFFFFFU
+#define KISS_TCP_TOKEN_LINK 0xFFFFFFFEU
+
+
+
+/* copy a frame in a queue, 0 when it does not fit */
+static uint8_t kiss_tcp_enqueue(kiss_tcp_queue_t *const queue, const uint8_t *const data, size_t length)
+{
+    if(length > sizeof(queue->data) - queue->length)
+    {
+        return 0;
+    }
+
+    size_t tail = (queue->head + queue->length) % sizeof(queue->data);
+    size_t first = sizeof(queue->data) - tail;
+    if(first > length)
+    {
+        first = length;
+    }
+    memcpy(&queue->data[tail], data, first);
+    memcpy(queue->data, &data[first], length - first);
+    queue->length += length;
+    return 1;
+}
+
+
+
+/* send what the descriptor takes without waiting, the rest stays queued */
+static int32_t kiss_tcp_flush(int fd, kiss_tcp_queue_t *const queue, uint8_t is_socket)
+{
+    while(queue->length > 0)
+    {
+        size_t chunk = sizeof(queue->data) - queue->head;
+        if(chunk > queue->length)
+        {
+            chunk = queue->length;
+        }
+
+        /* no SIGPIPE from a client that is gone */
+        ssize_t n = is_socket ? send(fd, &queue->data[queue->head], chunk, MSG_NOSIGNAL | MSG_DONTWAIT)
+                           : write(fd, &queue->data[queue->head], chunk);
+        if(n > 0)
+        {
+            queue->head = (queue->head + (size_t)n) % sizeof(queue->data);
+            queue->length -= (size_t)n;
+        }
+        else if(n < 0 && EINTR == errno)
+        {
+            /* interrupted before sending anything, try again */
+        }
+        else if(n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+        {
+            break;
+        }
+        else
+        {
+            return KISS_ERR_IO;
+        }
+    }
+
+    return KISS_OK;
+}
+
+
+
+/* change the events watched on a descriptor when they differ from the registered ones */
+static int32_t kiss_tcp_watch(const kiss_tcp_server_t *const server, int fd, uint32_t token, uint32_t events, uint32_t *const registered)
+{
+    if(events == *registered)
+    {
+        return KISS_OK;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u32 = token;
+    if(epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0)
+    {
+        return KISS_ERR_IO;
+    }
+    *registered = events;
+
+    return KISS_OK;
+}
+
+
+
+static void kiss_tcp_drop(kiss_tcp_server_t *const server, kiss_tcp_client_t *const client)
+{
+    (void)epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    (void)close(client->fd);
+    client->fd = -1;
+    server->count--;
+
+    /* a descriptor is free again: the connections waiting are accepted */
+    (void)kiss_tcp_watch(server, server->listen_fd, KISS_TCP_TOKEN_LISTEN, EPOLLIN, &server->listen_events);
+}
+
+
+
+/* 1 when nothing is left to read from a client, neither in its port nor in its socket */
+static uint8_t kiss_tcp_drained(const kiss_tcp_client_t *const client)
+{
+    int unread = 0;
+    if(kiss_serial_pending(&client->port) > 0)
+    {
+        return 0;
+    }
+    return (ioctl(client->fd, FIONREAD, &unread) != 0 || 0 == unread);
+}
+
+
+
+/* 1 when the frames of the clients go to link_queue and it cannot take the longest one */
+static uint8_t kiss_tcp_link_full(const kiss_tcp_server_t *const server)
+{
+    return (NULL == server->handler && server->link_fd >= 0 &&
+            sizeof(server->link_queue.data) - server->link_queue.length < sizeof(server->out_buffer));
+}
+
+
+
+/* a frame of a client goes to the handler, or on the link */
+static int32_t kiss_tcp_from_client(kiss_tcp_server_t *const server, kiss_tcp_client_t *const client, uint8_t header, size_t length)
+{
+    if(server->handler != NULL)
+    {
+        return server->handler(&client->kiss, header, server->frame, length, server->user);
+    }
+    if(NULL == server->link)
+    {
+        return KISS_OK;
+    }
+
+    /* encoded apart: the buffer of the link may hold a frame being received */
+    int32_t err = kiss_std_encode(&server->out, header, server->frame, length);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+    if(server->link_fd >= 0)
+    {
+        /* kiss_tcp_receive made sure there is room */
+        (void)kiss_tcp_enqueue(&server->link_queue, server->out.buffer, server->out.index);
+        return KISS_OK;
+    }
+    return (NULL == server->link->write) ? KISS_OK : server->link->write(server->link, server->out.buffer, server->out.index);
+}
+
+
+
+/* receive every frame buffered or available on a parser whose reads do not wait */
+static int32_t kiss_tcp_receive(kiss_tcp_server_t *const server, kiss_instance_t *const kiss, kiss_tcp_client_t *const client)
+{
+    int32_t err;
+    do
+    {
+        /* backpressure: the frames of the clients stay in their sockets until the link drains */
+        if(client != NULL && kiss_tcp_link_full(server))
+        {
+            server->paused = 1;
+            return KISS_OK;
+        }
+
+        err = kiss_receive_frame(kiss, 1);
+        if(KISS_OK == err)
+        {
+            size_t length = 0;
+            uint8_t header = 0;
+            if(KISS_OK == kiss_std_decode(kiss, server->frame, sizeof(server->frame), &length, &header))
+            {
+                if(client != NULL)
+                {
+                    (void)kiss_tcp_from_client(server, client, header, length);
+                }
+                else if(header != KISS_STD_RETURN && KISS_STD_DATA == KISS_STD_COMMAND(header))
+                {
+                    (void)kiss_tcp_server_broadcast(server, header, server->frame, length);
+                }
+            }
+        }
+    }
+    /* a bad frame is skipped, the next one may be good */
+    while(KISS_OK == err || KISS_ERR_INVALID_FRAME == err || KISS_ERR_BUFFER_OVERFLOW == err);
+
+    return (KISS_ERR_NO_DATA_RECEIVED == err) ? KISS_OK : err;
+}
+
+
+
+static int32_t kiss_tcp_accept(kiss_tcp_server_t *const server)
+{
+    for(;;)
+    {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+        {
+            if(EAGAIN == errno || EWOULDBLOCK == errno)
+            {
+                return KISS_OK;
+            }
+            if(EINTR == errno || ECONNABORTED == errno)
+            {
+                continue;
+            }
+            if(EMFILE == errno || ENFILE == errno || ENOBUFS == errno || ENOMEM == errno)
+            {
+                /* the connection stays in the backlog: the listening socket is watched again when a client leaves,
+                 *  otherwise the level-triggered event comes back at once and the loop spins */
+                return kiss_tcp_watch(server, server->listen_fd, KISS_TCP_TOKEN_LISTEN, 0, &server->listen_events);
+            }
+            return KISS_ERR_IO;
+        }
+
+        kiss_tcp_client_t *client = NULL;
+        for(uint32_t i = 0; i < KISS_TCP_MAX_CLIENTS && NULL == client; i++)
+        {
+            if(server->clients[i].fd < 0)
+            {
+                client = &server->clients[i];
+            }
+        }
+
+        /* small frames: do not wait to fill a segment */
+        int one = 1;
+        (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = server->paused ? 0U : (uint32_t)(EPOLLIN | EPOLLRDHUP);
+        ev.data.u32 = (NULL == client) ? 0U : (uint32_t)(client - server->clients);
+        if(NULL == client || kiss_serial_attach(&client->port, fd, 0) != KISS_OK || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            (void)close(fd);
+            continue;
+        }
+
+        (void)kiss_init(&client->kiss, client->buffer, sizeof(client->buffer), 0, NULL, kiss_serial_read, &client->port, 0, KISS_CRC32_OFF);
+        client->fd = fd;
+        client->queue.head = 0;
+        client->queue.length = 0;
+        client->events = ev.events;
+        client->dropped = 0;
+        server->count++;
+    }
+}
+
+
+
+int32_t kiss_tcp_server_init(kiss_tcp_server_t *const server, const char *const address, uint16_t port)
+{
+    if(NULL == server)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if(address != NULL && inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    server->count = 0;
+    server->link = NULL;
+    server->link_fd = -1;
+    server->link_queue.head = 0;
+    server->link_queue.length = 0;
+    server->link_events = 0;
+    server->listen_events = EPOLLIN;
+    server->paused = 0;
+    server->handler = NULL;
+    server->user = NULL;
+    for(uint32_t i = 0; i < KISS_TCP_MAX_CLIENTS; i++)
+    {
+        server->clients[i].fd = -1;
+    }
+    (void)kiss_init(&server->out, server->out_buffer, sizeof(server->out_buffer), 0, NULL, NULL, server, 0, KISS_CRC32_OFF);
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(server->epoll_fd < 0 || server->listen_fd < 0)
+    {
+        (void)kiss_tcp_server_close(server);
+        return KISS_ERR_IO;
+    }
+
+    int one = 1;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = KISS_TCP_TOKEN_LISTEN;
+    if(setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+       bind(server->listen_fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+       listen(server->listen_fd, SOMAXCONN) != 0 ||
+       epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev) != 0)
+    {
+        (void)kiss_tcp_server_close(server);
+        return KISS_ERR_IO;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_tcp_server_set_link(kiss_tcp_server_t *const server, kiss_instance_t *const link, int fd)
+{
+    if(NULL == server || NULL == link || KISS_FRAMING_KISS != link->framing)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    if(server->link_fd >= 0)
+    {
+        (void)epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, server->link_fd, NULL);
+    }
+    server->link = link;
+    server->link_fd = -1;
+    server->link_queue.head = 0;
+    server->link_queue.length = 0;
+
+    if(fd >= 0)
+    {
+        int flags = fcntl(fd, F_GETFL);
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = KISS_TCP_TOKEN_LINK;
+        if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            return KISS_ERR_IO;
+        }
+        server->link_fd = fd;
+        server->link_events = ev.events;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_tcp_server_set_handler(kiss_tcp_server_t *const server, kiss_frame_fn handler, void *const user)
+{
+    if(NULL == server)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    server->handler = handler;
+    server->user = user;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_tcp_server_run(kiss_tcp_server_t *const server, int32_t timeout_ms)
+{
+    if(NULL == server || server->epoll_fd < 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    struct epoll_event events[KISS_TCP_MAX_CLIENTS + 2];
+    int n = epoll_wait(server->epoll_fd, events, KISS_TCP_MAX_CLIENTS + 2, (int)timeout_ms);
+    if(n < 0)
+    {
+        if(errno != EINTR)
+        {
+            return KISS_ERR_IO;
+        }
+        n = 0;
+    }
+
+    int32_t link_err = KISS_OK;
+    int32_t accept_err = KISS_OK;
+    for(int i = 0; i < n; i++)
+    {
+        uint32_t token = events[i].data.u32;
+        uint32_t flags = events[i].events;
+
+        if(KISS_TCP_TOKEN_LISTEN == token)
+        {
+            accept_err = kiss_tcp_accept(server);
+        }
+        else if(KISS_TCP_TOKEN_LINK == token)
+        {
+            if(flags & EPOLLIN)
+            {
+                link_err = kiss_tcp_server_poll_link(server);
+            }
+            if(KISS_OK == link_err && (flags & (EPOLLOUT | EPOLLERR)) && kiss_tcp_flush(server->link_fd, &server->link_queue, 0) != KISS_OK)
+            {
+                link_err = KISS_ERR_IO;
+            }
+        }
+        else if(token < KISS_TCP_MAX_CLIENTS && server->clients[token].fd >= 0)
+        {
+            kiss_tcp_client_t *client = &server->clients[token];
+            int32_t err = KISS_OK;
+
+            /* the data received before a hang up is forwarded first */
+            if(flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                err = kiss_tcp_receive(server, &client->kiss, client);
+            }
+            if(KISS_OK == err && (flags & EPOLLOUT))
+            {
+                err = kiss_tcp_flush(client->fd, &client->queue, 1);
+            }
+            /* a client that closed its side may still have frames in its socket (the link was full, or a read
+             *  ended in the middle of a frame): it is dropped once they have all been read */
+            if(err != KISS_OK || (flags & (EPOLLHUP | EPOLLERR)) || ((flags & EPOLLRDHUP) && kiss_tcp_drained(client)))
+            {
+                kiss_tcp_drop(server, client);
+            }
+        }
+    }
+
+    /* the frames queued by this round go out with one write for the link and one send per client */
+    if(server->link_fd >= 0)
+    {
+        if(server->link_queue.length > 0 && kiss_tcp_flush(server->link_fd, &server->link_queue, 0) != KISS_OK)
+        {
+            link_err = KISS_ERR_IO;
+        }
+
+        /* the link drained: the frames already buffered are read first, the sockets are watched again */
+        if(server->paused && 0 == kiss_tcp_link_full(server))
+        {
+            server->paused = 0;
+            for(uint32_t i = 0; i < KISS_TCP_MAX_CLIENTS; i++)
+            {
+                kiss_tcp_client_t *client = &server->clients[i];
+                if(client->fd >= 0 && kiss_serial_pending(&client->port) > 0 && kiss_tcp_receive(server, &client->kiss, client) != KISS_OK)
+                {
+                    kiss_tcp_drop(server, client);
+                }
+            }
+        }
+
+        uint32_t watch = EPOLLIN | ((server->link_queue.length > 0) ? (uint32_t)EPOLLOUT : 0U);
+        if(kiss_tcp_watch(server, server->link_fd, KISS_TCP_TOKEN_LINK, watch, &server->link_events) != KISS_OK)
+        {
+            link_err = KISS_ERR_IO;
+        }
+    }
+
+    for(uint32_t i = 0; i < KISS_TCP_MAX_CLIENTS; i++)
+    {
+        kiss_tcp_client_t *client = &server->clients[i];
+        if(client->fd < 0)
+        {
+            continue;
+        }
+
+        uint32_t watch = (server->paused ? 0U : (uint32_t)(EPOLLIN | EPOLLRDHUP));
+        if(kiss_tcp_flush(client->fd, &client->queue, 1) != KISS_OK ||
+           kiss_tcp_watch(server, client->fd, i, watch | ((client->queue.length > 0) ? (uint32_t)EPOLLOUT : 0U), &client->events) != KISS_OK)
+        {
+            kiss_tcp_drop(server, client);
+        }
+    }
+
+    return (KISS_OK != link_err) ? link_err : accept_err;
+}
+
+
+
+int32_t kiss_tcp_server_poll_link(kiss_tcp_server_t *const server)
+{
+    if(NULL == server || NULL == server->link)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    return kiss_tcp_receive(server, server->link, NULL);
+}
+
+
+
+int32_t kiss_tcp_server_broadcast(kiss_tcp_server_t *const server, uint8_t header, const uint8_t *const payload, size_t length)
+{
+    if(NULL == server || (NULL == payload && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* encoded once for all the clients */
+    int32_t err = kiss_std_encode(&server->out, header, payload, length);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    for(uint32_t i = 0; i < KISS_TCP_MAX_CLIENTS; i++)
+    {
+        if(server->clients[i].fd >= 0 && 0 == kiss_tcp_enqueue(&server->clients[i].queue, server->out.buffer, server->out.index))
+        {
+            server->clients[i].dropped++;
+        }
+    }
+
+    return KISS_OK;
+}
+
+
+
+uint16_t kiss_tcp_server_port(const kiss_tcp_server_t *const server)
+{
+    if(NULL == server || server->listen_fd < 0)
+    {
+        return 0;
+    }
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if(getsockname(server->listen_fd, (struct sockaddr *)&addr, &len) != 0)
+    {
+        return 0;
+    }
+    return ntohs(addr.sin_port);
+}
+
+
+
+int32_t kiss_tcp_server_close(kiss_tcp_server_t *const server)
+{
+    if(NULL == server)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    for(uint32_t i = 0; i < KISS_TCP_MAX_CLIENTS; i++)
+    {
+        if(server->clients[i].fd >= 0)
+        {
+            (void)close(server->clients[i].fd);
+            server->clients[i].fd = -1;
+        }
+    }
+    server->count = 0;
+
+    if(server->listen_fd >= 0)
+    {
+        (void)close(server->listen_fd);
+        server->listen_fd = -1;
+    }
+    if(server->epoll_fd >= 0)
+    {
+        (void)close(server->epoll_fd);
+        server->epoll_fd = -1;
+    }
+
+    return KISS_OK;
+}
@@ -0,0 +1,185 @@
+#ifndef KISS_TCP_H
+#define KISS_TCP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../kissLIB.h"
+#include "kiss_serial.h"
+
+
+/*
+* KISS over TCP server for kissLIB (Linux epoll).
+* The clients speak standard KISS (KISS_STD_HEADER command bytes, no CRC): the data frames received on the
+* link (the TNC) are sent to every client and the frames of the clients are sent on the link.
+* One thread, level triggered epoll, non-blocking sockets.
+*/
+
+
+
+
+
+/* maximum number of clients connected at the same time */
+#ifndef KISS_TCP_MAX_CLIENTS
+#define KISS_TCP_MAX_CLIENTS 16
+#endif
+
+/* longest escaped frame accepted from a client */
+#ifndef KISS_TCP_FRAME_SIZE
+#define KISS_TCP_FRAME_SIZE 1024
+#endif
+
+/* send queue of a client or of the link: a frame that does not fit in the queue of a client is dropped for that client only */
+#ifndef KISS_TCP_QUEUE_SIZE
+#define KISS_TCP_QUEUE_SIZE 16384
+#endif
+
+
+/**
+ * @brief bytes waiting to be sent on a descriptor, circular.
+ */
+typedef struct
+{
+    uint8_t data[KISS_TCP_QUEUE_SIZE]; /**< queued bytes */
+    size_t head; /**< first byte to send */
+    size_t length; /**< bytes in the queue */
+} kiss_tcp_queue_t;
+
+
+/**
+ * @brief a client connection.
+ */
+typedef struct
+{
+    int fd; /**< socket, -1 when the slot is free */
+    kiss_serial_t port; /**< buffered non-blocking reads of the socket */
+    kiss_instance_t kiss; /**< parser of the frames of the client */
+    uint8_t buffer[KISS_TCP_FRAME_SIZE]; /**< buffer of the parser */
+    kiss_tcp_queue_t queue; /**< frames waiting to be sent to the client */
+    uint32_t events; /**< epoll events registered for the socket */
+    uint32_t dropped; /**< frames dropped because the queue was full (slow client) */
+} kiss_tcp_client_t;
+
+
+/**
+ * @brief KISS over TCP server.
+ */
+typedef struct
+{
+    int listen_fd; /**< listening socket */
+    uint32_t listen_events; /**< epoll events registered for listen_fd, 0 while the descriptors are exhausted */
+    int epoll_fd; /**< epoll instance */
+    kiss_tcp_client_t clients[KISS_TCP_MAX_CLIENTS]; /**< connections */
+    uint32_t count; /**< clients connected */
+    kiss_instance_t *link; /**< instance of the link (standard KISS framing, reads that do not wait), NULL if none */
+    int link_fd; /**< descriptor of the link, watched by epoll and written through link_queue, -1 if none */
+    kiss_tcp_queue_t link_queue; /**< frames of the clients waiting to be written on link_fd */
+    uint32_t link_events; /**< epoll events registered for link_fd */
+    uint8_t paused; /**< 1 while the clients are not read because link_queue has no room for a frame */
+    kiss_frame_fn handler; /**< optional: called with the frames of the clients instead of sending them on the link */
+    void *user; /**< user pointer of the handler */
+    kiss_instance_t out; /**< encoder of the frames sent to the clients and to the link */
+    uint8_t out_buffer[2 * KISS_TCP_FRAME_SIZE + 3]; /**< buffer of the encoder (every byte escaped) */
+    uint8_t frame[KISS_TCP_FRAME_SIZE]; /**< decoded frame */
+} kiss_tcp_server_t;
+
+
+
+/**
+ * @brief Open the listening socket of the server.
+ * @param server server to initialize (it is big: declare it static)
+ * @param address IPv4 address to listen on (e.g. "127.0.0.1"), NULL for all the addresses
+ * @param port TCP port (8001 is the usual KISS port), 0 chooses a free one (see kiss_tcp_server_port)
+ * @retval KISS_ERR_IO the socket cannot be opened (errno tells why)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_tcp_server_init(kiss_tcp_server_t *const server, const char *const address, uint16_t port);
+
+
+
+/**
+ * @brief Set the link of the server (e.g. a TNC on kiss_serial with timeout_ms = 0).
+ *  Its data frames are sent to all the clients, the frames of the clients are sent on it.
+ *  With a descriptor the server queues the frames of the clients and writes them on fd without waiting; when the queue is full it
+ *  stops reading the clients until the link drains (TCP flow control slows the clients down, no frame is lost).
+ *  Without a descriptor they are sent with the write function of the link.
+ * @param server initialized server
+ * @param link initialized instance with standard KISS framing, its read must not wait
+ * @param fd descriptor of the link (made non-blocking), -1 to receive with kiss_tcp_server_poll_link and send with link->write
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_tcp_server_set_link(kiss_tcp_server_t *const server, kiss_instance_t *const link, int fd);
+
+
+
+/**
+ * @brief Send the frames of the clients to a handler instead of the link (e.g. to route them or to handle the commands).
+ * @param server initialized server
+ * @param handler called with the parser of the client, the standard KISS command byte and the decoded frame
+ * @param user user pointer of the handler
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_tcp_server_set_handler(kiss_tcp_server_t *const server, kiss_frame_fn handler, void *const user);
+
+
+
+/**
+ * @brief Wait for the sockets and the link and serve them: accept the clients, receive and forward their frames,
+ *  forward the frames of the link and send the queues.
+ * @param server initialized server
+ * @param timeout_ms maximum wait, 0 = do not wait, -1 = forever
+ * @retval KISS_ERR_IO epoll failed, the link read failed or accept failed (the clients are still served)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_tcp_server_run(kiss_tcp_server_t *const server, int32_t timeout_ms);
+
+
+
+/**
+ * @brief Receive the frames available on the link and send them to the clients, for a link without a descriptor.
+ * @param server initialized server with a link
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_tcp_server_poll_link(kiss_tcp_server_t *const server);
+
+
+
+/**
+ * @brief Send a frame to all the clients. It is encoded once and copied in the queue of every client,
+ *  a client whose queue is full does not get it (its dropped counter is incremented).
+ * @param server initialized server
+ * @param header standard KISS command byte (e.g. KISS_STD_HEADER(0, KISS_STD_DATA))
+ * @param payload frame
+ * @param length frame length
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_tcp_server_broadcast(kiss_tcp_server_t *const server, uint8_t header, const uint8_t *const payload, size_t length);
+
+
+
+/**
+ * @brief TCP port the server listens on.
+ * @param server initialized server
+ * @returns the port, 0 on error
+ */
+uint16_t kiss_tcp_server_port(const kiss_tcp_server_t *const server);
+
+
+
+/**
+ * @brief Close the clients and the listening socket. The link is not closed.
+ * @param server initialized server
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_tcp_server_close(kiss_tcp_server_t *const server);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
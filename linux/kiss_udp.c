@@ -0,0 +1,349 @@
+/* recvmmsg and sendmmsg are not in strict C99 */
+#define _GNU_SOURCE
+
+#include "kiss_udp.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+
+
+
+
+/* wait for the socket, 1 if ready, 0 on timeout */
+static int32_t kiss_udp_wait(const kiss_udp_t *const udp, short events)
+{
+    struct pollfd pfd;
+    pfd.fd = udp->fd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    int n;
+    do
+    {
+        n = poll(&pfd, 1, (int)udp->timeout_ms);
+    }
+    while(n < 0 && EINTR == errno);
+
+    if(n < 0)
+    {
+        return -KISS_ERR_IO;
+    }
+    return (n > 0) ? 1 : 0;
+}
+
+
+
+/* IPv4 address and port, NULL address for all the addresses */
+static int32_t kiss_udp_address(struct sockaddr_in *const addr, const char *const address, uint16_t port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    addr->sin_addr.s_addr = htonl(INADDR_ANY);
+    if(address != NULL && inet_pton(AF_INET, address, &addr->sin_addr) != 1)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    return KISS_OK;
+}
+
+
+
+/* receive the next batch of datagrams without waiting, the number received (0 if none) or -KISS_ERR_IO */
+static int32_t kiss_udp_receive(kiss_udp_t *const udp)
+{
+    struct mmsghdr msgs[KISS_UDP_BATCH];
+    struct iovec iov[KISS_UDP_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for(uint32_t i = 0; i < KISS_UDP_BATCH; i++)
+    {
+        iov[i].iov_base = udp->rx[i];
+        iov[i].iov_len = sizeof(udp->rx[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    udp->syscalls++;
+    int n = recvmmsg(udp->fd, msgs, KISS_UDP_BATCH, MSG_DONTWAIT, NULL);
+    if(n < 0)
+    {
+        /* ECONNREFUSED: an earlier datagram found no peer, nothing was received */
+        return (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno || ECONNREFUSED == errno) ? 0 : -KISS_ERR_IO;
+    }
+
+    for(int i = 0; i < n; i++)
+    {
+        udp->rx_len[i] = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? (size_t)KISS_UDP_DATAGRAM_SIZE + 1 : (size_t)msgs[i].msg_len;
+    }
+    udp->rx_count = (uint32_t)n;
+    udp->rx_next = 0;
+
+    return n;
+}
+
+
+
+int32_t kiss_udp_open(kiss_udp_t *const udp, const char *const address, uint16_t port, int32_t timeout_ms)
+{
+    if(NULL == udp)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    struct sockaddr_in addr;
+    if(kiss_udp_address(&addr, address, port) != KISS_OK)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    udp->rx_count = 0;
+    udp->rx_next = 0;
+    udp->tx_count = 0;
+    udp->syscalls = 0;
+    udp->timeout_ms = timeout_ms;
+    udp->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(udp->fd < 0)
+    {
+        return KISS_ERR_IO;
+    }
+
+    if(bind(udp->fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        (void)close(udp->fd);
+        udp->fd = -1;
+        return KISS_ERR_IO;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_udp_connect(kiss_udp_t *const udp, const char *const address, uint16_t port)
+{
+    if(NULL == udp || udp->fd < 0 || NULL == address)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    struct sockaddr_in addr;
+    if(kiss_udp_address(&addr, address, port) != KISS_OK)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* a connected socket needs no address per datagram and drops the datagrams of the others */
+    if(connect(udp->fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        return KISS_ERR_IO;
+    }
+
+    return KISS_OK;
+}
+
+
+
+uint16_t kiss_udp_port(const kiss_udp_t *const udp)
+{
+    if(NULL == udp || udp->fd < 0)
+    {
+        return 0;
+    }
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if(getsockname(udp->fd, (struct sockaddr *)&addr, &len) != 0)
+    {
+        return 0;
+    }
+    return ntohs(addr.sin_port);
+}
+
+
+
+int32_t kiss_udp_flush(kiss_udp_t *const udp)
+{
+    if(NULL == udp || udp->fd < 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    struct mmsghdr msgs[KISS_UDP_BATCH];
+    struct iovec iov[KISS_UDP_BATCH];
+    uint32_t sent = 0;
+
+    while(sent < udp->tx_count)
+    {
+        uint32_t count = udp->tx_count - sent;
+        memset(msgs, 0, sizeof(msgs[0]) * count);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            iov[i].iov_base = udp->tx[sent + i];
+            iov[i].iov_len = udp->tx_len[sent + i];
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        udp->syscalls++;
+        int n = sendmmsg(udp->fd, msgs, count, MSG_DONTWAIT);
+        if(n > 0)
+        {
+            sent += (uint32_t)n;
+        }
+        else if(n < 0 && (EINTR == errno || ECONNREFUSED == errno))
+        {
+            /* ECONNREFUSED reports an earlier datagram that found no peer, this one was not sent yet */
+        }
+        else if(n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+        {
+            int32_t ready = kiss_udp_wait(udp, POLLOUT);
+            if(ready <= 0)
+            {
+                /* keep the frames not sent at the start of the queue */
+                for(uint32_t i = sent; i < udp->tx_count && sent > 0; i++)
+                {
+                    memcpy(udp->tx[i - sent], udp->tx[i], udp->tx_len[i]);
+                    udp->tx_len[i - sent] = udp->tx_len[i];
+                }
+                udp->tx_count -= sent;
+                return (0 == ready) ? KISS_ERR_TIMEOUT : -ready;
+            }
+        }
+        else
+        {
+            udp->tx_count = 0;
+            return KISS_ERR_IO;
+        }
+    }
+
+    udp->tx_count = 0;
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_udp_close(kiss_udp_t *const udp)
+{
+    if(NULL == udp)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+    if(udp->fd < 0)
+    {
+        return KISS_OK;
+    }
+
+    int32_t err = kiss_udp_flush(udp);
+    if(close(udp->fd) != 0 && KISS_OK == err)
+    {
+        err = KISS_ERR_IO;
+    }
+    udp->fd = -1;
+    udp->rx_count = 0;
+    udp->rx_next = 0;
+    udp->tx_count = 0;
+
+    return err;
+}
+
+
+
+int32_t kiss_udp_write(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    if(NULL == kiss || NULL == kiss->context || (NULL == data && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_udp_t *udp = (kiss_udp_t *)kiss->context;
+    if(length > KISS_UDP_DATAGRAM_SIZE)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    if(KISS_UDP_BATCH == udp->tx_count)
+    {
+        int32_t err = kiss_udp_flush(udp);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+
+    memcpy(udp->tx[udp->tx_count], data, length);
+    udp->tx_len[udp->tx_count] = length;
+    udp->tx_count++;
+
+    if(KISS_UDP_BATCH == udp->tx_count)
+    {
+        return kiss_udp_flush(udp);
+    }
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_udp_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received)
+{
+    if(NULL == kiss || NULL == kiss->context || NULL == buffer || NULL == received)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_udp_t *udp = (kiss_udp_t *)kiss->context;
+    *received = 0;
+
+    if(udp->rx_next == udp->rx_count)
+    {
+        /* the peer may be waiting for the frames queued before it answers */
+        int32_t err = kiss_udp_flush(udp);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+
+        udp->rx_count = 0;
+        udp->rx_next = 0;
+        int32_t n = kiss_udp_receive(udp);
+        if(0 == n)
+        {
+            int32_t ready = kiss_udp_wait(udp, POLLIN);
+            n = (ready > 0) ? kiss_udp_receive(udp) : ready;
+        }
+        if(n < 0)
+        {
+            return -n;
+        }
+        if(0 == n)
+        {
+            return KISS_OK;
+        }
+    }
+
+    /* one datagram is one frame */
+    size_t length = udp->rx_len[udp->rx_next];
+    const uint8_t *datagram = udp->rx[udp->rx_next];
+    udp->rx_next++;
+    if(length > KISS_UDP_DATAGRAM_SIZE || length > dataLen)
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    memcpy(buffer, datagram, length);
+    *received = length;
+
+    return KISS_OK;
+}
+
+
+
+size_t kiss_udp_pending(const kiss_udp_t *const udp)
+{
+    return (NULL == udp) ? 0 : (size_t)(udp->rx_count - udp->rx_next);
+}
@@ -0,0 +1,138 @@
+#ifndef KISS_UDP_H
+#define KISS_UDP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../kissLIB.h"
+
+
+/*
+* UDP transport for kissLIB (Linux), for the instances initialized with KISS_FRAMING_DATAGRAM:
+* every datagram is exactly one frame, without delimiters and escapes.
+* The datagrams are received and sent in batches with recvmmsg/sendmmsg, one system call for up to KISS_UDP_BATCH frames.
+*/
+
+
+
+
+
+/* datagrams received or sent with one system call */
+#ifndef KISS_UDP_BATCH
+#define KISS_UDP_BATCH 32
+#endif
+
+/* longest datagram (header, payload and CRC32), a longer one is dropped with KISS_ERR_BUFFER_OVERFLOW */
+#ifndef KISS_UDP_DATAGRAM_SIZE
+#define KISS_UDP_DATAGRAM_SIZE 1472
+#endif
+
+
+/**
+ * @brief UDP socket used as the context of a kiss instance.
+ */
+typedef struct
+{
+    int fd; /**< socket, -1 when closed */
+    int32_t timeout_ms; /**< time a read waits for a datagram and a write waits for room in the socket, -1 = forever */
+    uint8_t rx[KISS_UDP_BATCH][KISS_UDP_DATAGRAM_SIZE]; /**< datagrams received and not given to kissLIB yet */
+    size_t rx_len[KISS_UDP_BATCH]; /**< length of every received datagram, more than KISS_UDP_DATAGRAM_SIZE when it was truncated */
+    uint32_t rx_count; /**< datagrams in rx */
+    uint32_t rx_next; /**< next datagram to give to kissLIB */
+    uint8_t tx[KISS_UDP_BATCH][KISS_UDP_DATAGRAM_SIZE]; /**< frames waiting to be sent */
+    size_t tx_len[KISS_UDP_BATCH]; /**< length of every frame in tx */
+    uint32_t tx_count; /**< frames in tx */
+    uint32_t syscalls; /**< recvmmsg and sendmmsg calls, for statistics */
+} kiss_udp_t;
+
+
+
+/**
+ * @brief Open a non-blocking UDP socket bound to a local address.
+ * @param udp socket to open (it is big: declare it static)
+ * @param address local IPv4 address (e.g. "127.0.0.1"), NULL for all the addresses
+ * @param port local UDP port, 0 chooses a free one (see kiss_udp_port)
+ * @param timeout_ms time a read waits for a datagram and a write waits for room in the socket, -1 = forever
+ * @retval KISS_ERR_IO the socket cannot be opened or bound (errno tells why)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_udp_open(kiss_udp_t *const udp, const char *const address, uint16_t port, int32_t timeout_ms);
+
+
+
+/**
+ * @brief Set the peer of the link: the frames are sent to it and only its datagrams are received.
+ * @param udp open socket
+ * @param address IPv4 address of the peer
+ * @param port UDP port of the peer
+ * @retval KISS_ERR_IO the peer cannot be set (errno tells why)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_udp_connect(kiss_udp_t *const udp, const char *const address, uint16_t port);
+
+
+
+/**
+ * @brief Local UDP port of the socket.
+ * @param udp open socket
+ * @returns the port, 0 on error
+ */
+uint16_t kiss_udp_port(const kiss_udp_t *const udp);
+
+
+
+/**
+ * @brief Send the frames written so far, with one sendmmsg for up to KISS_UDP_BATCH frames.
+ * @param udp open socket
+ * @retval KISS_ERR_TIMEOUT the socket had no room for timeout_ms, the frames not sent are still queued
+ * @retval KISS_ERR_IO the socket failed (errno tells why)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_udp_flush(kiss_udp_t *const udp);
+
+
+
+/**
+ * @brief Send the frames still queued and close the socket.
+ * @param udp open socket
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_udp_close(kiss_udp_t *const udp);
+
+
+
+/**
+ * @brief kiss_write_fn of the transport, the context of the instance is the kiss_udp_t.
+ *  The frame is queued and sent by kiss_udp_flush, when KISS_UDP_BATCH frames are queued, or before a read waits for datagrams.
+ * @retval KISS_ERR_BUFFER_OVERFLOW the frame is longer than KISS_UDP_DATAGRAM_SIZE
+ */
+int32_t kiss_udp_write(kiss_instance_t *const kiss, const uint8_t *const data, size_t length);
+
+
+
+/**
+ * @brief kiss_read_fn of the transport: gives one datagram, 0 bytes when none arrives within timeout_ms.
+ *  When no datagram is left from the last batch, the queued frames are sent and the next batch is received with one recvmmsg.
+ * @retval KISS_ERR_BUFFER_OVERFLOW the datagram does not fit the buffer of the instance or KISS_UDP_DATAGRAM_SIZE, it is dropped
+ */
+int32_t kiss_udp_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received);
+
+
+
+/**
+ * @brief Datagrams received and not given to kissLIB yet, an event loop waits on fd only when it is 0.
+ * @param udp open socket
+ * @returns the number of datagrams
+ */
+size_t kiss_udp_pending(const kiss_udp_t *const udp);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,566 @@
+/* syscall() is not in strict C99 */
+#define _DEFAULT_SOURCE
+
+#include "kiss_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+
+
+
+
+/* user_data of the operations: link index and direction */
+#define KISS_URING_OP_READ 0U
+#define KISS_URING_OP_WRITE 1U
+#define KISS_URING_USER_DATA(index, op) (((uint64_t)(index) << 1) | (op))
+
+/* io_uring_enter without liburing */
+static int kiss_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, const void *arg, size_t arg_size)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+
+
+/* monotonic clock in milliseconds */
+static int64_t kiss_uring_now_ms(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+/* frame state machine of kiss_receive_frame: 0 between frames, 1 after the opening delimiter, 2 inside the frame. Returns 1 at the end of a frame */
+static uint8_t kiss_uring_frame_state(uint8_t *const state, uint8_t b, uint8_t delimiter)
+{
+    if(delimiter == b)
+    {
+        uint8_t end = (2 == *state);
+        *state = end ? 0 : 1;
+        return end;
+    }
+    if(1 == *state)
+    {
+        *state = 2;
+    }
+    return 0;
+}
+
+
+
+/* a free submission entry at the tail, kiss_uring_queue publishes it */
+static struct io_uring_sqe *kiss_uring_sqe(kiss_uring_t *const ring)
+{
+    uint32_t tail = *ring->sq_tail;
+    uint32_t head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if(tail - head > ring->sq_mask)
+    {
+        return NULL;
+    }
+
+    uint32_t i = tail & ring->sq_mask;
+    ring->sq_array[i] = i;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe *)ring->sqes)[i];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+
+
+/* queue a read or a write of a link in the registered buffers (the buffer index is 2 * link + op) */
+static void kiss_uring_queue(kiss_uring_t *const ring, uint32_t index, uint32_t op, uint8_t *const data, size_t length)
+{
+    struct io_uring_sqe *sqe = kiss_uring_sqe(ring);
+    if(NULL == sqe)
+    {
+        /* one read and one write per link: the ring has room for all of them */
+        return;
+    }
+
+    sqe->opcode = (KISS_URING_OP_READ == op) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+    sqe->fd = ring->links[index].fd;
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = (uint32_t)length;
+    sqe->off = (uint64_t)-1;
+    sqe->buf_index = (uint16_t)(2 * index + op);
+    sqe->user_data = KISS_URING_USER_DATA(index, op);
+
+    ring->queued++;
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+
+
+/* post a read on every link without one and a write on every link with frames to send */
+static void kiss_uring_prepare(kiss_uring_t *const ring)
+{
+    for(uint32_t i = 0; i < KISS_URING_MAX_LINKS; i++)
+    {
+        kiss_uring_link_t *link = &ring->links[i];
+        if(link->fd < 0 || link->error != KISS_OK)
+        {
+            continue;
+        }
+
+        if(0 == link->reading)
+        {
+            /* keep the partial frame at the start of the buffer, the read appends to it */
+            if(link->rx_pos > 0)
+            {
+                memmove(link->rx, &link->rx[link->rx_pos], link->rx_len - link->rx_pos);
+                link->rx_len -= link->rx_pos;
+                link->rx_pos = 0;
+            }
+            if(link->rx_len == sizeof(link->rx) && 0 == link->rx_frames)
+            {
+                /* a frame longer than the buffer: dropped */
+                link->rx_len = 0;
+                link->rx_scan = 0;
+                link->rx_state = 0;
+            }
+            /* a full buffer with frames not given to kissLIB yet: no read until kiss_uring_run takes them */
+            if(link->rx_len < sizeof(link->rx))
+            {
+                kiss_uring_queue(ring, i, KISS_URING_OP_READ, &link->rx[link->rx_len], sizeof(link->rx) - link->rx_len);
+                link->reading = 1;
+            }
+        }
+
+        if(0 == link->tx_busy && link->tx_len > 0)
+        {
+            kiss_uring_queue(ring, i, KISS_URING_OP_WRITE, link->tx, link->tx_len);
+            link->tx_busy = link->tx_len;
+        }
+    }
+}
+
+
+
+/* a completion: a read appends to the receive buffer, a write removes the bytes written */
+static void kiss_uring_complete(kiss_uring_t *const ring, const struct io_uring_cqe *const cqe)
+{
+    uint32_t index = (uint32_t)(cqe->user_data >> 1);
+    uint32_t op = (uint32_t)(cqe->user_data & 1U);
+    if(index >= KISS_URING_MAX_LINKS)
+    {
+        return;
+    }
+
+    kiss_uring_link_t *link = &ring->links[index];
+    int32_t res = cqe->res;
+
+    if(KISS_URING_OP_READ == op)
+    {
+        link->reading = 0;
+        if(res > 0)
+        {
+            uint8_t delimiter = kiss_frame_delimiter(link->kiss);
+            for(size_t i = link->rx_len; i < link->rx_len + (size_t)res; i++)
+            {
+                link->rx_frames += kiss_uring_frame_state(&link->rx_scan, link->rx[i], delimiter);
+            }
+            link->rx_len += (size_t)res;
+            return;
+        }
+    }
+    else
+    {
+        link->tx_busy = 0;
+        if(res > 0)
+        {
+            memmove(link->tx, &link->tx[res], link->tx_len - (size_t)res);
+            link->tx_len -= (size_t)res;
+            return;
+        }
+    }
+
+    /* end of file, or an error that posting the operation again would not fix */
+    if(res != -EAGAIN && res != -EINTR)
+    {
+        link->error = KISS_ERR_IO;
+        link->io_errno = (0 == res) ? 0 : -res;
+    }
+}
+
+
+
+/* submit the queued operations, wait for completions if asked and process all the completions */
+static int32_t kiss_uring_submit(kiss_uring_t *const ring, int32_t timeout_ms)
+{
+    uint32_t flags = 0;
+    uint32_t min_complete = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    const void *argp = NULL;
+    size_t arg_size = 0;
+
+    if(timeout_ms != 0 && ring->inflight + ring->queued > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+        if(timeout_ms > 0)
+        {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            argp = &arg;
+            arg_size = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+
+    if(ring->queued > 0 || min_complete > 0)
+    {
+        int n = kiss_uring_enter(ring->fd, ring->queued, min_complete, flags, argp, arg_size);
+        ring->syscalls++;
+        if(n < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY)
+        {
+            return KISS_ERR_IO;
+        }
+        if(n > 0)
+        {
+            ring->queued -= (uint32_t)n;
+            ring->inflight += (uint32_t)n;
+        }
+    }
+
+    uint32_t head = *ring->cq_head;
+    uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail)
+    {
+        kiss_uring_complete(ring, &((const struct io_uring_cqe *)ring->cqes)[head & ring->cq_mask]);
+        ring->inflight--;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_uring_init(kiss_uring_t *const ring)
+{
+    if(NULL == ring)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    ring->fd = -1;
+    ring->sq_map = MAP_FAILED;
+    ring->cq_map = MAP_FAILED;
+    ring->sqes = MAP_FAILED;
+    ring->queued = 0;
+    ring->inflight = 0;
+    ring->syscalls = 0;
+    for(uint32_t i = 0; i < KISS_URING_MAX_LINKS; i++)
+    {
+        ring->links[i].ring = ring;
+        ring->links[i].kiss = NULL;
+        ring->links[i].fd = -1;
+    }
+
+    /* a read and a write per link */
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, 2 * KISS_URING_MAX_LINKS, &params);
+    if(ring->fd < 0)
+    {
+        return KISS_ERR_IO;
+    }
+    if(0 == (params.features & IORING_FEAT_EXT_ARG))
+    {
+        (void)kiss_uring_close(ring);
+        errno = ENOSYS;
+        return KISS_ERR_IO;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(ring->cq_map_size > ring->sq_map_size)
+        {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = ring->sq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(MAP_FAILED == ring->sq_map)
+    {
+        (void)kiss_uring_close(ring);
+        return KISS_ERR_IO;
+    }
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_map = ring->sq_map;
+    }
+    else
+    {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(MAP_FAILED == ring->cq_map || MAP_FAILED == ring->sqes)
+    {
+        (void)kiss_uring_close(ring);
+        return KISS_ERR_IO;
+    }
+
+    uint8_t *sq = (uint8_t *)ring->sq_map;
+    uint8_t *cq = (uint8_t *)ring->cq_map;
+    ring->sq_head = (uint32_t *)(void *)(sq + params.sq_off.head);
+    ring->sq_tail = (uint32_t *)(void *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(uint32_t *)(void *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t *)(void *)(sq + params.sq_off.array);
+    ring->cq_head = (uint32_t *)(void *)(cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t *)(void *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(uint32_t *)(void *)(cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+
+    /* the receive and transmit buffers of every link: 2 * link + op */
+    struct iovec iov[2 * KISS_URING_MAX_LINKS];
+    for(uint32_t i = 0; i < KISS_URING_MAX_LINKS; i++)
+    {
+        iov[2 * i + KISS_URING_OP_READ].iov_base = ring->links[i].rx;
+        iov[2 * i + KISS_URING_OP_READ].iov_len = sizeof(ring->links[i].rx);
+        iov[2 * i + KISS_URING_OP_WRITE].iov_base = ring->links[i].tx;
+        iov[2 * i + KISS_URING_OP_WRITE].iov_len = sizeof(ring->links[i].tx);
+    }
+    if(syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, 2 * KISS_URING_MAX_LINKS) < 0)
+    {
+        /* e.g. RLIMIT_MEMLOCK too low for the buffers */
+        (void)kiss_uring_close(ring);
+        return KISS_ERR_IO;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_uring_close(kiss_uring_t *const ring)
+{
+    if(NULL == ring || ring->fd < 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    int saved = errno;
+    if(ring->sqes != MAP_FAILED)
+    {
+        (void)munmap(ring->sqes, ring->sqes_size);
+    }
+    if(ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map)
+    {
+        (void)munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if(ring->sq_map != MAP_FAILED)
+    {
+        (void)munmap(ring->sq_map, ring->sq_map_size);
+    }
+    ring->sqes = MAP_FAILED;
+    ring->cq_map = MAP_FAILED;
+    ring->sq_map = MAP_FAILED;
+
+    /* the operations still posted are cancelled by the kernel */
+    (void)close(ring->fd);
+    ring->fd = -1;
+    errno = saved;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_uring_add(kiss_uring_t *const ring, kiss_instance_t *const kiss, int fd)
+{
+    if(NULL == ring || NULL == kiss || fd < 0 || ring->fd < 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_uring_link_t *link = NULL;
+    for(uint32_t i = 0; i < KISS_URING_MAX_LINKS && NULL == link; i++)
+    {
+        if(ring->links[i].fd < 0)
+        {
+            link = &ring->links[i];
+        }
+    }
+    if(NULL == link)
+    {
+        return KISS_ERR_TABLE_FULL;
+    }
+
+    /* a non-blocking descriptor would complete the reads with -EAGAIN instead of waiting in the kernel */
+    int flags = fcntl(fd, F_GETFL);
+    if(flags < 0 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+    {
+        return KISS_ERR_IO;
+    }
+
+    /* VMIN = 0 would complete the reads with 0 bytes (end of file), VMIN = 1 completes them with what has arrived */
+    struct termios tio;
+    if(isatty(fd) && 0 == tcgetattr(fd, &tio))
+    {
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        if(tcsetattr(fd, TCSANOW, &tio) != 0)
+        {
+            return KISS_ERR_IO;
+        }
+    }
+
+    link->kiss = kiss;
+    link->fd = fd;
+    link->error = KISS_OK;
+    link->io_errno = 0;
+    link->rx_pos = 0;
+    link->rx_len = 0;
+    link->rx_frames = 0;
+    link->rx_scan = 0;
+    link->rx_state = 0;
+    link->reading = 0;
+    link->tx_len = 0;
+    link->tx_busy = 0;
+    kiss->context = link;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_uring_run(kiss_uring_t *const ring, int32_t timeout_ms, uint32_t *const frames)
+{
+    if(NULL == ring || ring->fd < 0)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    /* the writes of the frames encoded since the last call go with the reads, one system call */
+    kiss_uring_prepare(ring);
+    int32_t err = kiss_uring_submit(ring, timeout_ms);
+    if(err != KISS_OK)
+    {
+        return err;
+    }
+
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < KISS_URING_MAX_LINKS; i++)
+    {
+        kiss_uring_link_t *link = &ring->links[i];
+
+        /* kiss_uring_read counts the frames given to kissLIB, every call takes at least one byte */
+        while(link->fd >= 0 && link->rx_frames > 0 && link->rx_pos < link->rx_len)
+        {
+            if(KISS_OK == kiss_receive_frame(link->kiss, 4))
+            {
+                (void)kiss_dispatch(link->kiss, NULL, NULL, NULL);
+                count++;
+            }
+        }
+    }
+
+    if(frames)
+    {
+        *frames = count;
+    }
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_uring_write(kiss_instance_t *const kiss, const uint8_t *const data, size_t length)
+{
+    if(NULL == kiss || NULL == kiss->context || (NULL == data && length > 0))
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_uring_link_t *link = (kiss_uring_link_t *)kiss->context;
+    if(length > sizeof(link->tx))
+    {
+        return KISS_ERR_BUFFER_OVERFLOW;
+    }
+
+    /*
+    * no room: wait for the write in progress, the frames received meanwhile stay in the receive buffers
+    * (a link whose buffer fills up stops reading). A peer that does not read must not stop the whole hub
+    */
+    int64_t deadline = kiss_uring_now_ms() + KISS_URING_WRITE_TIMEOUT_MS;
+    while(link->error == KISS_OK && link->tx_len + length > sizeof(link->tx))
+    {
+        int64_t left = deadline - kiss_uring_now_ms();
+        if(left <= 0)
+        {
+            return KISS_ERR_TIMEOUT;
+        }
+        kiss_uring_prepare(link->ring);
+        int32_t err = kiss_uring_submit(link->ring, (int32_t)left);
+        if(err != KISS_OK)
+        {
+            return err;
+        }
+    }
+    if(link->error != KISS_OK)
+    {
+        return link->error;
+    }
+
+    memcpy(&link->tx[link->tx_len], data, length);
+    link->tx_len += length;
+
+    return KISS_OK;
+}
+
+
+
+int32_t kiss_uring_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received)
+{
+    if(NULL == kiss || NULL == kiss->context || NULL == buffer || NULL == received)
+    {
+        return KISS_ERR_INVALID_PARAMS;
+    }
+
+    kiss_uring_link_t *link = (kiss_uring_link_t *)kiss->context;
+    uint8_t delimiter = kiss_frame_delimiter(kiss);
+    size_t n = link->rx_len - link->rx_pos;
+    if(n > dataLen)
+    {
+        n = dataLen;
+    }
+
+    /* up to the end of the frame, kiss_receive_frame drops what comes after it */
+    size_t i = 0;
+    uint8_t end = 0;
+    while(i < n && 0 == end)
+    {
+        buffer[i] = link->rx[link->rx_pos + i];
+        end = kiss_uring_frame_state(&link->rx_state, buffer[i], delimiter);
+        i++;
+    }
+    if(end && link->rx_frames > 0)
+    {
+        link->rx_frames--;
+    }
+
+    link->rx_pos += i;
+    *received = i;
+
+    return KISS_OK;
+}
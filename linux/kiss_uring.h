@@ -0,0 +1,166 @@
+#ifndef KISS_URING_H
+#define KISS_URING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../kissLIB.h"
+
+
+/*
+* io_uring transport for kissLIB (Linux 5.11 or later), for hubs with many links.
+* Every link always has a read posted, the reads and writes of all the links are submitted and
+* reaped with one system call per kiss_uring_run, and the link buffers are registered with the kernel
+* (IORING_OP_READ_FIXED / IORING_OP_WRITE_FIXED) so they are not mapped again at every operation.
+* No liburing: the rings are set up with the system calls directly.
+*/
+
+
+
+
+
+/* maximum number of links of a hub */
+#ifndef KISS_URING_MAX_LINKS
+#define KISS_URING_MAX_LINKS 64
+#endif
+
+/* receive buffer of a link, it holds at least one whole frame */
+#ifndef KISS_URING_RX_SIZE
+#define KISS_URING_RX_SIZE 4096
+#endif
+
+/* transmit buffer of a link, the frames sent between two kiss_uring_run are written together */
+#ifndef KISS_URING_TX_SIZE
+#define KISS_URING_TX_SIZE 4096
+#endif
+
+
+/* longest wait of kiss_uring_write for room in the transmit buffer of a link */
+#ifndef KISS_URING_WRITE_TIMEOUT_MS
+#define KISS_URING_WRITE_TIMEOUT_MS 1000
+#endif
+
+
+/**
+ * @brief one link of the hub, the context of its kiss instance.
+ */
+typedef struct
+{
+    struct kiss_uring_t *ring; /**< hub of the link */
+    kiss_instance_t *kiss; /**< instance of the link */
+    int fd; /**< descriptor, -1 when the slot is free */
+    int32_t error; /**< KISS_OK, or the error that stopped the link (KISS_ERR_IO with the errno of the completion in io_errno) */
+    int32_t io_errno; /**< errno of the failed read or write */
+    uint8_t rx[KISS_URING_RX_SIZE]; /**< received data, registered buffer */
+    size_t rx_pos; /**< first byte not given to kissLIB */
+    size_t rx_len; /**< bytes in rx */
+    size_t rx_frames; /**< complete frames in rx */
+    uint8_t rx_scan; /**< frame state at rx_len (0 between frames, 1 after the opening delimiter, 2 inside the frame) */
+    uint8_t rx_state; /**< frame state at rx_pos */
+    uint8_t reading; /**< 1 while a read is posted */
+    uint8_t tx[KISS_URING_TX_SIZE]; /**< frames to send, registered buffer */
+    size_t tx_len; /**< bytes in tx */
+    size_t tx_busy; /**< bytes at the start of tx being written by the kernel */
+} kiss_uring_link_t;
+
+
+/**
+ * @brief hub of links served by one io_uring.
+ */
+typedef struct kiss_uring_t
+{
+    int fd; /**< io_uring descriptor, -1 when not initialized */
+    void *sq_map; /**< submission ring mapping */
+    size_t sq_map_size; /**< size of sq_map */
+    void *cq_map; /**< completion ring mapping (the same as sq_map on kernels with a single mapping) */
+    size_t cq_map_size; /**< size of cq_map */
+    void *sqes; /**< submission entries mapping */
+    size_t sqes_size; /**< size of sqes */
+    uint32_t *sq_head; /**< submission ring head, moved by the kernel */
+    uint32_t *sq_tail; /**< submission ring tail */
+    uint32_t sq_mask; /**< submission ring mask */
+    uint32_t *sq_array; /**< submission ring indexes */
+    uint32_t *cq_head; /**< completion ring head */
+    uint32_t *cq_tail; /**< completion ring tail, moved by the kernel */
+    uint32_t cq_mask; /**< completion ring mask */
+    void *cqes; /**< completion entries */
+    uint32_t queued; /**< submission entries written and not submitted yet */
+    uint32_t inflight; /**< operations submitted and not completed */
+    kiss_uring_link_t links[KISS_URING_MAX_LINKS]; /**< links of the hub */
+    uint32_t syscalls; /**< io_uring_enter calls, for statistics */
+} kiss_uring_t;
+
+
+
+/**
+ * @brief Create the io_uring of a hub and register the link buffers.
+ * @param ring hub to initialize (it is big: declare it static)
+ * @retval KISS_ERR_IO io_uring is not available (errno tells why, e.g. ENOSYS or EPERM)
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_uring_init(kiss_uring_t *const ring);
+
+
+
+/**
+ * @brief Close the io_uring of the hub. The descriptors of the links are not closed.
+ * @param ring initialized hub
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_uring_close(kiss_uring_t *const ring);
+
+
+
+/**
+ * @brief Add a link to the hub. The instance must be initialized with kiss_uring_write and kiss_uring_read,
+ *  its context becomes the link. The descriptor is made blocking (the kernel waits, not the caller) and a terminal
+ *  gets VMIN = 1, VTIME = 0 so that a read completes with what has arrived.
+ * @param ring initialized hub
+ * @param kiss initialized instance of the link
+ * @param fd serial port, pty or socket
+ * @retval KISS_ERR_TABLE_FULL the hub has KISS_URING_MAX_LINKS links
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_uring_add(kiss_uring_t *const ring, kiss_instance_t *const kiss, int fd);
+
+
+
+/**
+ * @brief Submit the reads and writes of all the links, wait for completions and give every frame received to kiss_dispatch
+ *  (the instances use their handler table). One io_uring_enter system call for the whole hub.
+ * @param ring initialized hub
+ * @param timeout_ms maximum wait for a completion, 0 = do not wait, -1 = forever
+ * @param frames if not NULL, frames dispatched
+ * @retval KISS_ERR_IO the io_uring failed. A failed link only sets its own error and stops
+ * @return Any number of errors or KISS_OK(0) if everything went ok
+ */
+int32_t kiss_uring_run(kiss_uring_t *const ring, int32_t timeout_ms, uint32_t *const frames);
+
+
+
+/**
+ * @brief kiss_write_fn of the transport: the frame is copied in the transmit buffer of the link and written by the next kiss_uring_run.
+ *  When the buffer is full it waits for the writes in progress (the frames received meanwhile stay buffered).
+ * @retval KISS_ERR_BUFFER_OVERFLOW the frame is longer than KISS_URING_TX_SIZE
+ * @retval KISS_ERR_TIMEOUT the buffer had no room for KISS_URING_WRITE_TIMEOUT_MS, the frame is not sent
+ */
+int32_t kiss_uring_write(kiss_instance_t *const kiss, const uint8_t *const data, size_t length);
+
+
+
+/**
+ * @brief kiss_read_fn of the transport: gives the received data up to the end of a frame, 0 bytes when there is nothing.
+ *  It never waits, kiss_uring_run receives the frames.
+ */
+int32_t kiss_uring_read(kiss_instance_t *const kiss, uint8_t *const buffer, size_t dataLen, size_t *const received);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif